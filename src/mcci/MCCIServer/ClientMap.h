@@ -0,0 +1,240 @@
+
+#pragma once
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+// entries kept inside the map itself, sorted, before it takes an array and an index
+#define CLIENT_MAP_INLINE 4
+
+
+/**
+   A map from small integer keys (client ids) to values, for the handful of subscribers
+   a request bank usually has per key.
+
+   Up to CLIENT_MAP_INLINE entries are kept in the map object itself, sorted by key, and
+   looked up by a scan; nothing is allocated for them.  Past that, the entries move to an
+   array (in no particular order), and an open-addressing index of their positions is
+   built beside it, twice the array's size, with linear probing and backward-shift
+   deletion; each doubles when the array is full.  Either way the entries are contiguous,
+   so iterating over them is a walk along an array, and an iterator is a pointer to a
+   pair<Key, Value>.
+
+   Removing an entry fills its place with the last one, so an erase invalidates iterators
+   to the last entry as well as to the erased one.  Inserting may move every entry.
+
+   The array and the index are allocated through Alloc, rebound to each.
+ */
+template <typename Key, typename Value,
+          typename Alloc = std::allocator<pair<Key, Value> > >
+class ClientMap
+{
+  public:
+    typedef pair<Key, Value> value_type;
+    typedef value_type* iterator;
+    typedef const value_type* const_iterator;
+
+  protected:
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<value_type> EntryAlloc;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<uint32_t> IndexAlloc;
+
+    EntryAlloc m_alloc;
+    value_type* m_entries;    // NULL while the entries are inline
+    uint32_t* m_index;        // 2 * m_capacity slots, each an entry's position + 1, or 0
+    unsigned int m_size;
+    unsigned int m_capacity;  // of m_entries
+    unsigned int m_shift;     // 32 - log2 of the index's slots
+    value_type m_inline[CLIENT_MAP_INLINE];
+
+  public:
+
+    ClientMap(const Alloc& alloc = Alloc()) : m_alloc(alloc)
+    {
+        this->m_entries = NULL;
+        this->m_index = NULL;
+        this->m_size = 0;
+        this->m_capacity = 0;
+        this->m_shift = 0;
+    }
+
+    ~ClientMap() { this->release(); }
+
+    bool empty() const { return 0 == this->m_size; }
+    unsigned int size() const { return this->m_size; }
+
+    iterator begin() { return this->data(); }
+    iterator end() { return this->data() + this->m_size; }
+    const_iterator begin() const { return this->data(); }
+    const_iterator end() const { return this->data() + this->m_size; }
+
+
+    iterator find(Key k)
+    {
+        if (!this->m_entries)
+        {
+            for (unsigned int i = 0; i < this->m_size; ++i)
+            {
+                if (this->m_inline[i].first == k) return this->m_inline + i;
+                if (k < this->m_inline[i].first) break;
+            }
+            return this->end();
+        }
+
+        uint32_t slot = this->index_slot(k);
+        return this->m_index[slot] ? this->m_entries + this->m_index[slot] - 1 : this->end();
+    }
+
+    const_iterator find(Key k) const { return const_cast<ClientMap*>(this)->find(k); }
+
+
+    // the value for a key, inserted (as Value()) if it isn't there
+    Value& operator[](Key k)
+    {
+        iterator it = this->find(k);
+        if (this->end() != it) return it->second;
+        return this->insert_new(k)->second;
+    }
+
+
+    // remove a key, if it's there; returns the number removed
+    unsigned int erase(Key k)
+    {
+        if (!this->m_entries)
+        {
+            iterator it = this->find(k);
+            if (this->end() == it) return 0;
+            for (iterator last = this->end() - 1; it != last; ++it) *it = *(it + 1);
+            --this->m_size;
+            return 1;
+        }
+
+        uint32_t slot = this->index_slot(k);
+        if (!this->m_index[slot]) return 0;
+
+        uint32_t position = this->m_index[slot] - 1;
+        this->unindex(slot);
+        if (position != --this->m_size)
+        {
+            this->m_entries[position] = this->m_entries[this->m_size];
+            this->m_index[this->index_slot(this->m_entries[position].first)] = position + 1;
+        }
+        this->m_entries[this->m_size].~value_type();
+        return 1;
+    }
+
+
+  protected:
+
+    // the entries are the map's own
+    ClientMap(const ClientMap &rhs);
+    ClientMap& operator=(const ClientMap &rhs);
+
+
+    value_type* data() const
+    {
+        return this->m_entries ? this->m_entries : const_cast<value_type*>(this->m_inline);
+    }
+
+
+    iterator insert_new(Key k)
+    {
+        if (!this->m_entries)
+        {
+            if (this->m_size < CLIENT_MAP_INLINE)
+            {
+                // keep them sorted, so a scan can stop early
+                iterator it = this->end();
+                for (; it != this->begin() && k < (it - 1)->first; --it) *it = *(it - 1);
+                it->first = k;
+                it->second = Value();
+                ++this->m_size;
+                return it;
+            }
+            this->grow(2 * CLIENT_MAP_INLINE);
+        }
+        else if (this->m_size == this->m_capacity)
+        {
+            this->grow(2 * this->m_capacity);
+        }
+
+        value_type* e = new (this->m_entries + this->m_size) value_type(k, Value());
+        this->m_index[this->index_slot(k)] = ++this->m_size;
+        return e;
+    }
+
+
+    // move the entries to an array of `capacity`, and index them again
+    void grow(unsigned int capacity)
+    {
+        value_type* entries = allocator_traits<EntryAlloc>::allocate(this->m_alloc, capacity);
+        for (unsigned int i = 0; i < this->m_size; ++i) new (entries + i) value_type(this->data()[i]);
+
+        unsigned int size = this->m_size;
+        this->release();
+        this->m_entries = entries;
+        this->m_capacity = capacity;
+        this->m_size = size;
+
+        IndexAlloc index_alloc(this->m_alloc);
+        this->m_index = allocator_traits<IndexAlloc>::allocate(index_alloc, 2 * capacity);
+        fill(this->m_index, this->m_index + 2 * capacity, 0);
+        this->m_shift = 32;
+        for (unsigned int n = 2 * capacity; n > 1; n >>= 1) --this->m_shift;
+
+        for (unsigned int i = 0; i < size; ++i)
+            this->m_index[this->index_slot(entries[i].first)] = i + 1;
+    }
+
+
+    // give back the array and the index, if there are any, leaving the map empty and inline
+    void release()
+    {
+        if (this->m_entries)
+        {
+            for (unsigned int i = 0; i < this->m_size; ++i) this->m_entries[i].~value_type();
+            allocator_traits<EntryAlloc>::deallocate(this->m_alloc, this->m_entries, this->m_capacity);
+
+            IndexAlloc index_alloc(this->m_alloc);
+            allocator_traits<IndexAlloc>::deallocate(index_alloc, this->m_index, 2 * this->m_capacity);
+        }
+        this->m_entries = NULL;
+        this->m_index = NULL;
+        this->m_size = 0;
+        this->m_capacity = 0;
+    }
+
+
+    uint32_t home(Key k) const { return ((uint32_t)k * 2654435769u) >> this->m_shift; }
+
+    // the index slot holding k, or the empty one where it would go
+    uint32_t index_slot(Key k) const
+    {
+        uint32_t mask = 2 * this->m_capacity - 1;
+        uint32_t slot = this->home(k);
+        while (this->m_index[slot] && this->m_entries[this->m_index[slot] - 1].first != k)
+            slot = (slot + 1) & mask;
+        return slot;
+    }
+
+    // empty an index slot, shifting back the entries after it that can move closer to home
+    void unindex(uint32_t slot)
+    {
+        uint32_t mask = 2 * this->m_capacity - 1;
+        for (uint32_t next = (slot + 1) & mask; this->m_index[next]; next = (next + 1) & mask)
+        {
+            uint32_t h = this->home(this->m_entries[this->m_index[next] - 1].first);
+            if (((next - h) & mask) >= ((next - slot) & mask))
+            {
+                this->m_index[slot] = this->m_index[next];
+                slot = next;
+            }
+        }
+        this->m_index[slot] = 0;
+    }
+};
@@ -0,0 +1,630 @@
+
+#pragma once
+
+#include "FibonacciHeap.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+#include <stdint.h>
+
+using namespace std;
+
+
+// bytes per chunk of nodes; a chunk is allocated whole and never moves.  64K is a size
+//  class of CMCCIArena, so a chunk from one is not rounded up
+#define COMPACT_HEAP_CHUNK_BYTES (64 * 1024)
+
+// the index that links to nothing
+#define COMPACT_HEAP_NONE 0xffffffffu
+
+
+template <typename Key, typename Data> class CompactFibonacciHeapNode
+{
+  protected:
+    Key m_key;
+    Data m_data;
+
+    // indices of the nodes around it, as in FibonacciHeapNode's pointers
+    uint32_t m_previous;
+    uint32_t m_next;
+    uint32_t m_child;
+    uint32_t m_parent;
+    uint32_t m_index;   // its own
+
+    uint16_t m_degree;
+    bool m_mark;
+
+  public:
+    CompactFibonacciHeapNode(Key k, Data d, uint32_t i)
+      : m_key(k), m_data(d), m_previous(i), m_next(i), m_child(COMPACT_HEAP_NONE),
+        m_parent(COMPACT_HEAP_NONE), m_index(i), m_degree(0), m_mark(false) {}
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    template <typename K, typename D, typename A> friend class CompactFibonacciHeap;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, typename Alloc> class CompactFibonacciHeap;
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream &, const CompactFibonacciHeap<Key, Data, Alloc> &);
+
+
+/**
+   A Fibonacci heap whose nodes link to one another by 32-bit index instead of by pointer,
+   with the same interface as FibonacciHeap, so a RequestBank can keep its timeouts in one.
+
+   The nodes are kept in chunks of COMPACT_HEAP_CHUNK_BYTES, each allocated whole
+   (through Alloc, rebound to the node type) and never moved, so a Node* stays good for
+   as long as the node is in the heap, and serves as the handle as it does in
+   FibonacciHeap.  A node's links and bookkeeping take 24 bytes rather than
+   FibonacciHeapNode's 40, and nodes allocated together sit together, so more of a large
+   heap fits in cache.  Freed nodes are reused, newest first, before a new chunk is
+   taken; chunks are only given back by clear().
+
+   The algorithm is FibonacciHeap's.  remove() and alter_key() don't need the caller's
+   minus_infinity: the node is cut to the root list and taken out as if it were the
+   minimum.
+ */
+template <typename Key, typename Data,
+          typename Alloc = std::allocator<CompactFibonacciHeapNode<Key, Data> > >
+class CompactFibonacciHeap
+{
+  public:
+    typedef CompactFibonacciHeapNode<Key, Data> Node;
+
+  protected:
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node*> ChunkAlloc;
+
+    static const uint32_t CHUNK = COMPACT_HEAP_CHUNK_BYTES / sizeof(Node);  // nodes per chunk
+
+    NodeAlloc m_alloc;
+    vector<Node*, ChunkAlloc> m_chunks;
+
+    uint32_t m_used;     // nodes ever handed out from the chunks
+    uint32_t m_free;     // the most recently freed node, linked through its first word
+
+    uint32_t m_min;
+    unsigned int m_count;
+    unsigned int m_max_degree;
+    uint32_t m_degree_roots[FIBONACCI_HEAP_MAX_DEGREE];  // consolidation's table; all NONE otherwise
+
+  public:
+
+    CompactFibonacciHeap(const Alloc& alloc = Alloc()) : m_alloc(alloc), m_chunks(ChunkAlloc(alloc))
+    {
+        this->m_used = 0;
+        this->m_free = COMPACT_HEAP_NONE;
+        this->m_min = COMPACT_HEAP_NONE;
+        this->m_count = 0;
+        this->m_max_degree = 0;
+        fill(this->m_degree_roots, this->m_degree_roots + FIBONACCI_HEAP_MAX_DEGREE, COMPACT_HEAP_NONE);
+    }
+
+    ~CompactFibonacciHeap() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const CompactFibonacciHeap<Key, Data, Alloc>& v);
+
+    bool empty() const { return 0 == this->m_count; }
+    unsigned int size() const { return this->m_count; }
+
+
+    Node* insert(Key k, Data d)
+    {
+        uint32_t i = this->create_node(k, d);
+        this->insert_root(i);
+        ++this->m_count;
+        return &this->at(i);
+    }
+
+
+    Node* minimum() const
+    {
+        if (COMPACT_HEAP_NONE == this->m_min) throw string("no minimum element");
+        return &this->at(this->m_min);
+    }
+
+
+    void remove_minimum()
+    {
+        if (COMPACT_HEAP_NONE == this->m_min) throw string("trying to remove from an empty heap");
+        this->remove_minimum_h(true);
+    }
+
+
+    // (minus_infinity is unused; it is here so that the heaps can be swapped for one another)
+    void remove(Node* node, Key minus_infinity)
+    {
+        this->cut_to_root(node->m_index);
+        this->m_min = node->m_index;
+        this->remove_minimum_h(true);
+    }
+
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+
+        node->m_key = new_key;
+        if (COMPACT_HEAP_NONE != node->m_parent && !(new_key < this->at(node->m_parent).m_key))
+            return;  // heap invariant not violated - nothing more to do
+
+        this->cut_to_root(node->m_index);
+        if (new_key < this->at(this->m_min).m_key) this->m_min = node->m_index;
+    }
+
+
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        if (new_key < node->m_key)
+        {
+            this->decrease_key(node, new_key);
+        }
+        else if (new_key > node->m_key)
+        {
+            // take it out as the minimum, keeping the node, and put it back alone
+            uint32_t i = node->m_index;
+            this->cut_to_root(i);
+            this->m_min = i;
+            this->remove_minimum_h(false);
+
+            node->m_key = new_key;
+            node->m_mark = false;
+            this->insert_root(i);
+            ++this->m_count;  // remove_minimum_h counted it out
+        }
+    }
+
+
+    // take all of other's nodes, leaving it empty.  its chunks are taken over whole, after
+    //  this heap's, and its nodes renumbered to match, so they don't move and handles to
+    //  them stay good; other must allocate as this heap does.  the root rings are then
+    //  spliced, as in FibonacciHeap::merge
+    void merge(CompactFibonacciHeap& other)
+    {
+        if (&other == this || !other.m_count) return;
+
+        uint32_t offset = this->m_chunks.size() * CHUNK;
+        if ((uint64_t)offset + other.m_chunks.size() * CHUNK >= COMPACT_HEAP_NONE)
+            throw string("CompactFibonacciHeap is full");
+
+        // all the memory this takes is taken first: nothing may fail once other is renumbered
+        this->m_chunks.reserve(this->m_chunks.size() + other.m_chunks.size());
+        vector<uint32_t> todo;
+        todo.reserve(other.m_count);  // at most one pending child list per node
+        todo.push_back(other.m_min);
+
+        // every index in other, live node or free, moves up by offset
+        while (!todo.empty())
+        {
+            uint32_t first = todo.back();
+            todo.pop_back();
+
+            uint32_t i = first;
+            do
+            {
+                Node &n = other.at(i);
+                if (COMPACT_HEAP_NONE != n.m_child)
+                {
+                    todo.push_back(n.m_child);
+                    n.m_child += offset;
+                }
+                if (COMPACT_HEAP_NONE != n.m_parent) n.m_parent += offset;
+                n.m_previous += offset;
+                n.m_index += offset;
+                i = n.m_next;
+                n.m_next += offset;
+            }
+            while (i != first);
+        }
+
+        uint32_t last_free = COMPACT_HEAP_NONE;
+        for (uint32_t i = other.m_free; COMPACT_HEAP_NONE != i; )
+        {
+            uint32_t* link = (uint32_t*)(void*)&other.at(i);
+            last_free = i + offset;
+            i = *link;
+            if (COMPACT_HEAP_NONE != i) *link += offset;
+        }
+
+        // this heap's unused slots, before other's chunks, are free now, after other's
+        uint32_t free = this->m_free;
+        for (uint32_t i = offset; i-- > this->m_used; )
+        {
+            *(uint32_t*)(void*)&this->at(i) = free;
+            free = i;
+        }
+
+        uint32_t roots = other.m_min + offset;
+        this->m_chunks.insert(this->m_chunks.end(), other.m_chunks.begin(), other.m_chunks.end());
+        if (COMPACT_HEAP_NONE == last_free)
+        {
+            this->m_free = free;
+        }
+        else
+        {
+            *(uint32_t*)(void*)&this->at(last_free) = free;
+            this->m_free = other.m_free + offset;
+        }
+        this->m_used = offset + other.m_used;
+
+        if (COMPACT_HEAP_NONE == this->m_min)
+        {
+            this->m_min = roots;
+        }
+        else
+        {
+            this->splice(this->m_min, roots);
+            if (this->at(roots).m_key < this->at(this->m_min).m_key) this->m_min = roots;
+        }
+        this->m_count += other.m_count;
+        if (other.m_max_degree > this->m_max_degree) this->m_max_degree = other.m_max_degree;
+
+        // other gives up its chunks without freeing them
+        other.m_chunks.clear();
+        other.m_used = 0;
+        other.m_free = COMPACT_HEAP_NONE;
+        other.m_min = COMPACT_HEAP_NONE;
+        other.m_count = 0;
+        other.m_max_degree = 0;
+    }
+
+
+    // remove every node with a key before `now`, in no particular order, passing each to
+    //  cb(const Node*) on the way out; the remaining roots are consolidated once, at the end
+    template <typename Callback> unsigned int pop_expired(Key now, Callback cb)
+    {
+        if (COMPACT_HEAP_NONE == this->m_min || !(this->at(this->m_min).m_key < now)) return 0;
+
+        vector<uint32_t> todo;
+        uint32_t i = this->m_min;
+        do
+        {
+            todo.push_back(i);
+            i = this->at(i).m_next;
+        }
+        while (i != this->m_min);
+
+        uint32_t survivors = COMPACT_HEAP_NONE;  // a new ring of roots
+        unsigned int popped = 0;
+        while (!todo.empty())
+        {
+            i = todo.back();
+            todo.pop_back();
+            Node &n = this->at(i);
+
+            if (n.m_key < now)
+            {
+                if (COMPACT_HEAP_NONE != n.m_child)
+                {
+                    uint32_t c = n.m_child;
+                    do
+                    {
+                        todo.push_back(c);
+                        c = this->at(c).m_next;
+                    }
+                    while (c != n.m_child);
+                }
+
+                cb((const Node*)&n);
+                this->destroy_node(i);
+                ++popped;
+            }
+            else
+            {
+                // heap order: nothing below it has expired either
+                n.m_parent = COMPACT_HEAP_NONE;
+                n.m_mark = false;
+                n.m_next = n.m_previous = i;
+                if (COMPACT_HEAP_NONE == survivors)
+                    survivors = i;
+                else
+                    this->splice(survivors, i);
+            }
+        }
+
+        this->m_count -= popped;
+        this->m_min = COMPACT_HEAP_NONE;
+        if (COMPACT_HEAP_NONE != survivors) this->consolidate(survivors);
+        return popped;
+    }
+
+
+    // remove every node, visiting each once, and give back the chunks
+    void clear()
+    {
+        if (COMPACT_HEAP_NONE != this->m_min)
+        {
+            // every ring, the roots' and each node's children, is followed once around
+            vector<uint32_t> todo(1, this->m_min);
+            while (!todo.empty())
+            {
+                uint32_t first = todo.back();
+                todo.pop_back();
+
+                uint32_t i = first;
+                do
+                {
+                    Node &n = this->at(i);
+                    uint32_t next = n.m_next;
+                    if (COMPACT_HEAP_NONE != n.m_child) todo.push_back(n.m_child);
+                    n.~Node();
+                    i = next;
+                }
+                while (i != first);
+            }
+        }
+
+        for (unsigned int c = 0; c < this->m_chunks.size(); ++c)
+            allocator_traits<NodeAlloc>::deallocate(this->m_alloc, this->m_chunks[c], CHUNK);
+        vector<Node*, ChunkAlloc>(this->m_chunks.get_allocator()).swap(this->m_chunks);
+
+        this->m_used = 0;
+        this->m_free = COMPACT_HEAP_NONE;
+        this->m_min = COMPACT_HEAP_NONE;
+        this->m_count = 0;
+        this->m_max_degree = 0;
+    }
+
+
+    void print_roots(ostream& out) const
+    {
+        out << "m_max_degree=" << this->m_max_degree << "  m_count=" << this->m_count << "  roots=";
+        if (COMPACT_HEAP_NONE != this->m_min) this->print_all(out, this->m_min);
+    }
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+
+  protected:
+
+    // the nodes are the heap's own; copies would share them
+    CompactFibonacciHeap(const CompactFibonacciHeap &rhs);
+    CompactFibonacciHeap& operator=(const CompactFibonacciHeap &rhs);
+
+
+    Node& at(uint32_t i) const
+    {
+        return this->m_chunks[i / CHUNK][i % CHUNK];
+    }
+
+
+    // a new node, alone in its ring: a freed one if there is one, or the next in the chunks
+    uint32_t create_node(Key k, Data d)
+    {
+        uint32_t i = this->m_free;
+        if (COMPACT_HEAP_NONE != i)
+        {
+            this->m_free = *(uint32_t*)(void*)&this->at(i);
+        }
+        else
+        {
+            if (COMPACT_HEAP_NONE == this->m_used) throw string("CompactFibonacciHeap is full");
+            if (this->m_used == this->m_chunks.size() * CHUNK)
+                this->m_chunks.push_back(allocator_traits<NodeAlloc>::allocate(this->m_alloc, CHUNK));
+            i = this->m_used++;
+        }
+
+        new (&this->at(i)) Node(k, d, i);
+        return i;
+    }
+
+    void destroy_node(uint32_t i)
+    {
+        Node* n = &this->at(i);
+        n->~Node();
+        *(uint32_t*)(void*)n = this->m_free;
+        this->m_free = i;
+    }
+
+
+    // put ring b after a, in a's ring
+    void splice(uint32_t a, uint32_t b)
+    {
+        Node &na = this->at(a);
+        Node &nb = this->at(b);
+        this->at(na.m_next).m_previous = nb.m_previous;
+        this->at(nb.m_previous).m_next = na.m_next;
+        na.m_next = b;
+        nb.m_previous = a;
+    }
+
+    // take a node out of its ring, leaving it alone in one of its own
+    void unlink(uint32_t i)
+    {
+        Node &n = this->at(i);
+        this->at(n.m_previous).m_next = n.m_next;
+        this->at(n.m_next).m_previous = n.m_previous;
+        n.m_next = n.m_previous = i;
+    }
+
+    void add_child(uint32_t parent, uint32_t child)
+    {
+        Node &p = this->at(parent);
+        Node &c = this->at(child);
+        if (COMPACT_HEAP_NONE == p.m_child)
+            p.m_child = child;
+        else
+            this->splice(p.m_child, child);
+        c.m_parent = parent;
+        c.m_mark = false;
+        ++p.m_degree;
+    }
+
+    void remove_child(uint32_t parent, uint32_t child)
+    {
+        Node &p = this->at(parent);
+        Node &c = this->at(child);
+        if (c.m_next == child)
+            p.m_child = COMPACT_HEAP_NONE;
+        else
+        {
+            if (p.m_child == child) p.m_child = c.m_next;
+            this->unlink(child);
+        }
+        c.m_parent = COMPACT_HEAP_NONE;
+        c.m_mark = false;
+        --p.m_degree;
+    }
+
+
+    // add a tree (alone in its ring) to the roots, keeping track of the minimum
+    void insert_root(uint32_t i)
+    {
+        if (COMPACT_HEAP_NONE == this->m_min)
+        {
+            this->m_min = i;
+            return;
+        }
+
+        this->splice(this->m_min, i);
+        if (this->at(i).m_key < this->at(this->m_min).m_key) this->m_min = i;
+    }
+
+
+    // cut a node from its parent, and the parent from its own if it had already lost a
+    //  child, and so on up (the cascading cut of decrease_key); a root stays where it is
+    void cut_to_root(uint32_t i)
+    {
+        uint32_t parent = this->at(i).m_parent;
+        while (COMPACT_HEAP_NONE != parent)
+        {
+            this->remove_child(parent, i);
+            this->insert_root(i);
+
+            Node &p = this->at(parent);
+            if (COMPACT_HEAP_NONE == p.m_parent) break;   // parent is a root - nothing more to do
+            if (!p.m_mark)
+            {
+                p.m_mark = true;   // parent is not a root and is not marked - just mark it
+                break;
+            }
+            i = parent;
+            parent = p.m_parent;
+        }
+    }
+
+
+    // take out the node at m_min, which need not have the least key, leaving its children
+    //  as roots, and consolidate
+    void remove_minimum_h(bool delete_node)
+    {
+        uint32_t z = this->m_min;
+        Node &n = this->at(z);
+        --this->m_count;
+
+        if (COMPACT_HEAP_NONE != n.m_child)
+        {
+            uint32_t c = n.m_child;
+            do
+            {
+                this->at(c).m_parent = COMPACT_HEAP_NONE;
+                c = this->at(c).m_next;
+            }
+            while (c != n.m_child);
+
+            this->splice(z, n.m_child);
+            n.m_child = COMPACT_HEAP_NONE;
+            n.m_degree = 0;
+        }
+
+        this->m_min = COMPACT_HEAP_NONE;
+        if (n.m_next == z)
+        {
+            if (delete_node) this->destroy_node(z);
+            return;
+        }
+
+        uint32_t roots = n.m_next;
+        this->unlink(z);
+        if (delete_node) this->destroy_node(z);
+        this->consolidate(roots);
+    }
+
+
+    // link the ring of roots starting at `roots` until no two have the same degree, and
+    //  find the minimum among them
+    void consolidate(uint32_t roots)
+    {
+        this->at(this->at(roots).m_previous).m_next = COMPACT_HEAP_NONE;  // open the ring
+        uint32_t i = roots;
+        unsigned int top_degree = 0;
+        while (COMPACT_HEAP_NONE != i)
+        {
+            uint32_t current = i;
+            i = this->at(i).m_next;
+            this->at(current).m_next = this->at(current).m_previous = current;
+
+            unsigned int d = this->at(current).m_degree;
+            while (COMPACT_HEAP_NONE != this->m_degree_roots[d])
+            {
+                uint32_t other = this->m_degree_roots[d];
+                if (this->at(other).m_key < this->at(current).m_key) swap(other, current);
+                this->add_child(current, other);
+                this->m_degree_roots[d] = COMPACT_HEAP_NONE;
+                ++d;
+            }
+            if (d >= FIBONACCI_HEAP_MAX_DEGREE)
+                throw string("Internal error: a root's degree is beyond FIBONACCI_HEAP_MAX_DEGREE");
+
+            this->m_degree_roots[d] = current;
+            if (d > top_degree) top_degree = d;
+        }
+
+        for (unsigned int d = 0; d <= top_degree; ++d)
+        {
+            if (COMPACT_HEAP_NONE == this->m_degree_roots[d]) continue;
+            this->insert_root(this->m_degree_roots[d]);
+            this->m_degree_roots[d] = COMPACT_HEAP_NONE;
+        }
+        this->m_max_degree = top_degree;
+    }
+
+
+    void print_tree(ostream& out, uint32_t i) const
+    {
+        const Node &n = this->at(i);
+        out << n.m_data << ":" << n.m_key << ":" << n.m_degree << ":" << n.m_mark;
+        if (COMPACT_HEAP_NONE != n.m_child)
+        {
+            out << "(";
+            this->print_all(out, n.m_child);
+            out << ")";
+        }
+    }
+
+    void print_all(ostream& out, uint32_t first) const
+    {
+        uint32_t i = first;
+        do
+        {
+            this->print_tree(out, i);
+            out << " ";
+            i = this->at(i).m_next;
+        }
+        while (i != first);
+    }
+};
+
+
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream& output, const CompactFibonacciHeap<Key, Data, Alloc>& v)
+{
+    v.print_roots(output);
+    return output;
+}
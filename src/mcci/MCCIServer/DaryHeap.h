@@ -0,0 +1,297 @@
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+
+using namespace std;
+
+
+// children per node.  4 children's entries (a key and a node pointer each) make a 64-byte
+//  cache line when keys are 32 bits
+#define DARY_HEAP_ARITY 4
+
+
+template <typename Key, typename Data> class DaryHeapNode
+{
+  protected:
+    Key m_key;
+    Data m_data;
+    unsigned int m_index;  // where its entry is in the heap array
+
+  public:
+    DaryHeapNode(Key k, Data d) : m_key(k), m_data(d), m_index(0) {}
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    template <typename K, typename D, typename A> friend class DaryHeap;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, typename Alloc> class DaryHeap;
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream &, const DaryHeap<Key, Data, Alloc> &);
+
+
+/**
+   An indexed d-ary min-heap (d = DARY_HEAP_ARITY) with the same interface as
+   FibonacciHeap, so a RequestBank can keep its timeouts in one.
+
+   The heap itself is an array of entries, each a key and a pointer to its node, so sifting
+   compares keys without leaving the array, and a node's children sit side by side.  The
+   nodes stay where they were allocated, and are the handles: each knows where its entry
+   is, so removing or rescheduling any node is a sift from there, O(log n) with a small
+   constant.  A wider node makes the heap shallower, so there are fewer levels to sift
+   up through, at the cost of more comparisons per level on the way down.
+
+   Nodes and the array are allocated through Alloc, rebound to each, as in FibonacciHeap.
+ */
+template <typename Key, typename Data,
+          typename Alloc = std::allocator<DaryHeapNode<Key, Data> > >
+class DaryHeap
+{
+  public:
+    typedef DaryHeapNode<Key, Data> Node;
+
+  protected:
+    struct Entry
+    {
+        Key key;
+        Node* node;
+    };
+
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Entry> EntryAlloc;
+
+    NodeAlloc m_alloc;
+    vector<Entry, EntryAlloc> m_heap;
+
+  public:
+
+    DaryHeap(const Alloc& alloc = Alloc()) : m_alloc(alloc), m_heap(EntryAlloc(alloc)) {}
+
+    ~DaryHeap() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const DaryHeap<Key, Data, Alloc>& v);
+
+    bool empty() const { return this->m_heap.empty(); }
+    unsigned int size() const { return this->m_heap.size(); }
+
+
+    Node* insert(Key k, Data d)
+    {
+        Node* n = allocator_traits<NodeAlloc>::allocate(this->m_alloc, 1);
+        new (n) Node(k, d);
+
+        Entry e;
+        e.key = k;
+        e.node = n;
+        this->m_heap.push_back(e);
+        this->sift_up(this->m_heap.size() - 1);
+        return n;
+    }
+
+
+    Node* minimum() const
+    {
+        if (this->m_heap.empty()) throw string("no minimum element");
+        return this->m_heap[0].node;
+    }
+
+
+    void remove_minimum()
+    {
+        if (this->m_heap.empty()) throw string("trying to remove from an empty heap");
+        this->remove_at(0);
+    }
+
+
+    // take all of other's nodes, leaving it empty.  the nodes stay where they are, so
+    //  handles to them stay good; other must allocate as this heap does.  a batch at least
+    //  as big as the heap is put in order with the rest in one pass, bottom up; a smaller
+    //  one is sifted up an entry at a time
+    void merge(DaryHeap& other)
+    {
+        if (&other == this || other.m_heap.empty()) return;
+
+        unsigned int n = this->m_heap.size();
+        bool rebuild = other.m_heap.size() >= n;
+        for (unsigned int i = 0; i < other.m_heap.size(); ++i)
+        {
+            this->m_heap.push_back(other.m_heap[i]);
+            if (rebuild)
+                this->m_heap.back().node->m_index = this->m_heap.size() - 1;
+            else
+                this->sift_up(this->m_heap.size() - 1);
+        }
+        other.m_heap.clear();
+
+        if (rebuild)
+            for (unsigned int i = (this->m_heap.size() - 1) / DARY_HEAP_ARITY + 1; i-- > 0; )
+                this->sift_down(i);
+    }
+
+
+    // remove every node, and give back the array
+    void clear()
+    {
+        for (unsigned int i = 0; i < this->m_heap.size(); ++i)
+            this->destroy_node(this->m_heap[i].node);
+        vector<Entry, EntryAlloc>(this->m_heap.get_allocator()).swap(this->m_heap);
+    }
+
+
+    // remove every node with a key before `now`, in order, passing each to cb(const Node*)
+    //  on the way out
+    template <typename Callback> unsigned int pop_expired(Key now, Callback cb)
+    {
+        unsigned int popped = 0;
+        while (!this->m_heap.empty() && this->m_heap[0].key < now)
+        {
+            cb((const Node*)this->m_heap[0].node);
+            this->remove_at(0);
+            ++popped;
+        }
+        return popped;
+    }
+
+
+    // (minus_infinity is unused; it is here so that the heaps can be swapped for one another)
+    void remove(Node* node, Key minus_infinity)
+    {
+        this->remove_at(node->m_index);
+    }
+
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+        this->alter_key(node, new_key, new_key);
+    }
+
+
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        bool lower = new_key < node->m_key;
+        node->m_key = new_key;
+        this->m_heap[node->m_index].key = new_key;
+
+        if (lower)
+            this->sift_up(node->m_index);
+        else
+            this->sift_down(node->m_index);
+    }
+
+
+    void print_roots(ostream& out) const
+    {
+        out << "m_count=" << this->m_heap.size() << "  heap=";
+        for (unsigned int i = 0; i < this->m_heap.size(); ++i)
+        {
+            this->m_heap[i].node->print_node(out);
+            out << " ";
+        }
+    }
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+
+  protected:
+
+    // the nodes are the heap's own; copies would share them
+    DaryHeap(const DaryHeap &rhs);
+    DaryHeap& operator=(const DaryHeap &rhs);
+
+
+    // put an entry at i, keeping its node's index up to date
+    void set(unsigned int i, const Entry &e)
+    {
+        this->m_heap[i] = e;
+        e.node->m_index = i;
+    }
+
+
+    void sift_up(unsigned int i)
+    {
+        Entry e = this->m_heap[i];
+        while (0 < i)
+        {
+            unsigned int parent = (i - 1) / DARY_HEAP_ARITY;
+            if (!(e.key < this->m_heap[parent].key)) break;
+            this->set(i, this->m_heap[parent]);
+            i = parent;
+        }
+        this->set(i, e);
+    }
+
+
+    void sift_down(unsigned int i)
+    {
+        Entry e = this->m_heap[i];
+        unsigned int n = this->m_heap.size();
+        for (;;)
+        {
+            unsigned int first = i * DARY_HEAP_ARITY + 1;
+            if (first >= n) break;
+
+            unsigned int last = first + DARY_HEAP_ARITY < n ? first + DARY_HEAP_ARITY : n;
+            unsigned int least = first;
+            for (unsigned int c = first + 1; c < last; ++c)
+                if (this->m_heap[c].key < this->m_heap[least].key) least = c;
+
+            if (!(this->m_heap[least].key < e.key)) break;
+            this->set(i, this->m_heap[least]);
+            i = least;
+        }
+        this->set(i, e);
+    }
+
+
+    // take out the entry at i, filling the hole with the last one
+    void remove_at(unsigned int i)
+    {
+        Node* node = this->m_heap[i].node;
+        Entry last = this->m_heap.back();
+        this->m_heap.pop_back();
+
+        if (i < this->m_heap.size())
+        {
+            this->set(i, last);
+            if (last.key < node->m_key)
+                this->sift_up(i);
+            else
+                this->sift_down(i);
+        }
+
+        this->destroy_node(node);
+    }
+
+
+    void destroy_node(Node* n)
+    {
+        n->~Node();
+        allocator_traits<NodeAlloc>::deallocate(this->m_alloc, n, 1);
+    }
+};
+
+
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream& output, const DaryHeap<Key, Data, Alloc>& v)
+{
+    v.print_roots(output);
+    return output;
+}
@@ -12,11 +12,66 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
 using namespace std;
 
 typedef unsigned int uint;
 
 
+// the trace of m_debug, m_debug_remove_min and m_debug_decrease_key is only compiled in when
+//  this is 1; otherwise the flags are never looked at
+#ifndef FIBONACCI_HEAP_DEBUG
+#define FIBONACCI_HEAP_DEBUG 0
+#endif
+
+// the counters in FibonacciHeapStats are only kept when this is 1; otherwise the code that
+//  keeps them is compiled out, and stats() is all zeros
+#ifndef FIBONACCI_HEAP_STATS
+#define FIBONACCI_HEAP_STATS 0
+#endif
+
+// a node of degree d has at least phi^d descendants, so with a 32-bit count no node can
+//  have 47 children
+#define FIBONACCI_HEAP_MAX_DEGREE 48
+
+
+// what a FibonacciHeap has done since it was made (or its stats reset)
+struct FibonacciHeapStats
+{
+    unsigned long inserts;
+    unsigned long keys_lowered;      // by alter_key
+    unsigned long keys_raised;       // by alter_key, each a removal and reinsertion
+    unsigned long cuts;              // nodes cut from their parents to the roots
+    unsigned long cascading_cuts;    // ... of them, marked parents cut in turn
+    unsigned long consolidations;
+    unsigned long consolidated_roots;
+    unsigned long links;             // roots made children of others by consolidation
+    unsigned int max_degree;         // the highest degree a root has had
+    unsigned long expiry_calls;      // pop_expired
+    unsigned long expired;
+    unsigned int most_expired;       // by one pop_expired
+
+    FibonacciHeapStats()
+      : inserts(0), keys_lowered(0), keys_raised(0), cuts(0), cascading_cuts(0),
+        consolidations(0), consolidated_roots(0), links(0), max_degree(0),
+        expiry_calls(0), expired(0), most_expired(0) {}
+};
+
+inline ostream& operator<<(ostream& out, const FibonacciHeapStats& s)
+{
+    return out << "inserts=" << s.inserts
+               << " lowered=" << s.keys_lowered << " raised=" << s.keys_raised
+               << " cuts=" << s.cuts << " cascading=" << s.cascading_cuts
+               << " consolidations=" << s.consolidations
+               << " roots=" << s.consolidated_roots << " links=" << s.links
+               << " max_degree=" << s.max_degree
+               << " expiry_calls=" << s.expiry_calls << " expired=" << s.expired
+               << " most_expired=" << s.most_expired;
+}
+
+
 /**
  * The heap is a min-heap sorted by Key.
  */
@@ -62,54 +117,87 @@ template <typename Key, typename Data> class FibonacciHeapNode
     Key key() const { return m_key; }
     Data data() const { return m_data; }
 	
-    template <typename D, typename K> friend class FibonacciHeap;
+    template <typename K, typename D, typename A> friend class FibonacciHeap;
 }; // FibonacciHeapNode
 
 
 // declare class to enable declaration of ostream operator
-template <typename Key, typename Data> class FibonacciHeap;
-template <typename Key, typename Data>
-    ostream& operator<<(ostream &, const FibonacciHeap<Key, Data> &);
+template <typename Key, typename Data, typename Alloc> class FibonacciHeap;
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream &, const FibonacciHeap<Key, Data, Alloc> &);
 
 
 
-template <typename Key, typename Data> class FibonacciHeap 
+/**
+ * Nodes are created and destroyed through Alloc (rebound to the node type), so a heap
+ * can take them from a pool -- e.g. a CMCCIArenaAllocator on a CMCCIArena, which
+ * recycles freed nodes from a free list instead of going back to malloc.
+ */
+template <typename Key, typename Data,
+          typename Alloc = std::allocator<FibonacciHeapNode<Key, Data> > >
+class FibonacciHeap 
 {
     typedef FibonacciHeapNode<Key, Data>* PNodePtr;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<FibonacciHeapNode<Key, Data> > NodeAlloc;
     
   protected:
     
+    NodeAlloc m_alloc;
+
     PNodePtr m_root_with_min_key; // a circular d-list of nodes
     uint m_count;      // total number of elements in heap
     uint m_max_degree;  // maximum degree (=child count) of a root in the  circular d-list
+    PNodePtr m_degree_roots[FIBONACCI_HEAP_MAX_DEGREE];  // consolidation's table; all NULL otherwise
+    FibonacciHeapStats m_stats;  // only kept if FIBONACCI_HEAP_STATS
     
     PNodePtr insert_node(PNodePtr new_node);
     void remove_minimum_h(bool delete_node); 
+    void consolidate(PNodePtr roots);
+
+    PNodePtr create_node(Key k, Data d);
+    void destroy_node(PNodePtr node);
     
   public:
+    typedef FibonacciHeapNode<Key, Data> Node;
+
     bool m_debug, m_debug_remove_min, m_debug_decrease_key;
     
-    FibonacciHeap();
+    FibonacciHeap(const Alloc& alloc = Alloc());
     
-    ~FibonacciHeap() { while (!empty()) remove_minimum(); }; // TODO: can do this more efficiently
+    ~FibonacciHeap() { clear(); };
 
-    friend ostream& operator<< <>(ostream& output, const FibonacciHeap<Key, Data>& v);
+    friend ostream& operator<< <>(ostream& output, const FibonacciHeap<Key, Data, Alloc>& v);
     string summary() const;
     
     bool empty() const { return 0 == this->m_count; };
-    bool size() const { return this->m_count; };
+    uint size() const { return this->m_count; };
 
     PNodePtr minimum() const;
     void remove_minimum();
+
+    // remove every node, visiting each once; no consolidation, so O(n)
+    void clear();
+
+    // remove every node with a key before `now`, in no particular order, passing each to
+    //  cb(const Node*) on the way out; the remaining roots are consolidated once, at the end
+    template <typename Callback> uint pop_expired(Key now, Callback cb);
+
     void remove(PNodePtr node, Key minus_infinity);
     void decrease_key(PNodePtr node, Key new_key);
     void alter_key(PNodePtr node, Key new_key, Key minus_infinity);
 
     PNodePtr insert(Key k, Data d);	
-    void merge(const FibonacciHeap& other);
+
+    // take all of other's nodes, in O(1), leaving it empty.  the nodes keep their
+    //  addresses, so handles to them stay good; other must allocate as this heap does
+    void merge(FibonacciHeap& other);
 
     void print_roots(ostream& out) const;
 
+    // counters of the heap's work (see FIBONACCI_HEAP_STATS)
+    const FibonacciHeapStats& stats() const { return this->m_stats; }
+    void reset_stats() { this->m_stats = FibonacciHeapStats(); }
+
 };  // FibonacciHeap
 
 
@@ -255,28 +343,29 @@ template <typename Key, typename Data>
 //////////////////////////////////////////// FibonacciHeap
 
 
-template <typename Key, typename Data>
-    FibonacciHeap<Key, Data>::FibonacciHeap()
+template <typename Key, typename Data, typename Alloc>
+    FibonacciHeap<Key, Data, Alloc>::FibonacciHeap(const Alloc& alloc) : m_alloc(alloc)
 {
     m_root_with_min_key  = NULL;
     m_count              = 0;
     m_max_degree         = 0;
+    fill(m_degree_roots, m_degree_roots + FIBONACCI_HEAP_MAX_DEGREE, (PNodePtr)NULL);
     m_debug              = false;
     m_debug_remove_min   = false;
     m_debug_decrease_key = false;
 }
 
 
-template <typename Key, typename Data>
-    ostream& operator<<(ostream& output, const FibonacciHeap<Key, Data>& v)
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream& output, const FibonacciHeap<Key, Data, Alloc>& v)
 {
     v.print_roots(output);
     return output;
 }
 
 
-template <typename Key, typename Data>
-    string FibonacciHeap<Key, Data>::summary() const
+template <typename Key, typename Data, typename Alloc>
+    string FibonacciHeap<Key, Data, Alloc>::summary() const
 {
     stringstream s;
     print_roots(s);
@@ -284,19 +373,19 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::insert_node(FibonacciHeapNode<Key, Data>* new_node) 
+template <typename Key, typename Data, typename Alloc>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Alloc>::insert_node(FibonacciHeapNode<Key, Data>* new_node) 
 {
-    if (m_debug) cerr << "\ninsert_node";
+    if (FIBONACCI_HEAP_DEBUG && m_debug) cerr << "\ninsert_node";
     if (!m_root_with_min_key) 
     {
-        if (m_debug) cerr << " as new root";
+        if (FIBONACCI_HEAP_DEBUG && m_debug) cerr << " as new root";
         // insert the first m_key to the heap:
         m_root_with_min_key = new_node;
     } 
     else 
     {
-        if (m_debug)
+        if (FIBONACCI_HEAP_DEBUG && m_debug)
         {
             cerr << " into existing root";
             m_root_with_min_key->print_all(cerr);
@@ -310,8 +399,8 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::minimum() const 
+template <typename Key, typename Data, typename Alloc>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Alloc>::minimum() const 
 { 
     if (!m_root_with_min_key)
         throw string("no minimum element");
@@ -319,8 +408,8 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::print_roots(ostream& out) const 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::print_roots(ostream& out) const 
 {
     out << "m_max_degree=" << m_max_degree << "  m_count=" << m_count << "  roots=";
     if (m_root_with_min_key)
@@ -328,49 +417,71 @@ template <typename Key, typename Data>
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::merge(const FibonacciHeap& other) 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::merge(FibonacciHeap& other) 
 {  // Fibonacci-Heap-Union
-    m_root_with_min_key->insert(other.m_root_with_min_key);
-    if (!m_root_with_min_key || 
-        (other.m_root_with_min_key &&
-         other.m_root_with_min_key->key() < m_root_with_min_key->key()))
-        this->m_root_with_min_key = other.m_root_with_min_key;
+    if (&other == this || !other.m_root_with_min_key) return;
+
+    insert_node(other.m_root_with_min_key);  // the whole ring of other's roots
+    if (other.m_max_degree > m_max_degree)
+        m_max_degree = other.m_max_degree;
     m_count += other.m_count;
+
+    // the nodes are ours now
+    other.m_root_with_min_key = NULL;
+    other.m_count = 0;
+    other.m_max_degree = 0;
 }
 
 
-template <typename Key, typename Data>
-    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data>::insert(Key k, Data d) 
+template <typename Key, typename Data, typename Alloc>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Alloc>::insert(Key k, Data d) 
 {
-    if (m_debug) cerr << "\ninsert new " << d << ":" << k;
+    if (FIBONACCI_HEAP_DEBUG && m_debug) cerr << "\ninsert new " << d << ":" << k;
+    if (FIBONACCI_HEAP_STATS) ++m_stats.inserts;
     ++m_count;
     // create a new tree with a single m_key:
-    return insert_node(new FibonacciHeapNode<Key, Data>(k, d));
+    return insert_node(create_node(k, d));
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove_minimum() 
+template <typename Key, typename Data, typename Alloc>
+    FibonacciHeapNode<Key, Data>* FibonacciHeap<Key, Data, Alloc>::create_node(Key k, Data d)
+{
+    FibonacciHeapNode<Key, Data>* node = allocator_traits<NodeAlloc>::allocate(m_alloc, 1);
+    return new (node) FibonacciHeapNode<Key, Data>(k, d);
+}
+
+
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::destroy_node(FibonacciHeapNode<Key, Data>* node)
+{
+    node->~FibonacciHeapNode<Key, Data>();
+    allocator_traits<NodeAlloc>::deallocate(m_alloc, node, 1);
+}
+
+
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::remove_minimum() 
 {
     remove_minimum_h(true);
 }
     
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove_minimum_h(bool delete_node) 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::remove_minimum_h(bool delete_node) 
 {  // Fibonacci-Heap-Extract-Min, CONSOLIDATE
 
     if (!m_root_with_min_key)
         throw string("trying to remove from an empty heap");
 
-    if (this->m_debug_remove_min) cerr << "\nremove_minimum";
+    if (FIBONACCI_HEAP_DEBUG && this->m_debug_remove_min) cerr << "\nremove_minimum";
     --m_count;
 
     /// Phase 1: Make all the removed root's children new roots:
     // Make all children of root new roots:
     if (m_root_with_min_key->m_child) 
     {
-        if (m_debug_remove_min) 
+        if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) 
         {
             cerr << "\n  root's children: "; 
             m_root_with_min_key->m_child->print_all(cerr);
@@ -384,10 +495,11 @@ template <typename Key, typename Data>
         while (c != m_root_with_min_key->m_child);
             
         m_root_with_min_key->m_child = NULL; // removed all children
+        m_root_with_min_key->m_degree = 0;   // (it may be reinserted, by alter_key)
         m_root_with_min_key->insert(c);
     }
     
-    if (m_debug_remove_min) 
+    if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) 
     {
         cerr << "\n  roots after inserting children: ";
         cerr << "\n";
@@ -399,28 +511,43 @@ template <typename Key, typename Data>
     /// Phase 2-a: handle the case where we delete the last m_key:
     if (m_root_with_min_key->m_next == m_root_with_min_key) 
     {
-        if (m_debug_remove_min) cerr << "\n  removed the last";
+        if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) cerr << "\n  removed the last";
         if (m_count != 0)
             throw string ("Internal error: should have 0 keys");
-        if (delete_node) delete m_root_with_min_key;
+        if (delete_node) destroy_node(m_root_with_min_key);
         m_root_with_min_key = NULL;
-        if (m_debug_remove_min) cerr << "\n  removal complete";
+        if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) cerr << "\n  removal complete";
         return;
     }
 
-    /// Phase 2: merge roots with the same degree:
-    vector<FibonacciHeapNode<Key, Data>*> degree_roots (m_max_degree + 1); // make room for a new degree
-    fill(degree_roots.begin(), degree_roots.end(), (FibonacciHeapNode<Key, Data>*)NULL);
-    m_max_degree = 0;
-    FibonacciHeapNode<Key, Data>* current_pointer = m_root_with_min_key->m_next;
+    /// Phase 2: take out the old minimum, and merge the rest of the roots
+    FibonacciHeapNode<Key, Data>* roots = m_root_with_min_key->m_next;
+    m_root_with_min_key->remove();
+    if (delete_node) destroy_node(m_root_with_min_key);
+    m_root_with_min_key = NULL;
+
+    consolidate(roots);
+    if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) cerr << "  removal complete";
+}
+
+
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::consolidate(FibonacciHeapNode<Key, Data>* roots)
+{  // CONSOLIDATE: the heap's roots are the ring `roots`; link them until no two have the same degree
+
+    /// Phase 2: merge roots with the same degree, in m_degree_roots (which is all NULL
+    ///  between consolidations):
+    roots->m_previous->m_next = NULL;  // open the ring, so each root can be taken from it alone
+    FibonacciHeapNode<Key, Data>* current_pointer = roots;
     uint current_degree;
+    uint top_degree = 0;
+    if (FIBONACCI_HEAP_STATS) ++m_stats.consolidations;
     do 
     {
         current_degree = current_pointer->m_degree;
-        if (m_debug_remove_min) 
+        if (FIBONACCI_HEAP_STATS) ++m_stats.consolidated_roots;
+        if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) 
         {
-            cerr << "\n  roots starting from current_pointer: "; 
-            current_pointer->print_all(cerr);
             cerr << "  checking root ";
             current_pointer->print_node(cerr);
             cerr << " with degree " << current_degree;
@@ -428,90 +555,190 @@ template <typename Key, typename Data>
 
         FibonacciHeapNode<Key, Data>* current = current_pointer;
         current_pointer = current_pointer->m_next;
-        while (degree_roots[current_degree]) 
+        current->m_next = current->m_previous = current;
+        while (m_degree_roots[current_degree]) 
         { // merge the two roots with the same degree:
-            FibonacciHeapNode<Key, Data>* other = degree_roots[current_degree]; // another root with the same degree
+            FibonacciHeapNode<Key, Data>* other = m_degree_roots[current_degree]; // another root with the same degree
             if (current->key() > other->key())
                 swap(other,current); 
             // now current->key() <= other->key() - make other a child of current:
-            other->remove(); // remove from list of roots
             current->add_child(other);
-            if (m_debug_remove_min)
+            if (FIBONACCI_HEAP_STATS) ++m_stats.links;
+            if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min)
             {
                 cerr << "  added ";
                 other->print_node(cerr);
                 cerr << " as child of ";
                 current->print_node(cerr);
             }
-            degree_roots[current_degree] = NULL;
+            m_degree_roots[current_degree] = NULL;
             ++current_degree;
-            if (current_degree >= degree_roots.size())
-                degree_roots.push_back((FibonacciHeapNode<Key, Data>*)NULL);
         }
-        // keep the current root as the first of its degree in the degrees array:
-        degree_roots[current_degree] = current;
+        if (current_degree >= FIBONACCI_HEAP_MAX_DEGREE)
+            throw string("Internal error: a root's degree is beyond FIBONACCI_HEAP_MAX_DEGREE");
 
+        // keep the current root as the first of its degree in the degrees array:
+        m_degree_roots[current_degree] = current;
+        if (current_degree > top_degree)
+            top_degree = current_degree;
     } 
-    while (current_pointer != m_root_with_min_key);
+    while (current_pointer);
 
-    /// Phase 3: remove the current root, and calcualte the new m_root_with_min_key:
-    if (delete_node) delete m_root_with_min_key;
+    /// Phase 3: calculate the new m_root_with_min_key, emptying m_degree_roots again:
     m_root_with_min_key = NULL;
 
-    uint new_max_degree = 0;
-    for (uint d = 0; d < degree_roots.size(); ++d) 
+    for (uint d = 0; d <= top_degree; ++d) 
     {
-        if (m_debug_remove_min) cerr << "\n  degree " << d << ": ";
-        if (degree_roots[d]) 
+        if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) cerr << "\n  degree " << d << ": ";
+        if (m_degree_roots[d]) 
         {
-            if (m_debug_remove_min)
+            if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min)
             {
                 cerr << " ";
-                degree_roots[d]->print_node(cerr);
+                m_degree_roots[d]->print_node(cerr);
             }
-            degree_roots[d]->m_next = degree_roots[d]->m_previous = degree_roots[d];
-            insert_node(degree_roots[d]);
-            if (d > new_max_degree)
-                new_max_degree = d;		
+            insert_node(m_degree_roots[d]);
+            m_degree_roots[d] = NULL;
         } 
         else 
         {
-            if (m_debug_remove_min) cerr << "  no node";
+            if (FIBONACCI_HEAP_DEBUG && m_debug_remove_min) cerr << "  no node";
         }
     }
-    m_max_degree = new_max_degree;
-    if (m_debug_remove_min) cerr << "  removal complete";
+    m_max_degree = top_degree;
+    if (FIBONACCI_HEAP_STATS && top_degree > m_stats.max_degree) m_stats.max_degree = top_degree;
 }
 
 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::clear()
+{
+    if (!m_root_with_min_key) return;
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::alter_key(FibonacciHeapNode<Key, Data>* node,
+    // each ring is opened and followed to its end; a node's children are a ring to do later
+    vector<FibonacciHeapNode<Key, Data>*> todo(1, m_root_with_min_key);
+    while (!todo.empty())
+    {
+        FibonacciHeapNode<Key, Data>* n = todo.back();
+        todo.pop_back();
+        n->m_previous->m_next = NULL;
+
+        while (n)
+        {
+            FibonacciHeapNode<Key, Data>* next = n->m_next;
+            if (n->m_child) todo.push_back(n->m_child);
+            destroy_node(n);
+            n = next;
+        }
+    }
+
+    m_root_with_min_key = NULL;
+    m_count = 0;
+    m_max_degree = 0;
+}
+
+
+template <typename Key, typename Data, typename Alloc>
+template <typename Callback>
+    uint FibonacciHeap<Key, Data, Alloc>::pop_expired(Key now, Callback cb)
+{
+    if (FIBONACCI_HEAP_STATS) ++m_stats.expiry_calls;
+    if (!m_root_with_min_key || !(m_root_with_min_key->key() < now)) return 0;
+
+    // every tree starts out to be looked at; an expired node's children then are too
+    vector<FibonacciHeapNode<Key, Data>*> todo;
+    FibonacciHeapNode<Key, Data>* n = m_root_with_min_key;
+    do
+    {
+        todo.push_back(n);
+        n = n->m_next;
+    }
+    while (n != m_root_with_min_key);
+
+    FibonacciHeapNode<Key, Data>* survivors = NULL;  // a new ring of roots
+    uint popped = 0;
+    while (!todo.empty())
+    {
+        n = todo.back();
+        todo.pop_back();
+
+        if (n->key() < now)
+        {
+            if (n->m_child)
+            {
+                FibonacciHeapNode<Key, Data>* c = n->m_child;
+                do
+                {
+                    todo.push_back(c);
+                    c = c->m_next;
+                }
+                while (c != n->m_child);
+            }
+
+            cb((const FibonacciHeapNode<Key, Data>*)n);
+            destroy_node(n);
+            ++popped;
+        }
+        else
+        {
+            // heap order: nothing below it has expired either
+            n->m_parent = NULL;
+            n->m_mark = false;
+            n->m_next = n->m_previous = n;
+            if (survivors)
+                survivors->insert(n);
+            else
+                survivors = n;
+        }
+    }
+
+    m_count -= popped;
+    m_root_with_min_key = NULL;
+    if (survivors) consolidate(survivors);
+    if (FIBONACCI_HEAP_STATS)
+    {
+        m_stats.expired += popped;
+        if (popped > m_stats.most_expired) m_stats.most_expired = popped;
+    }
+    return popped;
+}
+
+
+
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::alter_key(FibonacciHeapNode<Key, Data>* node,
                                              Key new_key,
                                              Key minus_infinity)
 {
     // decrease key if new key is less
     if (new_key < node->m_key)
+    {
+        if (FIBONACCI_HEAP_STATS) ++m_stats.keys_lowered;
         decrease_key(node, new_key);
+    }
 
     // remove and re-insert if new key is more
     if (new_key > node->m_key)
     {
+        if (FIBONACCI_HEAP_STATS) ++m_stats.keys_raised;
         decrease_key(node, minus_infinity);
         remove_minimum_h(false);
         node->m_key = new_key;
+        node->m_next = node->m_previous = node;  // still linked to its old neighbours
+        node->m_mark = false;
         insert_node(node);
+        ++m_count;  // remove_minimum_h counted it out
     }
 }
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::decrease_key(FibonacciHeapNode<Key, Data>* node, Key new_key) 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::decrease_key(FibonacciHeapNode<Key, Data>* node, Key new_key) 
 {
     if (new_key >= node->m_key)
         throw string("Trying to decrease key to a greater key");
 
-    if (m_debug)
+    if (FIBONACCI_HEAP_DEBUG && m_debug)
     {
         cerr << "\ndecrease key of ";
         node->print_node(cerr);
@@ -537,7 +764,8 @@ template <typename Key, typename Data>
     {
         parent->remove_child(node);
         insert_node(node);
-        if (m_debug_decrease_key) 
+        if (FIBONACCI_HEAP_STATS) ++m_stats.cuts;
+        if (FIBONACCI_HEAP_DEBUG && m_debug_decrease_key) 
         {
             cerr << "\n  removed ";
             node->print_node(cerr);
@@ -558,6 +786,7 @@ template <typename Key, typename Data>
         } 
         else 
         {
+            if (FIBONACCI_HEAP_STATS) ++m_stats.cascading_cuts;
             node = parent;
             parent = parent->m_parent;
             continue;
@@ -567,8 +796,8 @@ template <typename Key, typename Data>
 
 
 
-template <typename Key, typename Data>
-    void FibonacciHeap<Key, Data>::remove(FibonacciHeapNode<Key, Data>* node, Key minus_infinity) 
+template <typename Key, typename Data, typename Alloc>
+    void FibonacciHeap<Key, Data, Alloc>::remove(FibonacciHeapNode<Key, Data>* node, Key minus_infinity) 
 {
     if (minus_infinity >= minimum()->key())
         throw string("2nd argument to remove must be a key that is smaller than all other keys");
@@ -1,9 +1,15 @@
 
+// this test shows the heap's trace
+#define FIBONACCI_HEAP_DEBUG 1
+
 #include "FibonacciHeap.h"
+#include "MCCIArena.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
+#include <deque>
+#include <algorithm>
 
 using namespace std;
 
@@ -96,10 +102,59 @@ void doTest()
     cout << endl << endl;
 }
 
+// requests coming and going, with the nodes from a pool: cancelling from the middle of the
+//  heap and renewing must keep it ordered, and the pool must stop growing
+void doChurnTest()
+{
+    typedef FibonacciHeapNode<uint, uint> Node;
+    CMCCIArena arena;
+    FibonacciHeap<uint, uint, CMCCIArenaAllocator<Node> > h((CMCCIArenaAllocator<Node>(&arena)));
+    deque<Node*> live;
+    uint x = 1;
+    size_t reserved = 0;
+
+    for (uint i = 0; i < 20000; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        live.push_back(h.insert(1 + (x >> 8) % 5000, i));
+
+        if (300 < live.size())
+        {
+            h.remove(live.front(), 0);  // cancel the oldest, wherever it is
+            live.pop_front();
+        }
+        if (0 == i % 7)
+        {
+            // expire one (if it's one we hold, forget it)
+            deque<Node*>::iterator it = find(live.begin(), live.end(), h.minimum());
+            if (live.end() != it) live.erase(it);
+            h.remove_minimum();
+        }
+        if (0 == i % 5 && !live.empty())
+            h.alter_key(live.back(), live.back()->key() + 1000, 0);  // renew
+
+        if (1000 == i) reserved = arena.get_reserved();
+    }
+
+    cout << "\nChurn through a pooled heap: " << arena.get_reserved() << " bytes reserved";
+    if (reserved != arena.get_reserved()) throw string("node pool kept growing");
+
+    uint last = 0;
+    while (!h.empty())
+    {
+        if (h.minimum()->key() < last) throw string("heap out of order after churn");
+        last = h.minimum()->key();
+        h.remove_minimum();
+    }
+    if (arena.get_in_use()) throw string("nodes left in the pool");
+}
+
+
 int main() {
     try
     {
         doTest();
+        doChurnTest();
     } 
     catch (string s) 
     {
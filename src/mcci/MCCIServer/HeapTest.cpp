@@ -0,0 +1,316 @@
+
+#include "FibonacciHeap.h"
+#include "CompactFibonacciHeap.h"
+#include "PairingHeap.h"
+#include "DaryHeap.h"
+#include "TimingWheel.h"
+#include "MCCIArena.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+
+// the global heap, except that it refuses to allocate while g_refuse is set
+bool g_refuse = false;
+
+template <typename T>
+struct RefusingAllocator
+{
+    typedef T value_type;
+
+    RefusingAllocator() {}
+    template <typename U> RefusingAllocator(const RefusingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (g_refuse) throw bad_alloc();
+        return (T*)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t) { ::operator delete(p); }
+
+    template <typename U> bool operator==(const RefusingAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const RefusingAllocator<U>&) const { return false; }
+};
+
+
+// a few keys in, some lowered and raised, and out in order
+template <typename Heap>
+void doTest(const char* name)
+{
+    Heap h;
+    vector<typename Heap::Node*> nodes;
+
+    cout << "\n" << name << ":\n";
+
+    const char* data[] = {"a", "b", "c", "d", "e", "f"};
+    uint keys[] = {400, 200, 70, 50, 10, 80};
+    for (uint i = 0; i < 6; ++i) nodes.push_back(h.insert(keys[i], data[i]));
+    h.print_roots(cout);
+    cout << endl;
+
+    h.alter_key(nodes[0], 5, 0);    // a goes first
+    h.alter_key(nodes[4], 300, 0);  // e goes second to last
+    h.remove(nodes[3], 0);          // d goes
+    h.print_roots(cout);
+    cout << endl;
+
+    const char* order[] = {"a", "c", "f", "b", "e"};
+    for (uint i = 0; i < 5; ++i)
+    {
+        cout << "min=";
+        h.minimum()->print_node(cout);
+        cout << endl;
+        if (order[i] != h.minimum()->data()) throw string(name) + " out of order";
+        h.remove_minimum();
+    }
+    if (!h.empty()) throw string(name) + " isn't empty";
+}
+
+
+// counts what pop_expired lets go of, and checks it was due
+template <typename Node>
+struct CountExpired
+{
+    uint now;
+    uint* count;
+
+    void operator()(const Node* n)
+    {
+        if (!(n->key() < this->now)) throw string("expired a node that wasn't due");
+        ++*this->count;
+    }
+};
+
+
+// random inserts, reschedules, cancels and removals of the minimum, checked against the
+//  keys we know are in the heap, with the nodes from a pool
+template <template <typename, typename, typename> class Queue>
+void doRandomTest(const char* name)
+{
+    typedef typename Queue<uint, uint, std::allocator<char> >::Node Node;
+    CMCCIArena arena;
+    {
+        Queue<uint, uint, CMCCIArenaAllocator<Node> > h((CMCCIArenaAllocator<Node>(&arena)));
+        vector<Node*> live;
+        uint x = 1;
+
+        for (uint i = 0; i < 20000; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            uint r = x >> 8;
+            uint k = 1 + (x >> 4) % ((0 == r % 3) ? 100 : 100000);  // ties, and not
+
+            switch (r % 4)
+            {
+              case 0:
+              case 1:
+                live.push_back(h.insert(k, i));
+                break;
+
+              case 2:  // reschedule or cancel one at random
+                if (live.empty()) break;
+                {
+                    uint j = (x >> 3) % live.size();
+                    if (r & 0x100)
+                    {
+                        h.alter_key(live[j], k, 0);
+                    }
+                    else
+                    {
+                        h.remove(live[j], 0);
+                        live[j] = live.back();
+                        live.pop_back();
+                    }
+                }
+                break;
+
+              case 3:
+                if (h.empty()) break;
+                live.erase(find(live.begin(), live.end(), h.minimum()));
+                h.remove_minimum();
+                break;
+            }
+
+            if (live.size() != h.size()) throw string(name) + " count is off";
+            if (!live.empty())
+            {
+                uint smallest = live[0]->key();
+                for (uint j = 1; j < live.size(); ++j) smallest = min(smallest, live[j]->key());
+                if (h.minimum()->key() != smallest) throw string(name) + " minimum is wrong";
+            }
+        }
+
+        // expire the earliest third in one go
+        multimap<uint, Node*> expected;
+        for (uint j = 0; j < live.size(); ++j) expected.insert(make_pair(live[j]->key(), live[j]));
+        typename multimap<uint, Node*>::iterator it = expected.begin();
+        advance(it, live.size() / 3);
+
+        uint popped = 0;
+        CountExpired<Node> expire;
+        expire.now = it->first;
+        expire.count = &popped;
+        if (h.pop_expired(expire.now, expire) != popped
+            || popped != (uint)distance(expected.begin(), expected.lower_bound(expire.now)))
+            throw string(name) + " expired the wrong number";
+        if (popped + h.size() != live.size()) throw string(name) + " count is off after expiring";
+        expected.erase(expected.begin(), expected.lower_bound(expire.now));
+        if (h.minimum()->key() != expected.begin()->first) throw string(name) + " minimum is wrong after expiring";
+
+        // drain half of the rest in order, and clear the others out
+        it = expected.begin();
+        for (uint j = 0; j < expected.size() / 2; ++j, ++it)
+        {
+            if (h.minimum()->key() != it->first) throw string(name) + " drained out of order";
+            h.remove_minimum();
+        }
+        h.clear();
+        if (!h.empty() || arena.get_in_use()) throw string(name) + " kept nodes after clear";
+
+        // and it's as good as new; the heap takes these with it
+        h.insert(7, 0);
+        h.insert(3, 1);
+        if (3 != h.minimum()->key()) throw string(name) + " minimum is wrong after clear";
+
+        cout << "\n" << name << ": random operations against a reference, "
+             << arena.get_reserved() << " bytes reserved";
+    }
+    if (arena.get_in_use()) throw string(name) + " left nodes behind";
+}
+
+
+// batches from the same pool, with holes left by removals, merged into a heap one after
+//  another: the nodes taken in must still be good handles, and come out in order
+template <template <typename, typename, typename> class Queue>
+void doMergeTest(const char* name)
+{
+    typedef typename Queue<uint, uint, std::allocator<char> >::Node Node;
+    typedef Queue<uint, uint, CMCCIArenaAllocator<Node> > Heap;
+    CMCCIArena arena;
+    {
+        Heap h((CMCCIArenaAllocator<Node>(&arena)));
+        multiset<uint> expected;
+        uint x = 3;
+
+        for (uint round = 0; round < 20; ++round)
+        {
+            Heap batch((CMCCIArenaAllocator<Node>(&arena)));
+            vector<Node*> added;
+            for (uint i = 0; i < 50 * round; ++i)
+            {
+                x = x * 1103515245 + 12345;
+                added.push_back(batch.insert(1 + round * 100 + (x >> 8) % 5000, i));
+                if (6 == i % 7)
+                {
+                    uint j = (x >> 4) % added.size();
+                    batch.remove(added[j], 0);
+                    added[j] = added.back();
+                    added.pop_back();
+                }
+            }
+
+            h.merge(batch);
+            if (!batch.empty()) throw string(name) + " batch isn't empty after merging";
+            if (3 == round) h.merge(batch);  // nothing to take
+
+            // the handles are the heap's now
+            for (uint j = 0; j < added.size(); ++j)
+            {
+                if (0 == j % 5) h.alter_key(added[j], 1 + (added[j]->key() * 7) % 3000, 0);
+                expected.insert(added[j]->key());
+            }
+
+            for (uint j = 0; j < round * 10 && !expected.empty(); ++j)
+            {
+                if (h.minimum()->key() != *expected.begin()) throw string(name) + " minimum is wrong after merging";
+                h.remove_minimum();
+                expected.erase(expected.begin());
+            }
+            if (h.size() != expected.size()) throw string(name) + " count is off after merging";
+
+            batch.insert(5, 0);  // and the batch is still a heap of its own
+        }
+
+        while (!expected.empty())
+        {
+            if (h.minimum()->key() != *expected.begin()) throw string(name) + " drained out of order after merging";
+            h.remove_minimum();
+            expected.erase(expected.begin());
+        }
+        if (!h.empty()) throw string(name) + " isn't empty after draining";
+
+        cout << "\n" << name << ": batches merged in and drained in order";
+    }
+    if (arena.get_in_use()) throw string(name) + " left nodes behind after merging";
+}
+
+
+// a compact heap that can't take in another's chunks throws, leaving both heaps whole
+void doRefusedMergeTest()
+{
+    typedef CompactFibonacciHeap<uint, uint, RefusingAllocator<char> > Heap;
+    Heap h, batch;
+
+    for (uint i = 0; i < 100; ++i)
+    {
+        h.insert(1000 + i, i);
+        batch.insert(i, i);
+    }
+    batch.remove_minimum();  // so batch has children, and a free node
+    batch.insert(0, 0);
+
+    bool refused = false;
+    g_refuse = true;
+    try { h.merge(batch); } catch (bad_alloc&) { refused = true; }
+    g_refuse = false;
+    if (!refused) throw string("compact fibonacci heap merged without growing its chunk table");
+    if (100 != h.size() || 100 != batch.size()) throw string("compact fibonacci heap lost nodes in a refused merge");
+
+    h.merge(batch);
+    for (uint i = 0; i < 200; ++i)
+    {
+        if (h.minimum()->key() != (i < 100 ? i : 900 + i))
+            throw string("compact fibonacci heap drained out of order after a refused merge");
+        h.remove_minimum();
+    }
+    if (!h.empty() || !batch.empty()) throw string("compact fibonacci heap isn't empty after a refused merge");
+
+    cout << "\ncompact fibonacci heap: a refused merge left both heaps whole";
+}
+
+
+int main() {
+    try
+    {
+        doTest<PairingHeap<uint, string> >("pairing heap");
+        doTest<DaryHeap<uint, string> >("d-ary heap");
+        doTest<CompactFibonacciHeap<uint, string> >("compact fibonacci heap");
+
+        doRandomTest<FibonacciHeap>("fibonacci heap");
+        doRandomTest<CompactFibonacciHeap>("compact fibonacci heap");
+        doRandomTest<PairingHeap>("pairing heap");
+        doRandomTest<DaryHeap>("d-ary heap");
+        doRandomTest<TimingWheel>("timing wheel");
+
+        doMergeTest<FibonacciHeap>("fibonacci heap");
+        doMergeTest<CompactFibonacciHeap>("compact fibonacci heap");
+        doMergeTest<PairingHeap>("pairing heap");
+        doMergeTest<DaryHeap>("d-ary heap");
+        doMergeTest<TimingWheel>("timing wheel");
+        doRefusedMergeTest();
+        cout << endl;
+    }
+    catch (string s)
+    {
+        cerr << endl << "ERROR: " << s << endl;
+        return 1;
+    }
+}
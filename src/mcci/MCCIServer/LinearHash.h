@@ -1,9 +1,15 @@
-
 #pragma once
 
 #include <string>
 #include <map>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <memory>
+#include <new>
 #include <stdio.h>
+#include <boost/cstdint.hpp>
 
 using namespace std;
 
@@ -27,68 +33,258 @@ static unsigned int LINEAR_HASH_TABLE_PRIMES[] = {
     16384 - 3,
     32768 - 19,
     65536 - 15,
+    131072 - 1,
+    262144 - 5,
+    524288 - 1,
+    1048576 - 3,
+    2097152 - 9,
+    4194304 - 3,
+    8388608 - 15,
+    16777216 - 3,
+    33554432 - 39,
+    67108864 - 5,
+    134217728 - 39,
+    268435456 - 57,
+    536870912 - 3,
+    1073741824 - 35,
+    2147483648u - 1,
+};
+
+#define LINEAR_HASH_TABLE_PRIMES_COUNT (sizeof(LINEAR_HASH_TABLE_PRIMES) / sizeof(unsigned int))
+
+// buckets added by growth are allocated in segments of this many (a power of 2)
+#define LINEAR_HASH_SEGMENT_BITS 8
+#define LINEAR_HASH_SEGMENT_SIZE (1 << LINEAR_HASH_SEGMENT_BITS)
+
+// default average number of keys per bucket before a bucket is split
+#define LINEAR_HASH_MAX_LOAD_FACTOR 1.0
+
+
+/* Storage policies for LinearHash, selected by its third template parameter */
+struct LinearHashChained {};  // array of trees, one per bucket
+struct LinearHashFlat {};     // open addressing in one contiguous array (LinearHashFlat.h)
+struct LinearHashDense {};    // direct-indexed pages, for keys of 16 bits or less (LinearHashDense.h)
+struct LinearHashGroup {};    // open addressing probed 16 slots at a time with SIMD (LinearHashGroup.h)
+
+
+/* Hash policies, selected by the fourth template parameter: each turns a key into a 32-bit
+   hash code, which the storage then reduces to a bucket */
+struct LinearHashIdentity       // f(i) = i, folded to 32 bits; best for contiguous keys and prime sizes
+{
+    static uint32_t hash(uint64_t k) { return (uint32_t)(k ^ (k >> 32)); }
+};
+
+struct LinearHashMultiplyShift  // Fibonacci hashing: the high bits of k * 2^64/phi
+{
+    static uint32_t hash(uint64_t k) { return (uint32_t)((k * 11400714819323198485ull) >> 32); }
+};
+
+struct LinearHashMurmur         // the murmur3 64-bit finalizer, for keys with structure in every bit
+{
+    static uint32_t hash(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return (uint32_t)k;
+    }
 };
 
+/* Each storage has a hash that suits how it reduces hash codes to buckets */
+template <typename Storage> struct LinearHashDefaultHash { typedef LinearHashIdentity type; };
+template <> struct LinearHashDefaultHash<LinearHashFlat> { typedef LinearHashMultiplyShift type; };
+template <> struct LinearHashDefaultHash<LinearHashGroup> { typedef LinearHashMultiplyShift type; };
 
 
+/* Key traits choose the default storage: small keys index an array directly, others use Fallback */
+template <typename Key, typename Fallback = LinearHashChained>
+struct LinearHashTraits { typedef Fallback storage; };
+
+template <typename Fallback> struct LinearHashTraits<bool, Fallback>           { typedef LinearHashDense storage; };
+template <typename Fallback> struct LinearHashTraits<char, Fallback>           { typedef LinearHashDense storage; };
+template <typename Fallback> struct LinearHashTraits<signed char, Fallback>    { typedef LinearHashDense storage; };
+template <typename Fallback> struct LinearHashTraits<unsigned char, Fallback>  { typedef LinearHashDense storage; };
+template <typename Fallback> struct LinearHashTraits<short, Fallback>          { typedef LinearHashDense storage; };
+template <typename Fallback> struct LinearHashTraits<unsigned short, Fallback> { typedef LinearHashDense storage; };
+
 
 /**
    A simple hash table that uses f(i) = i for the hash function (so does Sun's hash table implementation)
 
    This hash table is designed for speed and for integer keys (key should be some variant of int/long/etc)
 
-   It is assumed that contiguous blocks of integer keys will be hashed.
+   It is assumed that contiguous blocks of integer keys will be hashed.  Keys with structure
+   in their high bits, like (host << 16) + var, should use a mixing hash policy instead
+   (LinearHashMultiplyShift or LinearHashMurmur).
+
+   Hash codes are reduced to a bucket modulo the table size, or by masking if the table
+   was sized with resize_power_of_two (which only makes sense with a mixing hash).
+
+   The table grows online, by Litwin's linear hashing: when the load factor passes its
+   limit, the bucket at the split pointer is divided between itself and one new bucket
+   at the end of the table.  Keys in buckets below the split pointer are addressed
+   modulo twice the round size.  There is never a whole-table rehash, so no insert pays
+   for more than a bucket or two of work.
+
+   Values are moved, never copied, when buckets split, and try_emplace constructs them
+   in place, so tables can hold other tables (or anything else expensive to copy).  Since
+   a split moves values, any insert may invalidate references and iterators into the
+   table; finding a key that is already there (with find, operator[] or try_emplace)
+   never does.  A table that has been moved from has no buckets: it may only be
+   destroyed, assigned to, or resized.
+
+   The buckets' trees, and the arrays that hold them, come from the allocator (for
+   instance a CMCCIArenaAllocator, to keep a table and everything in it in one arena).
+
+   Other storage policies are provided as specializations with the same interface.
    
  */
-template <typename Key, typename Data> class LinearHash
+template <typename Key,
+          typename Data,
+          typename Storage = typename LinearHashTraits<Key>::storage,
+          typename Hash = typename LinearHashDefaultHash<Storage>::type,
+          typename Alloc = std::allocator<pair<const Key, Data> > >
+class LinearHash
 {
 
   public:
     // to deal with collisions, we use a map (implemented as a RB tree, usually)
-    typedef map<Key, Data> Container;
+    typedef map<Key, Data, less<Key>, Alloc> Container;
     typedef typename Container::iterator ContainerIterator;
 
     
   protected:
-    
-    // internal storage is an array of trees
-    Container* m_container;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Container> ContainerAlloc;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Container*> SegmentAlloc;
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<uint64_t> OccupiedAlloc;
+
+    // where the trees, their nodes and our own arrays come from
+    Alloc m_alloc;
+
+    // internal storage is an array of trees, in segments: the initial buckets, then
+    //  fixed-size segments for the buckets that growth has added
+    vector<Container*, SegmentAlloc> m_segment;
 
     // the number of trees in our hash
     unsigned int m_size;
 
+    // the number of trees we started with (by resize), and at the start of this round
+    unsigned int m_base_size;
+    unsigned int m_round_size;
+
+    // the next tree to be split; m_size == m_round_size + m_split
+    unsigned int m_split;
+
+    // whether the round size is a power of 2 (it stays one if it starts as one), so we can mask
+    bool m_masked;
+
+    // the number of elements, and how many we allow per tree before splitting
+    unsigned int m_count;
+    double m_max_load_factor;
+
+    // one bit per tree, set if the tree has any elements, so iteration can skip empty ones
+    vector<uint64_t, OccupiedAlloc> m_occupied;
+
     
   public:
 
-    LinearHash()
+    explicit LinearHash(const Alloc& alloc = Alloc())
+      : m_alloc(alloc), m_segment(alloc), m_occupied(alloc)
     {
         this->m_size = 0;
+        this->m_max_load_factor = LINEAR_HASH_MAX_LOAD_FACTOR;
         this->resize(1);
     }
     
 
-    LinearHash(unsigned int size)
+    LinearHash(unsigned int size, const Alloc& alloc = Alloc())
+      : m_alloc(alloc), m_segment(alloc), m_occupied(alloc)
     {
         this->m_size = 0;
+        this->m_max_load_factor = LINEAR_HASH_MAX_LOAD_FACTOR;
         this->resize(size);
     }
 
     LinearHash(const LinearHash &rhs)
+      : LinearHash(rhs, allocator_traits<Alloc>::select_on_container_copy_construction(rhs.m_alloc))
     {
-        this->m_size = 0;
-        this->resize(rhs.m_size);
+    }
 
-        for (iterator it = rhs.begin(); it != rhs.end(); ++it)
-        {
-            this->insert(it->first, it->second);
-        }
-        
+    // copy bucket for bucket, so nothing is rehashed or rebalanced
+    LinearHash(const LinearHash &rhs, const Alloc& alloc)
+      : m_alloc(alloc), m_segment(alloc), m_occupied(alloc)
+    {
+        this->init_empty(rhs.m_max_load_factor);
+        if (!rhs.m_size) return;
+
+        this->resize(rhs.m_base_size);
+        for (unsigned int i = 1; i < rhs.m_segment.size(); ++i)
+            this->m_segment.push_back(this->new_segment(LINEAR_HASH_SEGMENT_SIZE));
+
+        this->m_size = rhs.m_size;
+        this->m_round_size = rhs.m_round_size;
+        this->m_split = rhs.m_split;
+        this->m_count = rhs.m_count;
+        this->m_occupied.assign(rhs.m_occupied.begin(), rhs.m_occupied.end());
+
+        for (unsigned int i = rhs.next_occupied(0); i < rhs.m_size; i = rhs.next_occupied(i + 1))
+            this->bucket(i) = rhs.bucket(i);
+    }
+
+
+    // take over the buckets of another table, leaving it with none
+    LinearHash(LinearHash &&rhs)
+      : m_alloc(rhs.m_alloc), m_segment(rhs.m_alloc), m_occupied(rhs.m_alloc)
+    {
+        this->init_empty(rhs.m_max_load_factor);
+        this->swap(rhs);
     }
 
     
     ~LinearHash()
     {
-        if (this->m_size) delete[] this->m_container;
+        if (this->m_size) this->release();
+    }
+
+
+    LinearHash& operator=(const LinearHash &rhs)
+    {
+        if (this != &rhs)
+        {
+            LinearHash tmp(rhs, this->m_alloc);  // a copy stays in our own allocator
+            this->swap(tmp);
+        }
+        return *this;
+    }
+
+
+    LinearHash& operator=(LinearHash &&rhs)
+    {
+        if (this != &rhs)
+        {
+            if (this->m_size) this->release();
+            this->init_empty(this->m_max_load_factor);
+            this->swap(rhs);
+        }
+        return *this;
+    }
+
+
+    // exchange contents with another table, without copying any elements
+    void swap(LinearHash &rhs)
+    {
+        std::swap(this->m_alloc, rhs.m_alloc);
+        std::swap(this->m_segment, rhs.m_segment);
+        std::swap(this->m_size, rhs.m_size);
+        std::swap(this->m_base_size, rhs.m_base_size);
+        std::swap(this->m_round_size, rhs.m_round_size);
+        std::swap(this->m_split, rhs.m_split);
+        std::swap(this->m_masked, rhs.m_masked);
+        std::swap(this->m_count, rhs.m_count);
+        std::swap(this->m_max_load_factor, rhs.m_max_load_factor);
+        std::swap(this->m_occupied, rhs.m_occupied);
     }
 
 
@@ -102,16 +298,31 @@ template <typename Key, typename Data> class LinearHash
 
         if (this->m_size)
         {
-            delete[] this->m_container;
-            this->m_size = 0;
+            this->release();
         }
 
         this->m_size = size;
-        this->m_container = new Container[this->m_size]();
+        this->m_base_size = size;
+        this->m_round_size = size;
+        this->m_split = 0;
+        this->m_masked = 0 == (size & (size - 1));
+        this->m_count = 0;
+        this->m_segment.push_back(this->new_segment(this->m_size));
+        this->m_occupied.assign((size + 63) / 64, 0);
         
     }
 
 
+    // resize, destructively, to the smallest power of 2 that holds the desired storage;
+    //  buckets are then addressed by masking instead of division
+    void resize_power_of_two(unsigned int desired_size)
+    {
+        unsigned int size = 1;
+        while (size < desired_size && size < (1u << 31)) size <<= 1;
+        this->resize(size);
+    }
+
+
     // resize to a prime number size according to desired storage
     void resize_nearest_prime(unsigned int desired_size)
     {
@@ -122,7 +333,9 @@ template <typename Key, typename Data> class LinearHash
         }
         else
         {
-            for (i = 1; i < 16 && LINEAR_HASH_TABLE_PRIMES[i] <= desired_size; ++i);
+            for (i = 1;
+                 i < LINEAR_HASH_TABLE_PRIMES_COUNT && LINEAR_HASH_TABLE_PRIMES[i] <= desired_size;
+                 ++i);
         
             this->resize(LINEAR_HASH_TABLE_PRIMES[i - 1]);
         }
@@ -139,21 +352,33 @@ template <typename Key, typename Data> class LinearHash
     // return the number of elements in the hash table
     unsigned int count() const
     {
-        unsigned int sum = 0;
-
-        // TODO: track it differently so its O(1)
-        for (unsigned int i = 0; i < this->m_size; ++i)
-            sum += this->m_container[i].size();
-
-        return sum;
+        return this->m_count;
     }
 
 
     // return whether the table is empty
     bool empty() const
     {
-        return 0 == this->count();
+        return 0 == this->m_count;
+    }
+
+
+    // the average number of keys per tree that triggers a split
+    double get_max_load_factor() const
+    {
+        return this->m_max_load_factor;
+    }
+
+    void set_max_load_factor(double f)
+    {
+        if (!(0 < f))
+        {
+            throw string("Tried to set hash max load factor to 0 or less");
+        }
+
+        this->m_max_load_factor = f;
     }
+
     
     // get the maximum key collisions on any given bucket
     unsigned int max_collisions() const
@@ -161,60 +386,88 @@ template <typename Key, typename Data> class LinearHash
         unsigned int max = 0;
 
         for (unsigned int i = 0; i < this->m_size; ++i)
-            if (max < this->m_container[i].size())
-                max = this->m_container[i].size();
+            if (max < this->bucket(i).size())
+                max = this->bucket(i).size();
 
         return max;
     }
 
+
+    // get the average number of keys sharing a bucket with any given key (1 is perfect)
+    double mean_collisions() const
+    {
+        double sum = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            sum += (double)this->bucket(i).size() * this->bucket(i).size();
+
+        return this->m_count ? sum / this->m_count : 0;
+    }
+
     
-    // explicitly insert an element into the hash
+    // explicitly insert an element into the hash (pass an rvalue to have it moved in)
     void insert(Key k, Data d)
     {
-        this->m_container[k % this->m_size][k] = d;
+        pair<iterator, bool> r = this->try_emplace(k, std::move(d));
+        if (!r.second) r.first->second = std::move(d);
     }
 
     
     // explicitly remove a key from the hash
     void remove(Key k)
     {
-        this->m_container[k % this->m_size].erase(k);
+        unsigned int idx = this->address(k);
+        if (this->bucket(idx).erase(k)) this->removed(idx);
     }
 
     
     // check existence of a hashed value
     bool has_key(Key k) const
     {
-        unsigned int idx = k % this->m_size;
-        return this->m_container[idx].end() != this->m_container[idx].find(k);
+        Container& c = this->bucket(this->address(k));
+        return c.end() != c.find(k);
     }
 
 
-    // read-only access
+    // read-only access (this adds the key if it is missing)
     Data& operator[] (Key k) const
     {
-        return this->m_container[k % this->m_size][k];
+        return const_cast<LinearHash*>(this)->operator[](k);
     }
     
     
     // array-style access to the hash
     Data& operator[] (Key k)
     {
-        return this->m_container[k % this->m_size][k];
+        unsigned int idx = this->address(k);
+        ContainerIterator ci = this->bucket(idx).find(k);
+        if (this->bucket(idx).end() != ci) return ci->second;
+
+        // only an insert splits, and before it adds, so the reference we return stays put
+        this->grow();
+        idx = this->address(k);
+        Data& ret = this->bucket(idx)[k];
+        this->added(idx);
+        return ret;
     }
 
 
     // remove all elements from the hash
     void clear()
     {
-        for (int i = 0; i < this->m_size; ++i)
-            this->m_container[i].clear();
+        for (unsigned int i = this->next_occupied(0); i < this->m_size; i = this->next_occupied(i + 1))
+            this->bucket(i).clear();
+
+        fill(this->m_occupied.begin(), this->m_occupied.end(), 0);
+        this->m_count = 0;
     }
 
 
     class iterator : public std::iterator<std::input_iterator_tag, pair<Key, Data> >
     {
-        const LinearHash<Key, Data>* h;
+        friend class LinearHash;
+
+        const LinearHash* h;
         unsigned int idx;
         ContainerIterator ci;
 
@@ -222,7 +475,7 @@ template <typename Key, typename Data> class LinearHash
 
         iterator() {}
         
-        iterator(const LinearHash<Key, Data>* const h, unsigned int idx, const ContainerIterator ci)
+        iterator(const LinearHash* const h, unsigned int idx, const ContainerIterator ci)
         {
             this->h = h;
             this->idx = idx;
@@ -246,20 +499,17 @@ template <typename Key, typename Data> class LinearHash
         iterator& operator++()
         {
             // increment individual tree pointer, or jump to next un-vacant tree
-            if (this->h->m_container[this->idx].end() != ++(this->ci)) return *this;
+            if (this->h->bucket(this->idx).end() != ++(this->ci)) return *this;
 
-            for (++(this->idx); this->idx < this->h->m_size; ++(this->idx))
+            this->idx = this->h->next_occupied(this->idx + 1);
+            if (this->idx < this->h->m_size)
             {
-                //fprintf(stderr, "\ntrying tree %d of %d", this->idx, this->h->m_size - 1);
-                if (!this->h->m_container[this->idx].empty())
-                {
-                    this->ci = this->h->m_container[this->idx].begin();
-                    return *this;
-                }
+                this->ci = this->h->bucket(this->idx).begin();
+                return *this;
             }
 
             // point to end if we don't find anything
-            this->ci = this->h->m_container[this->h->m_size - 1].end();
+            this->ci = this->h->bucket(this->h->m_size - 1).end();
             return *this;
         }
 
@@ -270,29 +520,31 @@ template <typename Key, typename Data> class LinearHash
             return tmp;
         }
 
-        bool operator==(const iterator& rhs)
+        bool operator==(const iterator& rhs) const
         {
             return rhs.h == this->h && rhs.idx == this->idx && rhs.ci == this->ci;
         }
 
-        bool operator!=(const iterator& rhs)
+        bool operator!=(const iterator& rhs) const
         {
             return rhs.h != this->h || rhs.idx != this->idx || (!(rhs.ci == this->ci));
         }
 
-        pair<const Key, Data> operator*() { return *(this->ci); }
+        pair<const Key, Data>& operator*() { return *(this->ci); }
 
         pair<const Key, Data>* operator->() { return &(*(this->ci)); }
 
         
     };
 
+    // what a const table iterates with; begin() and end() are const already
+    typedef iterator const_iterator;
+
     // iteration points: begin
     iterator begin() const
     {
-        for (unsigned int i = 0; i < this->m_size; ++i)
-            if (!this->m_container[i].empty())
-                return iterator(this, i, this->m_container[i].begin());
+        unsigned int i = this->next_occupied(0);
+        if (i < this->m_size) return iterator(this, i, this->bucket(i).begin());
 
         return this->end();
     }
@@ -301,8 +553,228 @@ template <typename Key, typename Data> class LinearHash
     iterator end() const
     {
         unsigned int last = this->m_size - 1;
-        return iterator(this, last + 1, this->m_container[last].end());
+        return iterator(this, last + 1, this->bucket(last).end());
+    }
+
+
+    // find a key, returning end() if it isn't there
+    iterator find(Key k) const
+    {
+        unsigned int idx = this->address(k);
+        Container& c = this->bucket(idx);
+        ContainerIterator ci = c.find(k);
+        return c.end() == ci ? this->end() : iterator(this, idx, ci);
+    }
+
+
+    // unless the key is already there, add it with a value constructed in place from args;
+    //  either way, return where it is and whether it was added
+    template <typename... Args>
+    pair<iterator, bool> try_emplace(Key k, Args&&... args)
+    {
+        unsigned int idx = this->address(k);
+        ContainerIterator ci = this->bucket(idx).lower_bound(k);
+        if (this->bucket(idx).end() != ci && !(k < ci->first)) return make_pair(iterator(this, idx, ci), false);
+
+        // only an insert splits, and before it adds, so the iterator we return stays put
+        unsigned int size = this->m_size;
+        this->grow();
+        if (size != this->m_size)
+        {
+            idx = this->address(k);
+            ci = this->bucket(idx).lower_bound(k);
+        }
+
+        Container& c = this->bucket(idx);
+        ci = c.emplace_hint(ci, piecewise_construct, forward_as_tuple(k), forward_as_tuple(std::forward<Args>(args)...));
+        this->added(idx);
+        return make_pair(iterator(this, idx, ci), true);
+    }
+
+
+    // the standard library's name for the same thing (the key is never constructed here)
+    template <typename... Args>
+    pair<iterator, bool> emplace(Key k, Args&&... args)
+    {
+        return this->try_emplace(k, std::forward<Args>(args)...);
+    }
+
+
+    // remove the element at an iterator (found with find or try_emplace)
+    void erase(iterator it)
+    {
+        this->bucket(it.idx).erase(it.ci);
+        this->removed(it.idx);
+    }
+
+
+  protected:
+
+    // no buckets at all, the state a table is left in when it is moved from
+    void init_empty(double max_load_factor)
+    {
+        this->m_size = 0;
+        this->m_base_size = 0;
+        this->m_round_size = 0;
+        this->m_split = 0;
+        this->m_masked = false;
+        this->m_count = 0;
+        this->m_max_load_factor = max_load_factor;
+    }
+
+
+    // the tree for a bucket index
+    Container& bucket(unsigned int idx) const
+    {
+        if (idx < this->m_base_size) return this->m_segment[0][idx];
+
+        idx -= this->m_base_size;
+        return this->m_segment[1 + (idx >> LINEAR_HASH_SEGMENT_BITS)][idx & (LINEAR_HASH_SEGMENT_SIZE - 1)];
+    }
+
+
+    // the bucket index for a key: its hash modulo the round size, or twice that if already split
+    unsigned int address(Key k) const
+    {
+        uint32_t h = Hash::hash(k);
+        unsigned int idx = this->reduce(h, this->m_round_size);
+        if (idx < this->m_split) idx = this->reduce(h, 2 * this->m_round_size);
+        return idx;
+    }
+
+
+    // a hash code modulo n, which is a power of 2 if we are masking
+    unsigned int reduce(uint32_t h, unsigned int n) const
+    {
+        return this->m_masked ? h & (n - 1) : h % n;
+    }
+
+
+    // split buckets until the load factor is back under its limit
+    void grow()
+    {
+        while (this->m_count > this->m_max_load_factor * this->m_size) this->split();
+    }
+
+
+    // add one bucket to the end of the table, and move into it the keys from the split bucket
+    void split()
+    {
+        unsigned int new_idx = this->m_size;
+
+        if (this->m_base_size <= new_idx && 0 == ((new_idx - this->m_base_size) & (LINEAR_HASH_SEGMENT_SIZE - 1)))
+        {
+            this->m_segment.push_back(this->new_segment(LINEAR_HASH_SEGMENT_SIZE));
+        }
+        if (0 == new_idx % 64) this->m_occupied.push_back(0);
+
+        Container& from = this->bucket(this->m_split);
+        Container& to = this->bucket(new_idx);
+        unsigned int modulus = 2 * this->m_round_size;
+
+        for (ContainerIterator it = from.begin(); it != from.end(); )
+        {
+            if (this->reduce(Hash::hash(it->first), modulus) == new_idx)
+            {
+                // keys arrive in order, so the hint makes this O(1); the value is moved, not copied
+                to.emplace_hint(to.end(), it->first, std::move(it->second));
+                from.erase(it++);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        this->mark(this->m_split, !from.empty());
+        this->mark(new_idx, !to.empty());
+
+        ++(this->m_size);
+        if (++(this->m_split) == this->m_round_size)
+        {
+            this->m_round_size *= 2;
+            this->m_split = 0;
+        }
+    }
+
+
+    // an array of empty trees, using our allocator for both
+    Container* new_segment(unsigned int n)
+    {
+        ContainerAlloc a(this->m_alloc);
+        Container* segment = allocator_traits<ContainerAlloc>::allocate(a, n);
+        for (unsigned int i = 0; i < n; ++i)
+            new (segment + i) Container(this->m_alloc);
+        return segment;
+    }
+
+    void delete_segment(Container* segment, unsigned int n)
+    {
+        for (unsigned int i = 0; i < n; ++i)
+            segment[i].~Container();
+
+        ContainerAlloc a(this->m_alloc);
+        allocator_traits<ContainerAlloc>::deallocate(a, segment, n);
+    }
+
+
+    // free all trees
+    void release()
+    {
+        for (unsigned int i = 0; i < this->m_segment.size(); ++i)
+            this->delete_segment(this->m_segment[i], i ? LINEAR_HASH_SEGMENT_SIZE : this->m_base_size);
+
+        this->m_segment.clear();
+        this->m_occupied.clear();
+        this->m_size = 0;
+    }
+
+
+    // bookkeeping after a key is added to, or removed from, a tree
+    void added(unsigned int idx)
+    {
+        ++(this->m_count);
+        this->mark(idx, true);
+    }
+
+    void removed(unsigned int idx)
+    {
+        --(this->m_count);
+        if (this->bucket(idx).empty()) this->mark(idx, false);
+    }
+
+
+    // set or clear the occupancy bit for a tree
+    void mark(unsigned int idx, bool occupied)
+    {
+        if (occupied)
+            this->m_occupied[idx / 64] |= 1ull << (idx % 64);
+        else
+            this->m_occupied[idx / 64] &= ~(1ull << (idx % 64));
+    }
+
+
+    // the first non-empty tree at or after idx, or m_size if there are none
+    unsigned int next_occupied(unsigned int idx) const
+    {
+        if (idx >= this->m_size) return this->m_size;
+
+        unsigned int w = idx / 64;
+        uint64_t word = this->m_occupied[w] & (~0ull << (idx % 64));
+
+        // skip empty words, then count trailing zeros to find the tree
+        while (!word)
+        {
+            if (++w == this->m_occupied.size()) return this->m_size;
+            word = this->m_occupied[w];
+        }
+
+        return w * 64 + __builtin_ctzll(word);
     }
 
 
 };
+
+
+// the default for small keys, so it must always be available
+#include "LinearHashDense.h"
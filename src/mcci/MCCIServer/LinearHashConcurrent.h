@@ -0,0 +1,473 @@
+
+#pragma once
+
+#include "LinearHash.h"
+#include <boost/cstdint.hpp>
+#include <vector>
+#include <type_traits>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+// default number of independently locked sub-tables
+#define LINEAR_HASH_CONCURRENT_SHARDS 16
+
+// smallest number of slots in a sub-table (a power of 2)
+#define LINEAR_HASH_CONCURRENT_MIN_SIZE 16
+
+// spins a reader makes waiting for a writer before giving up its time slice
+#define LINEAR_HASH_CONCURRENT_SPINS 64
+
+// slot states
+#define LINEAR_HASH_CONCURRENT_EMPTY   0
+#define LINEAR_HASH_CONCURRENT_FULL    1
+
+
+/**
+   A hash table that many threads can use at once.
+
+   Keys are spread by their hash over a number of shards, each an open-addressing table
+   with its own lock, so writers to different shards never wait for each other.  Readers
+   take no locks at all: every shard carries a sequence number (a "seqlock") that a writer
+   makes odd while it changes the shard and even again when it is done.  A reader notes the
+   sequence number, looks up its key, and tries again if the number has changed in the
+   meantime, so it only ever returns a value that was consistent.
+
+   A reader may be part-way through a sub-table when a writer replaces it with a bigger one,
+   so replaced sub-tables are not freed until the hash is destroyed or reclaim() is called
+   at a point where no lookups are running.  Since sub-tables double, this never costs more
+   than the live tables themselves.
+
+   Lookups copy the value out instead of returning a reference or iterator (which could be
+   invalidated by another thread at any moment), and a reader may copy a slot while a
+   writer is changing it, so keys and data must be trivially copyable: something cheap and
+   plain, such as a pointer or a number.  Otherwise insert, remove and has_key
+   behave like the single-threaded LinearHash.
+
+   The hash policy picks the shard from the top bits of the hash code and the slot from the
+   bits below them, so it must mix every bit; the default is multiply-shift.
+ */
+template <typename Key, typename Data, typename Hash = LinearHashMultiplyShift> class LinearHashConcurrent
+{
+    static_assert(is_trivially_copyable<Key>::value && is_trivially_copyable<Data>::value,
+                  "LinearHashConcurrent's readers copy keys and data as a writer may change them");
+
+  protected:
+
+    struct Slot
+    {
+        Key key;
+        Data data;
+        unsigned char state;
+    };
+
+    // one sub-table; once published, its size and arrays never change
+    struct Table
+    {
+        unsigned int size;      // a power of 2
+        Slot* slot;
+
+        Table(unsigned int size)
+        {
+            this->slot = new Slot[size]();
+            this->size = size;
+        }
+
+        ~Table()
+        {
+            delete[] this->slot;
+        }
+    };
+
+    struct Shard
+    {
+        // readers only touch these two
+        unsigned int seq;           // odd while a writer is changing the shard
+        Table* table;
+
+        // writers, under the lock
+        pthread_mutex_t lock;
+        unsigned int count;
+        vector<Table*> retired;     // old tables that a reader might still be looking at
+
+        // keep neighbouring shards' sequence numbers out of each other's cache lines
+        char padding[64];
+    };
+
+    // a shard's lock, held until the end of the scope however it is left.  writers do
+    //  everything that can throw (allocating) before they change the shard, so a throw
+    //  leaves it unlocked and as it was
+    class ShardLock
+    {
+        Shard& m_s;
+
+      public:
+        ShardLock(Shard& s) : m_s(s) { pthread_mutex_lock(&this->m_s.lock); }
+        ~ShardLock() { pthread_mutex_unlock(&this->m_s.lock); }
+
+      private:
+        ShardLock(const ShardLock &rhs);
+        ShardLock& operator=(const ShardLock &rhs);
+    };
+
+    Shard* m_shard;
+    unsigned int m_shards;
+
+
+  public:
+
+    LinearHashConcurrent(unsigned int shards = LINEAR_HASH_CONCURRENT_SHARDS, unsigned int size = 0)
+    {
+        if (!shards)
+        {
+            throw string("Tried to create a concurrent hash with 0 shards");
+        }
+
+        // size each shard to hold its share of the expected elements without growing
+        unsigned int slots = LINEAR_HASH_CONCURRENT_MIN_SIZE;
+        while (slots * 3 < (size / shards + 1) * 4) slots <<= 1;
+
+        this->m_shard = new Shard[shards];
+        this->m_shards = shards;
+
+        for (unsigned int i = 0; i < shards; ++i)
+        {
+            Shard& s = this->m_shard[i];
+            s.seq = 0;
+            s.table = new Table(slots);
+            s.count = 0;
+            pthread_mutex_init(&s.lock, NULL);
+        }
+    }
+
+
+    ~LinearHashConcurrent()
+    {
+        this->reclaim();
+
+        for (unsigned int i = 0; i < this->m_shards; ++i)
+        {
+            delete this->m_shard[i].table;
+            pthread_mutex_destroy(&this->m_shard[i].lock);
+        }
+
+        delete[] this->m_shard;
+    }
+
+
+    // the number of shards
+    unsigned int get_shards() const
+    {
+        return this->m_shards;
+    }
+
+
+    // the total number of slots in all shards
+    unsigned int get_size() const
+    {
+        unsigned int size = 0;
+        for (unsigned int i = 0; i < this->m_shards; ++i)
+            size += __atomic_load_n(&this->m_shard[i].table, __ATOMIC_ACQUIRE)->size;
+        return size;
+    }
+
+
+    // return the number of elements (exact only if no writer is running)
+    unsigned int count() const
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < this->m_shards; ++i)
+            count += __atomic_load_n(&this->m_shard[i].count, __ATOMIC_RELAXED);
+        return count;
+    }
+
+
+    // return whether the table is empty (exact only if no writer is running)
+    bool empty() const
+    {
+        return 0 == this->count();
+    }
+
+
+    // explicitly insert an element into the hash, replacing any existing value
+    void insert(Key k, Data d)
+    {
+        this->write(k, d, true);
+    }
+
+
+    // add an element unless the key is already there; return whether it was added
+    bool try_emplace(Key k, const Data& d = Data())
+    {
+        return this->write(k, d, false);
+    }
+
+
+    // explicitly remove a key from the hash; return whether it was there
+    bool remove(Key k)
+    {
+        uint32_t h = Hash::hash((uint64_t)k);
+        Shard& s = this->shard_of(h);
+        ShardLock lock(s);
+
+        Table* t = s.table;
+        unsigned int idx = this->find_index(t, k, h);
+        bool found = idx < t->size;
+
+        if (found)
+        {
+            begin_write(s);
+            this->erase_index(t, idx);
+            end_write(s);
+
+            __atomic_store_n(&s.count, s.count - 1, __ATOMIC_RELAXED);
+        }
+
+        return found;
+    }
+
+
+    // check existence of a hashed value, without locking
+    bool has_key(Key k) const
+    {
+        Data d = Data();
+        return this->find(k, d);
+    }
+
+
+    // look up a key without locking, copying its value into d; return whether it was there
+    bool find(Key k, Data& d) const
+    {
+        uint32_t h = Hash::hash((uint64_t)k);
+        const Shard& s = this->shard_of(h);
+
+        for (unsigned int spins = 0; ; ++spins)
+        {
+            unsigned int seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+            if (seq & 1)
+            {
+                relax(spins);
+                continue;
+            }
+
+            const Table* t = __atomic_load_n(&s.table, __ATOMIC_ACQUIRE);
+            unsigned int idx = this->find_index(t, k, h);
+            bool found = idx < t->size;
+            Data value = found ? t->slot[idx].data : Data();
+
+            // if no writer got in while we were looking, what we saw was consistent
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s.seq, __ATOMIC_RELAXED) != seq) continue;
+
+            if (found) d = value;
+            return found;
+        }
+    }
+
+
+    // remove all elements from the hash
+    void clear()
+    {
+        for (unsigned int i = 0; i < this->m_shards; ++i)
+        {
+            Shard& s = this->m_shard[i];
+            ShardLock lock(s);
+
+            begin_write(s);
+            fill(s.table->slot, s.table->slot + s.table->size, Slot());
+            end_write(s);
+
+            __atomic_store_n(&s.count, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+
+    // free the sub-tables left over from growth.  only call this when no other thread can
+    //  be inside find() or has_key(), e.g. between rounds of the server's main loop
+    void reclaim()
+    {
+        for (unsigned int i = 0; i < this->m_shards; ++i)
+        {
+            Shard& s = this->m_shard[i];
+            ShardLock lock(s);
+
+            for (unsigned int j = 0; j < s.retired.size(); ++j)
+                delete s.retired[j];
+            s.retired.clear();
+        }
+    }
+
+
+  protected:
+
+    // a copy would share nothing sensible with the original; don't allow it
+    LinearHashConcurrent(const LinearHashConcurrent &rhs);
+    LinearHashConcurrent& operator=(const LinearHashConcurrent &rhs);
+
+
+    // the top bits of the hash choose the shard (any count of shards works)...
+    Shard& shard_of(uint32_t h) const
+    {
+        return this->m_shard[((uint64_t)h * this->m_shards) >> 32];
+    }
+
+
+    // ...and the bits below them choose the home slot in the shard's table.  (the bottom
+    //  bits would do, but for keys in one shard they are correlated with the top ones)
+    unsigned int home(const Table* t, uint32_t h) const
+    {
+        uint32_t below = (uint32_t)((uint64_t)h * this->m_shards);
+        return ((uint64_t)below * t->size) >> 32;
+    }
+
+
+    // spin politely while a writer finishes, yielding in case it has been preempted
+    static void relax(unsigned int spins)
+    {
+        if (spins < LINEAR_HASH_CONCURRENT_SPINS)
+        {
+#if defined(__SSE2__)
+            _mm_pause();
+#endif
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+
+    // a writer makes the sequence number odd before changing anything...
+    static void begin_write(Shard& s)
+    {
+        __atomic_store_n(&s.seq, s.seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+
+    // ...and even again once it is done
+    static void end_write(Shard& s)
+    {
+        __atomic_store_n(&s.seq, s.seq + 1, __ATOMIC_RELEASE);
+    }
+
+
+    // linear probing from the home slot; return the index of k, or the table
+    //  size if it isn't there.  bounded by the table size, so a reader that races a writer
+    //  still terminates (and then retries)
+    unsigned int find_index(const Table* t, Key k, uint32_t h) const
+    {
+        unsigned int mask = t->size - 1;
+
+        for (unsigned int i = 0, idx = this->home(t, h); i < t->size; ++i, idx = (idx + 1) & mask)
+        {
+            if (LINEAR_HASH_CONCURRENT_EMPTY == t->slot[idx].state) break;
+            if (k == t->slot[idx].key) return idx;
+        }
+
+        return t->size;
+    }
+
+
+    // insert or (if overwrite) update under the shard lock; return whether k was added
+    bool write(Key k, const Data& d, bool overwrite)
+    {
+        uint32_t h = Hash::hash((uint64_t)k);
+        Shard& s = this->shard_of(h);
+        ShardLock lock(s);
+
+        Table* t = s.table;
+        unsigned int idx = this->find_index(t, k, h);
+
+        if (idx < t->size)
+        {
+            if (overwrite)
+            {
+                begin_write(s);
+                t->slot[idx].data = d;
+                end_write(s);
+            }
+
+            return false;
+        }
+
+        // keep the table at most 3/4 full.  (if growing throws, nothing has changed)
+        if ((s.count + 1) * 4 > t->size * 3) t = this->grow(s);
+
+        // the first empty slot; k isn't in the table, so this is where it goes
+        unsigned int mask = t->size - 1;
+        idx = this->home(t, h);
+        while (LINEAR_HASH_CONCURRENT_FULL == t->slot[idx].state) idx = (idx + 1) & mask;
+
+        begin_write(s);
+        t->slot[idx].key = k;
+        t->slot[idx].data = d;
+        t->slot[idx].state = LINEAR_HASH_CONCURRENT_FULL;
+        end_write(s);
+
+        __atomic_store_n(&s.count, s.count + 1, __ATOMIC_RELAXED);
+
+        return true;
+    }
+
+
+    // empty a slot, moving later entries of its run back so that every key stays reachable
+    //  from its home slot without tombstones (backward-shift deletion).  entries move, so
+    //  this must be inside a write
+    void erase_index(Table* t, unsigned int idx) const
+    {
+        unsigned int mask = t->size - 1;
+
+        for (unsigned int next = (idx + 1) & mask;
+             LINEAR_HASH_CONCURRENT_FULL == t->slot[next].state;
+             next = (next + 1) & mask)
+        {
+            // an entry can fill the hole if the hole lies between its home and where it is
+            unsigned int home = this->home(t, Hash::hash((uint64_t)t->slot[next].key));
+            if (((next - home) & mask) >= ((next - idx) & mask))
+            {
+                t->slot[idx] = t->slot[next];
+                idx = next;
+            }
+        }
+
+        t->slot[idx] = Slot();
+    }
+
+
+    // copy a shard into a table twice the size.  readers carry on with the old table until
+    //  the new one is published, and the old one is kept until reclaim().  both allocations
+    //  come first, so a throw from either leaves the shard (and its lock) untouched
+    Table* grow(Shard& s)
+    {
+        Table* old = s.table;
+        s.retired.reserve(s.retired.size() + 1);
+        Table* t = new Table(old->size * 2);
+        unsigned int mask = t->size - 1;
+
+        for (unsigned int i = 0; i < old->size; ++i)
+        {
+            if (LINEAR_HASH_CONCURRENT_EMPTY == old->slot[i].state) continue;
+
+            unsigned int idx = this->home(t, Hash::hash((uint64_t)old->slot[i].key));
+            while (LINEAR_HASH_CONCURRENT_EMPTY != t->slot[idx].state) idx = (idx + 1) & mask;
+
+            t->slot[idx] = old->slot[i];
+        }
+
+        s.retired.push_back(old);  // reserved above, so it can't throw
+
+        begin_write(s);
+        __atomic_store_n(&s.table, t, __ATOMIC_RELEASE);
+        end_write(s);
+
+        return t;
+    }
+
+};
@@ -0,0 +1,433 @@
+
+#pragma once
+
+#include "LinearHash.h"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+
+// keys are split into a page number (high byte) and a slot within the page (low byte)
+#define LINEAR_HASH_DENSE_PAGE_BITS 8
+#define LINEAR_HASH_DENSE_PAGE_SIZE (1 << LINEAR_HASH_DENSE_PAGE_BITS)
+#define LINEAR_HASH_DENSE_PAGES     (1 << (16 - LINEAR_HASH_DENSE_PAGE_BITS))
+
+// 64-bit words in each page's occupancy bitmap
+#define LINEAR_HASH_DENSE_WORDS     (LINEAR_HASH_DENSE_PAGE_SIZE / 64)
+
+
+/**
+   Direct-indexed storage for LinearHash, for keys of 16 bits or less.
+
+   Variable ids, node addresses and client ids are small integers, so there is no need to
+   hash them at all: the key itself is the index.  The 64K possible keys are divided into
+   pages of 256 slots, and a page is only allocated once one of its keys is used (and freed
+   again when its last key is removed), so memory is proportional to the populated pages
+   rather than to the key space.
+
+   Each page keeps an occupancy bitmap.  Pages that have never been used point at a shared
+   empty page, so a lookup is two array reads and a bit test with no branches; iteration
+   skips over unoccupied slots 64 at a time.
+
+   This is the default storage for small key types (see LinearHashTraits); the interface
+   is the same as the chained version, except that iterators point at pair<Key, Data>.
+   Nothing is hashed, so the hash policy is ignored; the pages come from the global heap,
+   so the allocator is too.
+ */
+template <typename Key, typename Data, typename Hash, typename Alloc>
+class LinearHash<Key, Data, LinearHashDense, Hash, Alloc>
+{
+
+  public:
+    typedef pair<Key, Data> Slot;
+
+  protected:
+
+    struct Page
+    {
+        uint64_t occupied[LINEAR_HASH_DENSE_WORDS];
+        unsigned int count;
+        Slot slot[LINEAR_HASH_DENSE_PAGE_SIZE];
+
+        Page() : count(0)
+        {
+            fill(this->occupied, this->occupied + LINEAR_HASH_DENSE_WORDS, 0);
+        }
+    };
+
+    // directory of pages, indexed by the high byte of the key
+    Page* m_page[LINEAR_HASH_DENSE_PAGES];
+
+    // the number of occupied slots
+    unsigned int m_count;
+
+
+  public:
+
+    LinearHash()
+    {
+        this->init();
+    }
+
+
+    // the size is accepted for compatibility with the other storages, but not needed
+    LinearHash(unsigned int size, const Alloc& alloc = Alloc())
+    {
+        this->init();
+    }
+
+    LinearHash(const LinearHash &rhs)
+    {
+        this->init();
+        this->operator=(rhs);
+    }
+
+
+    // take over another table's pages, leaving it empty (and still usable)
+    LinearHash(LinearHash &&rhs)
+    {
+        this->init();
+        this->swap(rhs);
+    }
+
+
+    ~LinearHash()
+    {
+        this->clear();
+    }
+
+
+    LinearHash& operator=(const LinearHash &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->clear();
+        for (unsigned int p = 0; p < LINEAR_HASH_DENSE_PAGES; ++p)
+            if (rhs.m_page[p] != empty_page())
+                this->m_page[p] = new Page(*rhs.m_page[p]);
+
+        this->m_count = rhs.m_count;
+
+        return *this;
+    }
+
+
+    LinearHash& operator=(LinearHash &&rhs)
+    {
+        if (this != &rhs)
+        {
+            this->clear();
+            this->swap(rhs);
+        }
+        return *this;
+    }
+
+
+    // exchange contents with another table, without copying any elements
+    void swap(LinearHash &rhs)
+    {
+        for (unsigned int p = 0; p < LINEAR_HASH_DENSE_PAGES; ++p)
+            std::swap(this->m_page[p], rhs.m_page[p]);
+        std::swap(this->m_count, rhs.m_count);
+    }
+
+
+    // remove all elements; the size is ignored since every key already has a slot
+    void resize(unsigned int size)
+    {
+        if (!size)
+        {
+            throw string("Tried to set hash size to 0");
+        }
+
+        this->clear();
+    }
+
+
+    // remove all elements (the names match the chained version)
+    void resize_nearest_prime(unsigned int desired_size)
+    {
+        this->resize(desired_size + 1);
+    }
+
+    void resize_power_of_two(unsigned int desired_size)
+    {
+        this->resize(desired_size + 1);
+    }
+
+
+    // return the size of the hash table: the number of keys that can be addressed
+    unsigned int get_size() const
+    {
+        return 1u << (8 * (sizeof(Key) < 2 ? sizeof(Key) : 2));
+    }
+
+
+    // return the number of elements in the hash table
+    unsigned int count() const
+    {
+        return this->m_count;
+    }
+
+
+    // return whether the table is empty
+    bool empty() const
+    {
+        return 0 == this->m_count;
+    }
+
+
+    // there are never any collisions
+    unsigned int max_collisions() const
+    {
+        return this->m_count ? 1 : 0;
+    }
+
+    double mean_collisions() const
+    {
+        return this->m_count ? 1 : 0;
+    }
+
+
+    // explicitly insert an element into the hash (pass an rvalue to have it moved in)
+    void insert(Key k, Data d)
+    {
+        pair<iterator, bool> r = this->try_emplace(k, std::move(d));
+        if (!r.second) r.first->second = std::move(d);
+    }
+
+
+    // explicitly remove a key from the hash
+    void remove(Key k)
+    {
+        unsigned int idx = index(k);
+        if (occupied(this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS], idx)) this->erase_index(idx);
+    }
+
+
+    // check existence of a hashed value
+    bool has_key(Key k) const
+    {
+        unsigned int idx = index(k);
+        return occupied(this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS], idx);
+    }
+
+
+    // read-only access (like the chained version, this adds the key if it is missing)
+    Data& operator[] (Key k) const
+    {
+        return const_cast<LinearHash*>(this)->operator[](k);
+    }
+
+
+    // array-style access to the hash
+    Data& operator[] (Key k)
+    {
+        return this->try_emplace(k).first->second;
+    }
+
+
+    // remove all elements from the hash, freeing every page
+    void clear()
+    {
+        for (unsigned int p = 0; p < LINEAR_HASH_DENSE_PAGES; ++p)
+        {
+            if (this->m_page[p] != empty_page()) delete this->m_page[p];
+            this->m_page[p] = empty_page();
+        }
+        this->m_count = 0;
+    }
+
+
+    class iterator : public std::iterator<std::input_iterator_tag, pair<Key, Data> >
+    {
+        friend class LinearHash;
+
+        const LinearHash* h;
+        unsigned int idx;
+
+      public:
+
+        iterator() {}
+
+        iterator(const LinearHash* const h, unsigned int idx)
+        {
+            this->h = h;
+            this->idx = idx;
+        }
+
+        iterator& operator++()
+        {
+            this->idx = this->h->next_occupied(this->idx + 1);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            this->operator++();
+            return tmp;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return rhs.h == this->h && rhs.idx == this->idx;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return rhs.h != this->h || rhs.idx != this->idx;
+        }
+
+        Slot& operator*() { return this->h->slot(this->idx); }
+
+        Slot* operator->() { return &(this->h->slot(this->idx)); }
+
+    };
+
+    // what a const table iterates with; begin() and end() are const already
+    typedef iterator const_iterator;
+
+    // iteration points: begin
+    iterator begin() const
+    {
+        return iterator(this, this->next_occupied(0));
+    }
+
+    // iteration points: end
+    iterator end() const
+    {
+        return iterator(this, LINEAR_HASH_DENSE_PAGES * LINEAR_HASH_DENSE_PAGE_SIZE);
+    }
+
+
+    // find a key, returning end() if it isn't there
+    iterator find(Key k) const
+    {
+        unsigned int idx = index(k);
+        if (occupied(this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS], idx)) return iterator(this, idx);
+        return this->end();
+    }
+
+
+    // unless the key is already there, add it with a value constructed from args (and then
+    //  moved into its slot); either way, return where it is and whether it was added
+    template <typename... Args>
+    pair<iterator, bool> try_emplace(Key k, Args&&... args)
+    {
+        unsigned int idx = index(k);
+        Page* &page = this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS];
+
+        if (occupied(page, idx)) return make_pair(iterator(this, idx), false);
+
+        if (page == empty_page()) page = new Page();
+
+        page->occupied[(idx % LINEAR_HASH_DENSE_PAGE_SIZE) / 64] |= 1ull << (idx % 64);
+        ++(page->count);
+        ++(this->m_count);
+
+        page->slot[idx % LINEAR_HASH_DENSE_PAGE_SIZE] = Slot(k, Data(std::forward<Args>(args)...));
+        return make_pair(iterator(this, idx), true);
+    }
+
+
+    // the standard library's name for the same thing
+    template <typename... Args>
+    pair<iterator, bool> emplace(Key k, Args&&... args)
+    {
+        return this->try_emplace(k, std::forward<Args>(args)...);
+    }
+
+
+    // remove the element at an iterator (found with find or try_emplace)
+    void erase(iterator it)
+    {
+        this->erase_index(it.idx);
+    }
+
+
+  protected:
+
+    // the one page that unpopulated directory entries point to; it is never written
+    static Page* empty_page()
+    {
+        static Page empty;
+        return &empty;
+    }
+
+
+    void init()
+    {
+        fill(this->m_page, this->m_page + LINEAR_HASH_DENSE_PAGES, empty_page());
+        this->m_count = 0;
+    }
+
+
+    // the key is the index (signed keys wrap around to the top of the range)
+    static unsigned int index(Key k)
+    {
+        return (uint16_t)k;
+    }
+
+
+    // test the occupancy bit for an index on its page
+    static bool occupied(const Page* page, unsigned int idx)
+    {
+        return (page->occupied[(idx % LINEAR_HASH_DENSE_PAGE_SIZE) / 64] >> (idx % 64)) & 1;
+    }
+
+
+    // empty an occupied slot, giving its page back as soon as the page is unused
+    void erase_index(unsigned int idx)
+    {
+        Page* &page = this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS];
+
+        if (0 == --(page->count))
+        {
+            delete page;
+            page = empty_page();
+        }
+        else
+        {
+            page->occupied[(idx % LINEAR_HASH_DENSE_PAGE_SIZE) / 64] &= ~(1ull << (idx % 64));
+            page->slot[idx % LINEAR_HASH_DENSE_PAGE_SIZE].second = Data();
+        }
+
+        --(this->m_count);
+    }
+
+
+    Slot& slot(unsigned int idx) const
+    {
+        return this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS]->slot[idx % LINEAR_HASH_DENSE_PAGE_SIZE];
+    }
+
+
+    // the first occupied index at or after idx, or the end index
+    unsigned int next_occupied(unsigned int idx) const
+    {
+        const unsigned int end = LINEAR_HASH_DENSE_PAGES * LINEAR_HASH_DENSE_PAGE_SIZE;
+
+        while (idx < end)
+        {
+            const Page* page = this->m_page[idx >> LINEAR_HASH_DENSE_PAGE_BITS];
+            if (page == empty_page())
+            {
+                // skip to the start of the next page
+                idx = (idx | (LINEAR_HASH_DENSE_PAGE_SIZE - 1)) + 1;
+                continue;
+            }
+
+            // remaining bits in this word, then count trailing zeros to find the next one
+            uint64_t word = page->occupied[(idx % LINEAR_HASH_DENSE_PAGE_SIZE) / 64] >> (idx % 64);
+            if (word) return idx + __builtin_ctzll(word);
+
+            idx = (idx | 63) + 1;
+        }
+
+        return end;
+    }
+
+};
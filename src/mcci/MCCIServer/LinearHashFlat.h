@@ -0,0 +1,480 @@
+
+#pragma once
+
+#include "LinearHash.h"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+
+// a probe sequence this long means the table is pathologically clustered; grow instead
+#define LINEAR_HASH_FLAT_MAX_DISTANCE 255
+
+// smallest number of slots we will allocate
+#define LINEAR_HASH_FLAT_MIN_SIZE 8
+
+
+/**
+   Open-addressing storage for LinearHash.
+
+   All entries live in one contiguous array of slots, placed with robin hood linear
+   probing and removed with backward shifting (so there are no tombstones).  Nothing is
+   allocated per element, and a lookup usually touches a single cache line.
+
+   The number of slots is a power of 2.  A key's home slot is found by scaling its 32-bit
+   hash code onto the table (Lemire's fastrange: a multiply and a shift, no division), so
+   the high bits of the hash choose the slot.  That needs a mixing hash, so the default is
+   multiplicative (Fibonacci) hashing rather than f(i) = i; contiguous and strided integer
+   keys would otherwise pile up in neighbouring slots.  The table doubles itself when it
+   gets 7/8 full.
+
+   Select it with LinearHash<Key, Data, LinearHashFlat>; the interface is the same as
+   the chained version, except that iterators point at pair<Key, Data>.  The slots are
+   allocated as one array from the global heap, so the allocator is ignored.
+ */
+template <typename Key, typename Data, typename Hash, typename Alloc>
+class LinearHash<Key, Data, LinearHashFlat, Hash, Alloc>
+{
+
+  public:
+    typedef pair<Key, Data> Slot;
+
+  protected:
+
+    // internal storage is an array of slots, with a parallel array of probe distances
+    Slot* m_slot;
+    unsigned char* m_distance; // 0 means vacant, otherwise 1 + distance from the home slot
+
+    // the number of slots (a power of 2)
+    unsigned int m_size;
+
+    // the number of occupied slots
+    unsigned int m_count;
+
+
+  public:
+
+    LinearHash()
+    {
+        this->m_size = 0;
+        this->resize(LINEAR_HASH_FLAT_MIN_SIZE);
+    }
+
+
+    LinearHash(unsigned int size, const Alloc& alloc = Alloc())
+    {
+        this->m_size = 0;
+        this->resize_nearest_prime(size);
+    }
+
+    LinearHash(const LinearHash &rhs)
+    {
+        this->m_size = 0;
+        this->operator=(rhs);
+    }
+
+
+    // take over another table's arrays, leaving it with none (it may then only be
+    //  destroyed, assigned to, or resized)
+    LinearHash(LinearHash &&rhs)
+    {
+        this->m_size = 0;
+        this->m_count = 0;
+        this->swap(rhs);
+    }
+
+
+    ~LinearHash()
+    {
+        if (this->m_size)
+        {
+            delete[] this->m_slot;
+            delete[] this->m_distance;
+        }
+    }
+
+
+    LinearHash& operator=(const LinearHash &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->resize(rhs.m_size);
+        copy(rhs.m_slot, rhs.m_slot + rhs.m_size, this->m_slot);
+        copy(rhs.m_distance, rhs.m_distance + rhs.m_size, this->m_distance);
+        this->m_count = rhs.m_count;
+
+        return *this;
+    }
+
+
+    LinearHash& operator=(LinearHash &&rhs)
+    {
+        if (this != &rhs)
+        {
+            LinearHash tmp(std::move(rhs));
+            this->swap(tmp);
+        }
+        return *this;
+    }
+
+
+    // exchange contents with another table, without copying any elements
+    void swap(LinearHash &rhs)
+    {
+        std::swap(this->m_slot, rhs.m_slot);
+        std::swap(this->m_distance, rhs.m_distance);
+        std::swap(this->m_size, rhs.m_size);
+        std::swap(this->m_count, rhs.m_count);
+    }
+
+
+    //resize, destructively, to hold the given number of slots (rounded up to a power of 2)
+    void resize(unsigned int size)
+    {
+        if (!size)
+        {
+            throw string("Tried to set hash size to 0");
+        }
+
+        if (this->m_size)
+        {
+            delete[] this->m_slot;
+            delete[] this->m_distance;
+            this->m_size = 0;
+        }
+
+        unsigned int slots = LINEAR_HASH_FLAT_MIN_SIZE;
+        while (slots < size) slots <<= 1;
+
+        // only record the size once the arrays exist, so a failed allocation leaves us empty
+        this->m_slot = new Slot[slots]();
+        this->m_distance = new unsigned char[slots]();
+        this->m_size = slots;
+        this->m_count = 0;
+    }
+
+
+    // resize, destructively, to the smallest power of 2 that holds the desired storage
+    //  (which every resize does; the name matches the chained version)
+    void resize_power_of_two(unsigned int desired_size)
+    {
+        this->resize(desired_size);
+    }
+
+
+    // resize, destructively, to hold the desired number of elements without growing
+    //  (there are no primes involved; the name matches the chained version)
+    void resize_nearest_prime(unsigned int desired_size)
+    {
+        this->resize(desired_size + desired_size / 7 + 1);
+    }
+
+
+    // return the size of the hash table
+    unsigned int get_size() const
+    {
+        return this->m_size;
+    }
+
+
+    // return the number of elements in the hash table
+    unsigned int count() const
+    {
+        return this->m_count;
+    }
+
+
+    // return whether the table is empty
+    bool empty() const
+    {
+        return 0 == this->m_count;
+    }
+
+    // get the longest probe sequence needed to find any key
+    unsigned int max_collisions() const
+    {
+        unsigned int max = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (max < this->m_distance[i])
+                max = this->m_distance[i];
+
+        return max;
+    }
+
+
+    // get the average probe sequence needed to find a key (1 is perfect)
+    double mean_collisions() const
+    {
+        double sum = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            sum += this->m_distance[i];
+
+        return this->m_count ? sum / this->m_count : 0;
+    }
+
+
+    // explicitly insert an element into the hash (pass an rvalue to have it moved in)
+    void insert(Key k, Data d)
+    {
+        pair<iterator, bool> r = this->try_emplace(k, std::move(d));
+        if (!r.second) r.first->second = std::move(d);
+    }
+
+
+    // explicitly remove a key from the hash
+    void remove(Key k)
+    {
+        unsigned int idx = this->find_index(k);
+        if (idx < this->m_size) this->erase_index(idx);
+    }
+
+
+    // check existence of a hashed value
+    bool has_key(Key k) const
+    {
+        return this->find_index(k) < this->m_size;
+    }
+
+
+    // read-only access (like the chained version, this adds the key if it is missing)
+    Data& operator[] (Key k) const
+    {
+        return const_cast<LinearHash*>(this)->operator[](k);
+    }
+
+
+    // array-style access to the hash
+    Data& operator[] (Key k)
+    {
+        return this->try_emplace(k).first->second;
+    }
+
+
+    // remove all elements from the hash
+    void clear()
+    {
+        for (unsigned int i = 0; i < this->m_size; ++i)
+        {
+            if (this->m_distance[i]) this->m_slot[i] = Slot();
+            this->m_distance[i] = 0;
+        }
+        this->m_count = 0;
+    }
+
+
+    class iterator : public std::iterator<std::input_iterator_tag, pair<Key, Data> >
+    {
+        friend class LinearHash;
+
+        const LinearHash* h;
+        unsigned int idx;
+
+      public:
+
+        iterator() {}
+
+        iterator(const LinearHash* const h, unsigned int idx)
+        {
+            this->h = h;
+            this->idx = idx;
+        }
+
+        iterator& operator++()
+        {
+            // jump to next occupied slot, or to end
+            for (++(this->idx); this->idx < this->h->m_size; ++(this->idx))
+                if (this->h->m_distance[this->idx]) break;
+
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            this->operator++();
+            return tmp;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return rhs.h == this->h && rhs.idx == this->idx;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return rhs.h != this->h || rhs.idx != this->idx;
+        }
+
+        Slot& operator*() { return this->h->m_slot[this->idx]; }
+
+        Slot* operator->() { return &(this->h->m_slot[this->idx]); }
+
+    };
+
+    // what a const table iterates with; begin() and end() are const already
+    typedef iterator const_iterator;
+
+    // iteration points: begin
+    iterator begin() const
+    {
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (this->m_distance[i])
+                return iterator(this, i);
+
+        return this->end();
+    }
+
+    // iteration points: end
+    iterator end() const
+    {
+        return iterator(this, this->m_size);
+    }
+
+
+    // find a key, returning end() if it isn't there
+    iterator find(Key k) const
+    {
+        return iterator(this, this->find_index(k));
+    }
+
+
+    // unless the key is already there, add it with a value constructed from args (and then
+    //  moved into its slot); either way, return where it is and whether it was added.
+    //  adding may move other elements
+    template <typename... Args>
+    pair<iterator, bool> try_emplace(Key k, Args&&... args)
+    {
+        unsigned int idx = this->find_index(k);
+        if (idx < this->m_size) return make_pair(iterator(this, idx), false);
+
+        if ((this->m_count + 1) * 8 > this->m_size * 7) this->grow();
+
+        ++(this->m_count);
+        // may grow the table, so don't build the iterator first
+        idx = this->place(Slot(k, Data(std::forward<Args>(args)...)));
+        return make_pair(iterator(this, idx), true);
+    }
+
+
+    // the standard library's name for the same thing
+    template <typename... Args>
+    pair<iterator, bool> emplace(Key k, Args&&... args)
+    {
+        return this->try_emplace(k, std::forward<Args>(args)...);
+    }
+
+
+    // remove the element at an iterator (found with find or try_emplace); this shifts its
+    //  neighbours, so other iterators are invalidated
+    void erase(iterator it)
+    {
+        this->erase_index(it.idx);
+    }
+
+
+  protected:
+
+    // the slot where a key would be placed in an uncrowded table
+    unsigned int home(Key k) const
+    {
+        return (unsigned int)(((uint64_t)Hash::hash(k) * this->m_size) >> 32);
+    }
+
+
+    // the slot holding a key, or m_size if it isn't there
+    unsigned int find_index(Key k) const
+    {
+        unsigned int mask = this->m_size - 1;
+        unsigned int idx = this->home(k);
+
+        // robin hood invariant: once we pass a slot closer to home than we are, k isn't here
+        for (unsigned int dist = 1; dist <= this->m_distance[idx]; ++dist)
+        {
+            if (dist == this->m_distance[idx] && k == this->m_slot[idx].first) return idx;
+            idx = (idx + 1) & mask;
+        }
+
+        return this->m_size;
+    }
+
+
+    // robin hood insertion of a key that is known to be absent; returns the slot it landed in
+    unsigned int place(Slot carry)
+    {
+        Key k = carry.first;
+        unsigned int mask = this->m_size - 1;
+        unsigned int landed = this->m_size;
+        unsigned char dist = 1;
+
+        for (unsigned int idx = this->home(k); ; idx = (idx + 1) & mask, ++dist)
+        {
+            if (LINEAR_HASH_FLAT_MAX_DISTANCE == dist)
+            {
+                // pathological clustering: spread everything out, then finish the job
+                this->grow();
+                this->place(std::move(carry));
+                return this->find_index(k);
+            }
+
+            if (0 == this->m_distance[idx])
+            {
+                this->m_slot[idx] = std::move(carry);
+                this->m_distance[idx] = dist;
+                return landed < this->m_size ? landed : idx;
+            }
+
+            // steal from the rich: displace any resident that is closer to its home than we are
+            if (this->m_distance[idx] < dist)
+            {
+                std::swap(carry, this->m_slot[idx]);
+                std::swap(dist, this->m_distance[idx]);
+                if (landed == this->m_size) landed = idx;
+            }
+        }
+    }
+
+
+    // remove an occupied slot, shifting its successors back toward their home slots
+    void erase_index(unsigned int idx)
+    {
+        unsigned int mask = this->m_size - 1;
+        unsigned int next = (idx + 1) & mask;
+
+        while (1 < this->m_distance[next])
+        {
+            this->m_slot[idx] = std::move(this->m_slot[next]);
+            this->m_distance[idx] = this->m_distance[next] - 1;
+            idx = next;
+            next = (next + 1) & mask;
+        }
+
+        this->m_slot[idx] = Slot();
+        this->m_distance[idx] = 0;
+        --(this->m_count);
+    }
+
+
+    // double the number of slots, keeping the contents
+    void grow()
+    {
+        Slot* old_slot = this->m_slot;
+        unsigned char* old_distance = this->m_distance;
+        unsigned int old_size = this->m_size;
+        unsigned int old_count = this->m_count;
+
+        this->m_size = 0; // so that resize doesn't free the old arrays
+        this->resize(old_size * 2);
+        this->m_count = old_count;
+
+        for (unsigned int i = 0; i < old_size; ++i)
+            if (old_distance[i]) this->place(std::move(old_slot[i]));
+
+        delete[] old_slot;
+        delete[] old_distance;
+    }
+
+};
@@ -0,0 +1,575 @@
+
+#pragma once
+
+#include "LinearHash.h"
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+// slots are probed a group at a time; a group's control bytes fit in one SSE2 register
+#define LINEAR_HASH_GROUP_WIDTH 16
+
+// smallest number of slots we will allocate (one group)
+#define LINEAR_HASH_GROUP_MIN_SIZE LINEAR_HASH_GROUP_WIDTH
+
+// control byte values; a full slot holds the low 7 bits of its key's hash (high bit clear)
+#define LINEAR_HASH_GROUP_EMPTY   ((signed char)0x80)
+#define LINEAR_HASH_GROUP_DELETED ((signed char)0xFE)
+
+
+/**
+   Group-probing ("Swiss table") storage for LinearHash.
+
+   Entries live in one contiguous array of slots, divided into groups of 16.  Alongside
+   it is an array of control bytes, one per slot: empty, deleted, or 7 bits of the key's
+   hash.  A lookup picks a group from the hash, compares all 16 control bytes against
+   the key's 7 bits at once, and only looks at the (rare) slots that match.  If the
+   group has an empty slot the search stops there, so most misses cost one comparison
+   and touch no slots at all.  Full groups overflow to further groups in triangular
+   order, which visits every group of a power-of-2 table.
+
+   The comparisons use SSE2 where the compiler says it is available (always, on x86-64),
+   and a plain loop over the bytes otherwise.
+
+   Removal leaves a tombstone unless the group still has an empty slot (in which case no
+   search can have passed through it).  The table is rebuilt, dropping tombstones and
+   doubling if it is more than half full, once it is 7/8 used.
+
+   Select it with LinearHash<Key, Data, LinearHashGroup>; the interface is the same as
+   the chained version, except that iterators point at pair<Key, Data>.  The slots are
+   allocated as one array from the global heap, so the allocator is ignored.
+ */
+template <typename Key, typename Data, typename Hash, typename Alloc>
+class LinearHash<Key, Data, LinearHashGroup, Hash, Alloc>
+{
+
+  public:
+    typedef pair<Key, Data> Slot;
+
+  protected:
+
+    // internal storage is an array of slots, with a parallel array of control bytes
+    Slot* m_slot;
+    signed char* m_control;
+
+    // the number of slots (a power of 2, at least one group)
+    unsigned int m_size;
+
+    // the number of full slots, and of tombstones
+    unsigned int m_count;
+    unsigned int m_deleted;
+
+
+  public:
+
+    LinearHash()
+    {
+        this->m_size = 0;
+        this->resize(LINEAR_HASH_GROUP_MIN_SIZE);
+    }
+
+
+    LinearHash(unsigned int size, const Alloc& alloc = Alloc())
+    {
+        this->m_size = 0;
+        this->resize_nearest_prime(size);
+    }
+
+    LinearHash(const LinearHash &rhs)
+    {
+        this->m_size = 0;
+        this->operator=(rhs);
+    }
+
+
+    // take over another table's arrays, leaving it with none (it may then only be
+    //  destroyed, assigned to, or resized)
+    LinearHash(LinearHash &&rhs)
+    {
+        this->m_size = 0;
+        this->m_count = 0;
+        this->m_deleted = 0;
+        this->swap(rhs);
+    }
+
+
+    ~LinearHash()
+    {
+        if (this->m_size)
+        {
+            delete[] this->m_slot;
+            delete[] this->m_control;
+        }
+    }
+
+
+    LinearHash& operator=(const LinearHash &rhs)
+    {
+        if (this == &rhs) return *this;
+
+        this->resize(rhs.m_size);
+        copy(rhs.m_slot, rhs.m_slot + rhs.m_size, this->m_slot);
+        copy(rhs.m_control, rhs.m_control + rhs.m_size, this->m_control);
+        this->m_count = rhs.m_count;
+        this->m_deleted = rhs.m_deleted;
+
+        return *this;
+    }
+
+
+    LinearHash& operator=(LinearHash &&rhs)
+    {
+        if (this != &rhs)
+        {
+            LinearHash tmp(std::move(rhs));
+            this->swap(tmp);
+        }
+        return *this;
+    }
+
+
+    // exchange contents with another table, without copying any elements
+    void swap(LinearHash &rhs)
+    {
+        std::swap(this->m_slot, rhs.m_slot);
+        std::swap(this->m_control, rhs.m_control);
+        std::swap(this->m_size, rhs.m_size);
+        std::swap(this->m_count, rhs.m_count);
+        std::swap(this->m_deleted, rhs.m_deleted);
+    }
+
+
+    //resize, destructively, to hold the given number of slots (rounded up to a power of 2)
+    void resize(unsigned int size)
+    {
+        if (!size)
+        {
+            throw string("Tried to set hash size to 0");
+        }
+
+        if (this->m_size)
+        {
+            delete[] this->m_slot;
+            delete[] this->m_control;
+            this->m_size = 0;
+        }
+
+        unsigned int slots = LINEAR_HASH_GROUP_MIN_SIZE;
+        while (slots < size) slots <<= 1;
+
+        // only record the size once the arrays exist, so a failed allocation leaves us empty
+        this->m_slot = new Slot[slots]();
+        this->m_control = new signed char[slots];
+        fill(this->m_control, this->m_control + slots, LINEAR_HASH_GROUP_EMPTY);
+        this->m_size = slots;
+        this->m_count = 0;
+        this->m_deleted = 0;
+    }
+
+
+    // resize, destructively, to the smallest power of 2 that holds the desired storage
+    //  (which every resize does; the name matches the chained version)
+    void resize_power_of_two(unsigned int desired_size)
+    {
+        this->resize(desired_size);
+    }
+
+
+    // resize, destructively, to hold the desired number of elements without growing
+    //  (there are no primes involved; the name matches the chained version)
+    void resize_nearest_prime(unsigned int desired_size)
+    {
+        this->resize(desired_size + desired_size / 7 + 1);
+    }
+
+
+    // return the size of the hash table
+    unsigned int get_size() const
+    {
+        return this->m_size;
+    }
+
+
+    // return the number of elements in the hash table
+    unsigned int count() const
+    {
+        return this->m_count;
+    }
+
+
+    // return whether the table is empty
+    bool empty() const
+    {
+        return 0 == this->m_count;
+    }
+
+
+    // get the most groups that must be searched to find any key
+    unsigned int max_collisions() const
+    {
+        unsigned int max = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (0 <= this->m_control[i] && max < this->probes(i))
+                max = this->probes(i);
+
+        return max;
+    }
+
+
+    // get the average number of groups searched to find a key (1 is perfect)
+    double mean_collisions() const
+    {
+        double sum = 0;
+
+        for (unsigned int i = 0; i < this->m_size; ++i)
+            if (0 <= this->m_control[i])
+                sum += this->probes(i);
+
+        return this->m_count ? sum / this->m_count : 0;
+    }
+
+
+    // explicitly insert an element into the hash (pass an rvalue to have it moved in)
+    void insert(Key k, Data d)
+    {
+        pair<iterator, bool> r = this->try_emplace(k, std::move(d));
+        if (!r.second) r.first->second = std::move(d);
+    }
+
+
+    // explicitly remove a key from the hash
+    void remove(Key k)
+    {
+        unsigned int idx = this->find_index(k);
+        if (idx < this->m_size) this->erase_index(idx);
+    }
+
+
+    // check existence of a hashed value
+    bool has_key(Key k) const
+    {
+        return this->find_index(k) < this->m_size;
+    }
+
+
+    // read-only access (like the chained version, this adds the key if it is missing)
+    Data& operator[] (Key k) const
+    {
+        return const_cast<LinearHash*>(this)->operator[](k);
+    }
+
+
+    // array-style access to the hash
+    Data& operator[] (Key k)
+    {
+        return this->try_emplace(k).first->second;
+    }
+
+
+    // remove all elements from the hash
+    void clear()
+    {
+        for (unsigned int i = 0; i < this->m_size; ++i)
+        {
+            if (0 <= this->m_control[i]) this->m_slot[i] = Slot();
+            this->m_control[i] = LINEAR_HASH_GROUP_EMPTY;
+        }
+        this->m_count = 0;
+        this->m_deleted = 0;
+    }
+
+
+    class iterator : public std::iterator<std::input_iterator_tag, pair<Key, Data> >
+    {
+        friend class LinearHash;
+
+        const LinearHash* h;
+        unsigned int idx;
+
+      public:
+
+        iterator() {}
+
+        iterator(const LinearHash* const h, unsigned int idx)
+        {
+            this->h = h;
+            this->idx = idx;
+        }
+
+        iterator& operator++()
+        {
+            this->idx = this->h->next_full(this->idx + 1);
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            this->operator++();
+            return tmp;
+        }
+
+        bool operator==(const iterator& rhs) const
+        {
+            return rhs.h == this->h && rhs.idx == this->idx;
+        }
+
+        bool operator!=(const iterator& rhs) const
+        {
+            return rhs.h != this->h || rhs.idx != this->idx;
+        }
+
+        Slot& operator*() { return this->h->m_slot[this->idx]; }
+
+        Slot* operator->() { return &(this->h->m_slot[this->idx]); }
+
+    };
+
+    // what a const table iterates with; begin() and end() are const already
+    typedef iterator const_iterator;
+
+    // iteration points: begin
+    iterator begin() const
+    {
+        return iterator(this, this->next_full(0));
+    }
+
+    // iteration points: end
+    iterator end() const
+    {
+        return iterator(this, this->m_size);
+    }
+
+
+    // find a key, returning end() if it isn't there
+    iterator find(Key k) const
+    {
+        return iterator(this, this->find_index(k));
+    }
+
+
+    // unless the key is already there, add it with a value constructed from args (and then
+    //  moved into its slot); either way, return where it is and whether it was added.
+    //  adding may move other elements
+    template <typename... Args>
+    pair<iterator, bool> try_emplace(Key k, Args&&... args)
+    {
+        unsigned int idx = this->find_index(k);
+        if (idx < this->m_size) return make_pair(iterator(this, idx), false);
+
+        if ((this->m_count + this->m_deleted + 1) * 8 > this->m_size * 7) this->rehash();
+
+        idx = this->free_index(k);
+        if (LINEAR_HASH_GROUP_DELETED == this->m_control[idx]) --(this->m_deleted);
+
+        this->m_control[idx] = fingerprint(Hash::hash(k));
+        this->m_slot[idx] = Slot(k, Data(std::forward<Args>(args)...));
+        ++(this->m_count);
+        return make_pair(iterator(this, idx), true);
+    }
+
+
+    // the standard library's name for the same thing
+    template <typename... Args>
+    pair<iterator, bool> emplace(Key k, Args&&... args)
+    {
+        return this->try_emplace(k, std::forward<Args>(args)...);
+    }
+
+
+    // remove the element at an iterator (found with find or try_emplace)
+    void erase(iterator it)
+    {
+        this->erase_index(it.idx);
+    }
+
+
+  protected:
+
+    // the 7 bits of a hash code kept in a full slot's control byte
+    static signed char fingerprint(uint32_t h)
+    {
+        return (signed char)(h & 0x7F);
+    }
+
+
+    // the group where a search for a hash code starts: its high bits, scaled to the table
+    unsigned int home_group(uint32_t h) const
+    {
+        return (unsigned int)(((uint64_t)h * (this->m_size / LINEAR_HASH_GROUP_WIDTH)) >> 32);
+    }
+
+
+    // the control bytes of one group, loaded once for all the comparisons a search makes
+    class Group
+    {
+#if defined(__SSE2__)
+        __m128i ctrl;
+
+      public:
+        Group(const signed char* p) : ctrl(_mm_loadu_si128((const __m128i*)p)) {}
+
+        // bit i is set if control byte i equals c
+        unsigned int match(signed char c) const
+        {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(this->ctrl, _mm_set1_epi8(c)));
+        }
+
+        // bit i is set if slot i is empty or deleted (the only bytes with the high bit set)
+        unsigned int match_free() const
+        {
+            return _mm_movemask_epi8(this->ctrl);
+        }
+#else
+        const signed char* ctrl;
+
+      public:
+        Group(const signed char* p) : ctrl(p) {}
+
+        unsigned int match(signed char c) const
+        {
+            unsigned int mask = 0;
+            for (unsigned int i = 0; i < LINEAR_HASH_GROUP_WIDTH; ++i)
+                if (c == this->ctrl[i]) mask |= 1u << i;
+            return mask;
+        }
+
+        unsigned int match_free() const
+        {
+            unsigned int mask = 0;
+            for (unsigned int i = 0; i < LINEAR_HASH_GROUP_WIDTH; ++i)
+                if (this->ctrl[i] < 0) mask |= 1u << i;
+            return mask;
+        }
+#endif
+    };
+
+
+    // the slot holding a key, or m_size if it isn't there
+    unsigned int find_index(Key k) const
+    {
+        uint32_t h = Hash::hash(k);
+        signed char fp = fingerprint(h);
+        unsigned int groups = this->m_size / LINEAR_HASH_GROUP_WIDTH;
+        unsigned int g = this->home_group(h);
+
+        for (unsigned int step = 1; step <= groups; ++step)
+        {
+            unsigned int base = g * LINEAR_HASH_GROUP_WIDTH;
+            Group group(this->m_control + base);
+
+            for (unsigned int m = group.match(fp); m; m &= m - 1)
+            {
+                unsigned int idx = base + __builtin_ctz(m);
+                if (k == this->m_slot[idx].first) return idx;
+            }
+
+            // a key is never placed beyond a group that had room for it
+            if (group.match(LINEAR_HASH_GROUP_EMPTY)) break;
+
+            g = (g + step) & (groups - 1);
+        }
+
+        return this->m_size;
+    }
+
+
+    // the first empty or deleted slot on a key's search path (there must be one)
+    unsigned int free_index(Key k) const
+    {
+        unsigned int groups = this->m_size / LINEAR_HASH_GROUP_WIDTH;
+        unsigned int g = this->home_group(Hash::hash(k));
+
+        for (unsigned int step = 1; ; ++step)
+        {
+            unsigned int m = Group(this->m_control + g * LINEAR_HASH_GROUP_WIDTH).match_free();
+            if (m) return g * LINEAR_HASH_GROUP_WIDTH + __builtin_ctz(m);
+
+            g = (g + step) & (groups - 1);
+        }
+    }
+
+
+    // how many groups are searched to find the key in a full slot
+    unsigned int probes(unsigned int idx) const
+    {
+        unsigned int groups = this->m_size / LINEAR_HASH_GROUP_WIDTH;
+        unsigned int g = this->home_group(Hash::hash(this->m_slot[idx].first));
+        unsigned int step = 1;
+
+        for (; g != idx / LINEAR_HASH_GROUP_WIDTH; ++step)
+            g = (g + step) & (groups - 1);
+
+        return step;
+    }
+
+
+    // the first full slot at or after idx, or m_size if there are none
+    unsigned int next_full(unsigned int idx) const
+    {
+        for (unsigned int base = idx & ~(LINEAR_HASH_GROUP_WIDTH - 1); base < this->m_size;
+             base += LINEAR_HASH_GROUP_WIDTH)
+        {
+            unsigned int full = ~Group(this->m_control + base).match_free() & 0xFFFF;
+            if (base < idx) full &= ~0u << (idx - base);
+            if (full) return base + __builtin_ctz(full);
+        }
+
+        return this->m_size;
+    }
+
+
+    // empty a full slot, leaving a tombstone if a search may have passed through its group
+    void erase_index(unsigned int idx)
+    {
+        unsigned int base = idx & ~(LINEAR_HASH_GROUP_WIDTH - 1);
+
+        if (Group(this->m_control + base).match(LINEAR_HASH_GROUP_EMPTY))
+        {
+            this->m_control[idx] = LINEAR_HASH_GROUP_EMPTY;
+        }
+        else
+        {
+            this->m_control[idx] = LINEAR_HASH_GROUP_DELETED;
+            ++(this->m_deleted);
+        }
+
+        this->m_slot[idx] = Slot();
+        --(this->m_count);
+    }
+
+
+    // rebuild the table without tombstones, doubling it if it is more than half full
+    void rehash()
+    {
+        Slot* old_slot = this->m_slot;
+        signed char* old_control = this->m_control;
+        unsigned int old_size = this->m_size;
+        unsigned int old_count = this->m_count;
+
+        this->m_size = 0; // so that resize doesn't free the old arrays
+        this->resize(old_count * 2 >= old_size ? old_size * 2 : old_size);
+
+        for (unsigned int i = 0; i < old_size; ++i)
+        {
+            if (old_control[i] < 0) continue;
+
+            unsigned int idx = this->free_index(old_slot[i].first);
+            this->m_control[idx] = old_control[i];
+            this->m_slot[idx] = std::move(old_slot[i]);
+        }
+        this->m_count = old_count;
+
+        delete[] old_slot;
+        delete[] old_control;
+    }
+
+};
@@ -0,0 +1,369 @@
+
+#pragma once
+
+#include "LinearHash.h"
+#include <boost/cstdint.hpp>
+#include <type_traits>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+
+// "MCCILHI" and a format version, as one little-endian word; a byte-swapped image won't match
+#define LINEAR_HASH_IMAGE_MAGIC 0x0149484c4943434dull
+
+// smallest number of slots in an image (they are never more than 3/4 full, since an
+//  image is only ever read)
+#define LINEAR_HASH_IMAGE_MIN_SIZE 8
+
+// the slot array starts this far into the image, to a multiple of this
+#define LINEAR_HASH_IMAGE_ALIGN 64
+
+
+/**
+   A read-only hash table kept in a flat, position-independent image, so it can be written
+   to a file once and then used straight from an mmap of it, with nothing to rebuild.
+
+   The image is a header, a byte of probe distance per slot, and the slots themselves, all
+   located by offsets from the start of the image.  Lookups work like LinearHashFlat:
+   robin hood linear probing from a home slot found by scaling the key's hash onto a
+   power-of-2 number of slots.  The header records the key and data sizes and a fingerprint
+   of the hash policy, and an image is refused if they don't match the reader's.
+
+   Keys and data must be trivially copyable, since they are stored as their bytes.  Images
+   are native-endian; one from a machine of the other byte order is refused.
+
+   Build one from any LinearHash (or anything iterable over key/data pairs) with build() or
+   write(); then open() it from a file, or attach() it to memory already holding one.
+ */
+template <typename Key, typename Data, typename Hash = LinearHashMultiplyShift>
+class LinearHashImage
+{
+    static_assert(is_trivially_copyable<Key>::value && is_trivially_copyable<Data>::value,
+                  "LinearHashImage stores keys and data as their bytes");
+
+  public:
+    // pair-like, but trivially copyable
+    struct Slot
+    {
+        Key first;
+        Data second;
+    };
+
+    struct Header
+    {
+        uint64_t magic;
+        uint32_t key_size;
+        uint32_t data_size;
+        uint32_t slot_size;
+        uint32_t hash_check;      // the hash of a fixed key, to catch a different hash policy
+        uint32_t size;            // number of slots, a power of 2
+        uint32_t count;           // number of keys
+        uint64_t distance_offset; // 0 means vacant, otherwise 1 + distance from the home slot
+        uint64_t slot_offset;
+        uint64_t image_size;
+    };
+
+
+  protected:
+
+    const unsigned char* m_distance;
+    const Slot* m_slot;
+    unsigned int m_size;
+    unsigned int m_count;
+
+    // the mapping we made in open(), if any
+    void* m_map;
+    size_t m_map_length;
+
+
+  public:
+
+    LinearHashImage()
+    {
+        this->m_map = NULL;
+        this->m_map_length = 0;
+        this->detach();
+    }
+
+    ~LinearHashImage()
+    {
+        this->close();
+    }
+
+
+    // use an image that is already in memory; it must stay there, unchanged, while in use.
+    //  if it is refused, whatever image was in use still is
+    void attach(const void* image, size_t length)
+    {
+        const Header* h = (const Header*)image;
+        string problem = check_header(image, length);
+        if (!problem.empty()) throw string("Bad LinearHash image: " + problem);
+
+        this->close();
+        this->m_distance = (const unsigned char*)image + h->distance_offset;
+        this->m_slot = (const Slot*)((const char*)image + h->slot_offset);
+        this->m_size = h->size;
+        this->m_count = h->count;
+    }
+
+
+    // map an image file (written by write()) read-only
+    void open(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) throw string("Couldn't open LinearHash image ") + path + ": " + strerror(errno);
+
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (0 == fstat(fd, &st) && 0 < st.st_size)
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);  // the mapping keeps the file
+
+        if (MAP_FAILED == map) throw string("Couldn't map LinearHash image ") + path;
+
+        try
+        {
+            this->attach(map, st.st_size);
+        }
+        catch (string s)
+        {
+            munmap(map, st.st_size);
+            throw s + " (" + path + ")";
+        }
+
+        this->m_map = map;
+        this->m_map_length = st.st_size;
+    }
+
+
+    // stop using the image (unmapping it, if we mapped it)
+    void close()
+    {
+        if (this->m_map) munmap(this->m_map, this->m_map_length);
+        this->m_map = NULL;
+        this->m_map_length = 0;
+        this->detach();
+    }
+
+
+    // the number of keys
+    unsigned int count() const { return this->m_count; }
+
+    bool empty() const { return 0 == this->m_count; }
+
+    // the number of slots
+    unsigned int get_size() const { return this->m_size; }
+
+
+    // copy out the data for a key, if it's there
+    bool find(Key k, Data &d) const
+    {
+        const Slot* s = this->find_slot(k);
+        if (s) d = s->second;
+        return s;
+    }
+
+    bool has_key(Key k) const { return this->find_slot(k); }
+
+
+    class iterator : public std::iterator<std::input_iterator_tag, Slot>
+    {
+        friend class LinearHashImage;
+
+        const LinearHashImage* h;
+        unsigned int idx;
+
+        iterator(const LinearHashImage* h, unsigned int idx) : h(h), idx(idx) { this->skip(); }
+
+        void skip() { while (this->idx < this->h->m_size && !this->h->m_distance[this->idx]) ++this->idx; }
+
+      public:
+        iterator() : h(NULL), idx(0) {}
+
+        iterator& operator++()
+        {
+            ++this->idx;
+            this->skip();
+            return *this;
+        }
+
+        bool operator==(const iterator &rhs) const { return this->idx == rhs.idx; }
+        bool operator!=(const iterator &rhs) const { return this->idx != rhs.idx; }
+
+        const Slot& operator*() const { return this->h->m_slot[this->idx]; }
+        const Slot* operator->() const { return &(this->h->m_slot[this->idx]); }
+    };
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, this->m_size); }
+
+
+    // lay out the contents of a table as an image
+    template <typename Table>
+    static void build(const Table &table, vector<char> &image)
+    {
+        unsigned int size = LINEAR_HASH_IMAGE_MIN_SIZE;
+        while (size < table.count() + table.count() / 3 + 1) size <<= 1;
+
+        // pathological clustering (a distance that won't fit in a byte) means more slots
+        while (!build_sized(table, size, image)) size <<= 1;
+    }
+
+
+    // write the contents of a table to an image file, replacing it in one step so
+    //  that anything mapping the old one keeps a consistent view
+    template <typename Table>
+    static void write(const Table &table, const char* path)
+    {
+        vector<char> image;
+        build(table, image);
+
+        string tmp = string(path) + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (!f) throw string("Couldn't create LinearHash image ") + tmp + ": " + strerror(errno);
+
+        bool ok = 1 == fwrite(&image[0], image.size(), 1, f);
+        ok = 0 == fflush(f) && 0 == fsync(fileno(f)) && ok;
+        ok = 0 == fclose(f) && ok;
+        if (!ok || 0 != rename(tmp.c_str(), path))
+        {
+            unlink(tmp.c_str());
+            throw string("Couldn't write LinearHash image ") + path + ": " + strerror(errno);
+        }
+    }
+
+
+    // why an image can't be used, or "" if it can
+    static string check_header(const void* image, size_t length)
+    {
+        const Header* h = (const Header*)image;
+
+        if (!image || length < sizeof(Header)) return "too short";
+        if ((uintptr_t)image % __alignof__(Header) || (uintptr_t)image % __alignof__(Slot)) return "misaligned";
+        if (LINEAR_HASH_IMAGE_MAGIC != h->magic) return "not an image, a different version, or the wrong byte order";
+        if (sizeof(Key) != h->key_size || sizeof(Data) != h->data_size || sizeof(Slot) != h->slot_size)
+            return "different key or data type";
+        if (hash_check() != h->hash_check) return "different hash policy";
+        if (h->size < LINEAR_HASH_IMAGE_MIN_SIZE || (h->size & (h->size - 1)) || h->size <= h->count)
+            return "bad size";
+        if (h->image_size != length ||
+            h->distance_offset < sizeof(Header) || length < h->distance_offset ||
+            length - h->distance_offset < h->size ||
+            h->slot_offset % LINEAR_HASH_IMAGE_ALIGN || h->slot_offset < h->distance_offset + h->size ||
+            length < h->slot_offset || (length - h->slot_offset) / sizeof(Slot) < h->size)
+            return "truncated or inconsistent";
+
+        return "";
+    }
+
+
+  protected:
+
+    // don't allow copies; only one of them could own the mapping
+    LinearHashImage(const LinearHashImage &rhs);
+    LinearHashImage& operator=(const LinearHashImage &rhs);
+
+
+    void detach()
+    {
+        this->m_distance = NULL;
+        this->m_slot = NULL;
+        this->m_size = 0;
+        this->m_count = 0;
+    }
+
+
+    static uint32_t hash_check() { return Hash::hash(0x0123456789abcdefull); }
+
+
+    // the slot where a key would be placed in an uncrowded table
+    static unsigned int home(Key k, unsigned int size)
+    {
+        return (unsigned int)(((uint64_t)Hash::hash(k) * size) >> 32);
+    }
+
+
+    const Slot* find_slot(Key k) const
+    {
+        if (!this->m_size) return NULL;
+
+        unsigned int mask = this->m_size - 1;
+        unsigned int idx = home(k, this->m_size);
+
+        // robin hood invariant: once we pass a slot closer to home than we are, k isn't here
+        for (unsigned int dist = 1; dist <= this->m_distance[idx]; ++dist)
+        {
+            if (dist == this->m_distance[idx] && k == this->m_slot[idx].first) return &this->m_slot[idx];
+            idx = (idx + 1) & mask;
+        }
+
+        return NULL;
+    }
+
+
+    // lay out an image with a given number of slots; false if the probes got too long
+    template <typename Table>
+    static bool build_sized(const Table &table, unsigned int size, vector<char> &image)
+    {
+        Header h;
+        memset(&h, 0, sizeof(h));
+        h.magic = LINEAR_HASH_IMAGE_MAGIC;
+        h.key_size = sizeof(Key);
+        h.data_size = sizeof(Data);
+        h.slot_size = sizeof(Slot);
+        h.hash_check = hash_check();
+        h.size = size;
+        h.count = table.count();
+        h.distance_offset = sizeof(Header);
+        h.slot_offset = (sizeof(Header) + size + LINEAR_HASH_IMAGE_ALIGN - 1) & ~(uint64_t)(LINEAR_HASH_IMAGE_ALIGN - 1);
+        h.image_size = h.slot_offset + (uint64_t)size * sizeof(Slot);
+
+        image.assign(h.image_size, 0);  // vacant slots are all zeros, so images are reproducible
+        memcpy(&image[0], &h, sizeof(h));
+        unsigned char* distance = (unsigned char*)&image[h.distance_offset];
+        Slot* slot = (Slot*)&image[h.slot_offset];
+        unsigned int mask = size - 1;
+
+        for (typename Table::const_iterator it = table.begin(); it != table.end(); ++it)
+        {
+            Slot carry;
+            memset((void*)&carry, 0, sizeof(carry));  // so padding is written as zeros
+            carry.first = it->first;
+            carry.second = it->second;
+            unsigned char dist = 1;
+
+            // robin hood insertion, as in LinearHashFlat
+            for (unsigned int idx = home(carry.first, size); ; idx = (idx + 1) & mask, ++dist)
+            {
+                if (255 == dist) return false;
+
+                if (0 == distance[idx])
+                {
+                    memcpy(&slot[idx], &carry, sizeof(Slot));
+                    distance[idx] = dist;
+                    break;
+                }
+
+                if (distance[idx] < dist)
+                {
+                    Slot s;
+                    memcpy(&s, &slot[idx], sizeof(Slot));
+                    memcpy(&slot[idx], &carry, sizeof(Slot));
+                    carry = s;
+                    std::swap(dist, distance[idx]);
+                }
+            }
+        }
+
+        return true;
+    }
+};
@@ -1,12 +1,42 @@
 
 #include "LinearHash.h"
+#include "LinearHashFlat.h"
+#include "LinearHashGroup.h"
+#include "LinearHashConcurrent.h"
+#include "LinearHashImage.h"
+#include "MCCIArena.h"
 #include <string>
+#include <map>
 #include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <new>
+#include <utility>
 #include <boost/cstdint.hpp>
 
 using namespace std;
 
 
+// count every heap allocation, so tests can show which paths don't make any
+unsigned long g_allocations = 0;
+
+// the allocation with this number (counting from 0) fails, so tests can show what a throw leaves
+unsigned long g_fail_allocation = ~0ul;
+
+__attribute__((noinline)) void* operator new(size_t n)
+{
+    if (g_fail_allocation == __atomic_fetch_add(&g_allocations, 1, __ATOMIC_RELAXED)) throw bad_alloc();
+    void* p = malloc(n ? n : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+
 void try_hash_resize(unsigned int desired)
 {
     LinearHash<int, int> lh;
@@ -154,6 +184,745 @@ void test_short_hash()
     m_ordinality[var_id] = i;
 }
 
+
+// check the open-addressing storage against std::map under random churn
+void test_flat_hash()
+{
+    typedef LinearHash<uint32_t, uint32_t, LinearHashFlat> FlatHash;
+    FlatHash fh(4);
+    map<uint32_t, uint32_t> reference;
+
+    srand(1234);
+    for (int i = 0; i < 200000; ++i)
+    {
+        // keys shaped like (host << 16) + var, with a few hosts and vars
+        uint32_t k = ((rand() % 40) << 16) + (rand() % 300);
+
+        if (rand() % 3)
+        {
+            fh[k] = i;
+            reference[k] = i;
+        }
+        else
+        {
+            fh.remove(k);
+            reference.erase(k);
+        }
+    }
+
+    printf("\n\nFlat hash: count() = %d, get_size() = %d, max_collisions() = %d",
+           fh.count(), fh.get_size(), fh.max_collisions());
+    assert(reference.size() == fh.count());
+
+    unsigned int iterated = 0;
+    for (FlatHash::iterator it = fh.begin(); it != fh.end(); ++it, ++iterated)
+        assert(reference[it->first] == it->second);
+    assert(reference.size() == iterated);
+
+    for (map<uint32_t, uint32_t>::iterator it = reference.begin(); it != reference.end(); ++it)
+        assert(fh.has_key(it->first) && it->second == fh[it->first]);
+
+    FlatHash copy(fh);
+    fh.clear();
+    assert(fh.empty() && fh.begin() == fh.end());
+    assert(reference.size() == copy.count());
+
+    LinearHash<uint16_t, string, LinearHashFlat> sh;
+    sh.insert(37, "thirty seven");
+    assert(sh.has_key(37) && !sh.has_key(38));
+    assert("" == sh[38]);                 // auto-added, like the chained version
+    assert(sh.has_key(38) && 2 == sh.count());
+}
+
+
+// check the group-probing storage against std::map, with enough removals to leave tombstones
+void test_group_hash()
+{
+    typedef LinearHash<uint32_t, uint32_t, LinearHashGroup> GroupHash;
+    GroupHash gh(4);
+    map<uint32_t, uint32_t> reference;
+
+    srand(2468);
+    for (int i = 0; i < 300000; ++i)
+    {
+        // keys shaped like (host << 16) + var; removal is as likely as insertion
+        uint32_t k = ((rand() % 60) << 16) + (rand() % 200);
+
+        if (rand() % 2)
+        {
+            gh[k] = i;
+            reference[k] = i;
+        }
+        else
+        {
+            gh.remove(k);
+            reference.erase(k);
+        }
+    }
+
+    printf("\n\nGroup hash: count() = %d, get_size() = %d, max_collisions() = %d, mean_collisions() = %.2f",
+           gh.count(), gh.get_size(), gh.max_collisions(), gh.mean_collisions());
+    assert(reference.size() == gh.count());
+
+    unsigned int iterated = 0;
+    for (GroupHash::iterator it = gh.begin(); it != gh.end(); ++it, ++iterated)
+        assert(reference[it->first] == it->second);
+    assert(reference.size() == iterated);
+
+    for (map<uint32_t, uint32_t>::iterator it = reference.begin(); it != reference.end(); ++it)
+        assert(gh.has_key(it->first) && it->second == gh[it->first]);
+    assert(!gh.has_key(61 << 16));
+
+    GroupHash copy(gh);
+    gh.clear();
+    assert(gh.empty() && gh.begin() == gh.end() && !gh.has_key(reference.begin()->first));
+    assert(reference.size() == copy.count() && copy.has_key(reference.begin()->first));
+}
+
+
+// check the direct-indexed storage (the default for 16-bit keys) against std::map
+void test_dense_hash()
+{
+    typedef LinearHash<uint16_t, uint32_t> DenseHash;
+    DenseHash dh;
+    LinearHash<uint16_t, uint32_t, LinearHashDense>* selected = &dh; // traits picked dense storage
+    map<uint16_t, uint32_t> reference;
+
+    srand(4321);
+    for (int i = 0; i < 200000; ++i)
+    {
+        // mostly small ids, with a few scattered across the whole key space
+        uint16_t k = rand() % 10 ? rand() % 600 : rand() % 65536;
+
+        if (rand() % 3)
+        {
+            dh[k] = i;
+            reference[k] = i;
+        }
+        else
+        {
+            dh.remove(k);
+            reference.erase(k);
+        }
+    }
+
+    printf("\n\nDense hash: count() = %d, get_size() = %d", selected->count(), selected->get_size());
+    assert(reference.size() == dh.count());
+
+    // iteration visits keys in ascending order, so it should match the map exactly
+    map<uint16_t, uint32_t>::iterator ref = reference.begin();
+    for (DenseHash::iterator it = dh.begin(); it != dh.end(); ++it, ++ref)
+    {
+        assert(ref != reference.end());
+        assert(ref->first == it->first && ref->second == it->second);
+    }
+    assert(reference.end() == ref);
+
+    DenseHash copy(dh);
+    for (ref = reference.begin(); ref != reference.end(); ++ref)
+        dh.remove(ref->first);
+    assert(dh.empty() && dh.begin() == dh.end());
+    assert(reference.size() == copy.count() && copy.has_key(reference.begin()->first));
+
+    // signed keys wrap around, but come back out unchanged
+    LinearHash<short, string> sh;
+    sh[-5] = "minus five";
+    sh[5] = "five";
+    assert(sh.has_key(-5) && !sh.has_key(-4) && 2 == sh.count());
+    assert("" == sh[-4]);                 // auto-added, like the chained version
+    assert(3 == sh.count());
+    for (LinearHash<short, string>::iterator it = sh.begin(); it != sh.end(); ++it)
+        assert(-5 == it->first || -4 == it->first || 5 == it->first);
+
+    LinearHash<bool, int> bh;
+    bh[true] = 1;
+    assert(bh.has_key(true) && !bh.has_key(false) && true == bh.begin()->first);
+}
+
+
+// find / try_emplace / erase behave the same for every storage
+template <typename Table>
+void try_single_probe(const char* name)
+{
+    Table t;
+    typename Table::iterator it;
+
+    printf("\n\nSingle-probe API, %s storage", name);
+
+    assert(t.end() == t.find(7));
+    assert(0 == t.count());                // find must not auto-add
+
+    pair<typename Table::iterator, bool> r = t.try_emplace(7, 70);
+    assert(r.second && 7 == r.first->first && 70 == r.first->second && 1 == t.count());
+
+    r = t.try_emplace(7, 71);              // already there: keep the old value
+    assert(!r.second && 70 == r.first->second && 1 == t.count());
+    r.first->second = 72;                  // update in place
+    assert(72 == t[7]);
+
+    for (int i = 0; i < 1000; ++i) t.try_emplace(i, i * 10);
+    assert(1000 == t.count() && 72 == t.find(7)->second && 9990 == t.find(999)->second);
+
+    // erase every other key through find
+    for (int i = 0; i < 1000; i += 2)
+    {
+        it = t.find(i);
+        assert(t.end() != it);
+        t.erase(it);
+    }
+    assert(500 == t.count());
+
+    for (int i = 0; i < 1000; ++i)
+        assert((t.end() == t.find(i)) == (0 == i % 2));
+
+    unsigned int iterated = 0;
+    for (it = t.begin(); it != t.end(); ++it, ++iterated)
+        assert(1 == it->first % 2);
+    assert(500 == iterated);
+}
+
+
+void test_single_probe()
+{
+    try_single_probe<LinearHash<uint32_t, uint32_t, LinearHashChained> >("chained");
+    try_single_probe<LinearHash<uint32_t, uint32_t, LinearHashFlat> >("flat");
+    try_single_probe<LinearHash<uint16_t, uint32_t, LinearHashDense> >("dense");
+    try_single_probe<LinearHash<uint32_t, uint32_t, LinearHashGroup> >("group");
+}
+
+
+// grow a table of composite keys from a tiny start, with either kind of range reduction
+template <typename Table>
+void try_hash_policy(const char* name, bool power_of_two)
+{
+    Table t;
+    if (power_of_two)
+        t.resize_power_of_two(2);
+    else
+        t.resize_nearest_prime(3);
+
+    for (uint32_t h = 1; h <= 100; ++h)
+        for (uint32_t v = 1; v <= 200; ++v)
+            t[(h << 16) + v] = v;
+
+    printf("\n%-16s %s: count() = %d, get_size() = %d, max_collisions() = %d, mean_collisions() = %.2f",
+           name, power_of_two ? "2^n  " : "prime", t.count(), t.get_size(), t.max_collisions(), t.mean_collisions());
+    assert(20000 == t.count());
+
+    for (uint32_t h = 1; h <= 100; ++h)
+        for (uint32_t v = 1; v <= 200; ++v)
+            assert(t.has_key((h << 16) + v) && v == t.find((h << 16) + v)->second);
+
+    assert(!t.has_key((101 << 16) + 1) && !t.has_key(201));
+}
+
+
+void test_hash_policies()
+{
+    printf("\n\nHash policies on (host << 16) + var keys");
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashIdentity> >("identity", false);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashIdentity> >("identity", true);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift> >("multiply-shift", false);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift> >("multiply-shift", true);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMurmur> >("murmur", false);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMurmur> >("murmur", true);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashFlat, LinearHashMurmur> >("flat murmur", true);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashGroup> >("group", true);
+    try_hash_policy<LinearHash<uint32_t, uint32_t, LinearHashGroup, LinearHashMurmur> >("group murmur", true);
+}
+
+
+// monotonic clock, in microseconds
+double now_usec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+// iterating a big, nearly empty table should cost about the same as a small one
+void test_sparse_iteration()
+{
+    typedef LinearHash<uint32_t, uint32_t> SparseHash;
+    SparseHash sh(1 << 20);
+    map<uint32_t, uint32_t> reference;
+
+    for (uint32_t k = 7; k < (1 << 20); k += 100003)
+    {
+        sh[k] = k;
+        reference[k] = k;
+    }
+
+    double start = now_usec();
+    unsigned int iterated = 0;
+    for (int round = 0; round < 1000; ++round)
+        for (SparseHash::iterator it = sh.begin(); it != sh.end(); ++it, ++iterated)
+            assert(reference[it->first] == it->second);
+
+    printf("\n\nIterated %d keys in %d buckets 1000 times in %.1f usec",
+           sh.count(), sh.get_size(), now_usec() - start);
+    assert(reference.size() * 1000 == iterated);
+
+    // occupancy must follow removals, clears and splits
+    sh.remove(7);
+    assert(100010 == sh.begin()->first);
+    sh.erase(sh.begin());
+    assert(reference.size() - 2 == sh.count());
+    sh.clear();
+    assert(sh.empty() && sh.begin() == sh.end());
+
+    sh.resize(1);
+    for (uint32_t k = 0; k < 10000; k += 3) sh[k] = k;
+    for (uint32_t k = 0; k < 10000; k += 6) sh.remove(k);
+    iterated = 0;
+    for (SparseHash::iterator it = sh.begin(); it != sh.end(); ++it, ++iterated)
+        assert(3 == it->first % 6);
+    assert(sh.count() == iterated);
+}
+
+
+// grow a table from 1 bucket to millions of keys, one split at a time
+void test_incremental_growth()
+{
+    const unsigned int n = 2000000;
+    LinearHash<uint32_t, uint32_t> lh(1);
+
+    unsigned int max_added = 0;
+    double worst = 0;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        unsigned int size_before = lh.get_size();
+        double t0 = now_usec();
+
+        lh.insert(i * 7 + 3, i);
+
+        double elapsed = now_usec() - t0;
+        if (worst < elapsed) worst = elapsed;
+        if (max_added < lh.get_size() - size_before) max_added = lh.get_size() - size_before;
+    }
+
+    printf("\n\nGrew to %d keys in %d buckets (max_collisions %d); "
+           "worst insert took %.1f usec and added %d buckets",
+           lh.count(), lh.get_size(), lh.max_collisions(), worst, max_added);
+
+    // no insert may rehash the table: each one splits at most one bucket.  (the worst time
+    //  is only printed; on a loaded machine it is mostly the scheduler's)
+    assert(n == lh.count());
+    assert(1 == max_added);
+    assert(lh.count() <= lh.get_max_load_factor() * lh.get_size() + 1);
+
+    for (uint32_t i = 0; i < n; i += 997)
+        assert(lh.has_key(i * 7 + 3) && i == lh[i * 7 + 3] && !lh.has_key(i * 7 + 4));
+
+    unsigned int iterated = 0;
+    for (LinearHash<uint32_t, uint32_t>::iterator it = lh.begin(); it != lh.end(); ++it)
+        ++iterated;
+    assert(n == iterated);
+
+    // a looser table grows more slowly
+    LinearHash<uint32_t, uint32_t> loose(13);
+    loose.set_max_load_factor(4.0);
+    for (uint32_t i = 0; i < 10000; ++i)
+        loose[i] = i;
+    printf("\nWith max load factor 4, 10000 keys use %d buckets", loose.get_size());
+    assert(10000 == loose.count() && loose.get_size() <= 2501);
+
+    for (uint32_t i = 0; i < 10000; i += 2)
+        loose.remove(i);
+    assert(5000 == loose.count() && loose.has_key(9999) && !loose.has_key(9998));
+
+    // a table due to split leaves its values where they are when keys already in it are
+    //  looked up, whichever way; the next insert does the split
+    LinearHash<uint32_t, uint32_t> due(1);
+    uint32_t k = 0;
+    for (; due.count() <= due.get_max_load_factor() * due.get_size(); ++k) due[k] = k;
+    vector<uint32_t*> where;
+    for (uint32_t i = 0; i < k; ++i) where.push_back(&due[i]);
+    unsigned int size = due.get_size();
+    for (uint32_t i = 0; i < k; ++i)
+        assert(where[i] == &due[i] && where[i] == &due.try_emplace(i, 0).first->second);
+    assert(size == due.get_size());
+    due[k] = k;
+    assert(size < due.get_size());
+}
+
+
+// a value that shows whether it was read whole: b is always ~a
+struct CheckedValue
+{
+    uint64_t a, b;
+    CheckedValue() : a(0), b(~0ull) {}
+    CheckedValue(uint32_t k, uint32_t round) : a(((uint64_t)k << 32) | round), b(~a) {}
+    bool ok(uint32_t k) const { return b == ~a && k == a >> 32; }
+};
+
+typedef LinearHashConcurrent<uint32_t, CheckedValue> ConcurrentHash;
+
+struct StressArgs
+{
+    ConcurrentHash* h;
+    unsigned int id, writers, keys, rounds;
+    volatile bool* done;
+    unsigned int lookups, found, bad;
+};
+
+// each writer owns the keys equal to its id, modulo the number of writers
+void* stress_writer(void* p)
+{
+    StressArgs* args = (StressArgs*)p;
+
+    for (uint32_t round = 0; round < args->rounds; ++round)
+    {
+        for (uint32_t k = args->id; k < args->keys; k += args->writers)
+            args->h->insert(k, CheckedValue(k, round));
+        for (uint32_t k = args->id; k < args->keys; k += args->writers)
+            if (0 == k % 4) args->h->remove(k);
+    }
+    return NULL;
+}
+
+void* stress_reader(void* p)
+{
+    StressArgs* args = (StressArgs*)p;
+    uint32_t x = args->id * 2654435761u + 1;
+
+    while (!__atomic_load_n(args->done, __ATOMIC_ACQUIRE))
+    {
+        x = x * 1103515245 + 12345;
+        uint32_t k = (x >> 8) % args->keys;
+        CheckedValue v;
+
+        ++args->lookups;
+        if (args->h->find(k, v))
+        {
+            ++args->found;
+            if (!v.ok(k)) ++args->bad;
+        }
+    }
+    return NULL;
+}
+
+// the concurrent hash behaves like the others on one thread, and never shows a reader
+//  half of a write
+void test_concurrent_hash()
+{
+    ConcurrentHash ch(4);
+    map<uint32_t, uint32_t> reference;
+
+    assert(ch.empty() && 4 == ch.get_shards());
+    for (uint32_t i = 0; i < 5000; ++i)
+    {
+        uint32_t k = (i * 7919) % 3001;
+        switch (i % 3)
+        {
+        case 0:
+            ch.insert(k, CheckedValue(k, i));
+            reference[k] = i;
+            break;
+        case 1:
+            assert(ch.try_emplace(k, CheckedValue(k, i)) == !reference.count(k));
+            if (!reference.count(k)) reference[k] = i;
+            break;
+        case 2:
+            assert(ch.remove(k) == (0 < reference.erase(k)));
+            break;
+        }
+    }
+
+    assert(reference.size() == ch.count());
+    for (uint32_t k = 0; k < 3001; ++k)
+    {
+        CheckedValue v;
+        assert(ch.has_key(k) == (0 < reference.count(k)));
+        if (ch.find(k, v)) assert(v.ok(k) && reference[k] == (uint32_t)v.a);
+    }
+
+    ch.reclaim();
+    ch.clear();
+    assert(ch.empty() && !ch.has_key(reference.begin()->first));
+
+    // a write that can't grow its shard throws, leaving the shard as it was and unlocked.
+    //  fail each allocation the growth makes in turn, until it gets through
+    ConcurrentHash one(1);
+    uint32_t k = 0;
+    for (; (one.count() + 1) * 4 <= one.get_size() * 3; ++k) one.insert(k, CheckedValue(k, 0));
+    unsigned int size = one.get_size();
+    unsigned long fail = 0;
+    for (bool threw = true; threw; ++fail)
+    {
+        threw = false;
+        g_fail_allocation = g_allocations + fail;
+        try { one.insert(k, CheckedValue(k, 0)); } catch (bad_alloc&) { threw = true; }
+        g_fail_allocation = ~0ul;
+        if (threw) assert(k == one.count() && size == one.get_size() && !one.has_key(k));
+    }
+    assert(2 < fail && k + 1 == one.count() && size < one.get_size());
+    for (uint32_t i = 0; i <= k; ++i) assert(one.has_key(i));
+
+    // now hammer it
+    const unsigned int writers = 4, readers = 4, keys = 20000, rounds = 20;
+    ConcurrentHash shared(8);
+    volatile bool done = false;
+    pthread_t thread[writers + readers];
+    StressArgs args[writers + readers];
+
+    double start = now_usec();
+    for (unsigned int i = 0; i < writers + readers; ++i)
+    {
+        StressArgs a = { &shared, i < writers ? i : i - writers, writers, keys, rounds, &done, 0, 0, 0 };
+        args[i] = a;
+        pthread_create(&thread[i], NULL, i < writers ? stress_writer : stress_reader, &args[i]);
+    }
+
+    for (unsigned int i = 0; i < writers; ++i)
+        pthread_join(thread[i], NULL);
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+
+    unsigned int lookups = 0, found = 0, bad = 0;
+    for (unsigned int i = writers; i < writers + readers; ++i)
+    {
+        pthread_join(thread[i], NULL);
+        lookups += args[i].lookups;
+        found += args[i].found;
+        bad += args[i].bad;
+    }
+
+    printf("\n\n%d writers and %d readers: %d lookups (%d found) in %.1f usec, %d inconsistent",
+           writers, readers, lookups, found, now_usec() - start, bad);
+    assert(0 == bad);
+
+    // every writer finished its last round, leaving 3 keys in 4
+    assert(keys - keys / 4 == shared.count());
+    for (uint32_t k = 0; k < keys; ++k)
+    {
+        CheckedValue v;
+        assert(shared.find(k, v) == (0 != k % 4));
+        if (k % 4) assert(v.ok(k) && rounds - 1 == (uint32_t)v.a);
+    }
+}
+
+
+// tables of tables (like RequestBankTwoKeys) must never copy the inner tables as they are
+//  added, looked up or reshuffled by splits; only an explicit copy may do that
+void test_nested_moves()
+{
+    typedef LinearHash<uint32_t, uint32_t> Inner;
+    typedef LinearHash<uint32_t, Inner, LinearHashChained, LinearHashMultiplyShift> Outer;
+
+    const uint32_t outer_keys = 2000, inner_keys = 50;
+    Outer outer(1);
+    unsigned long before, worst = 0;
+
+    // each insert moves a populated table in, and the splits it causes move others around
+    for (uint32_t k1 = 0; k1 < outer_keys; ++k1)
+    {
+        Inner inner(7);
+        for (uint32_t k2 = 0; k2 < inner_keys; ++k2)
+            inner[k2] = k1 + k2;
+
+        before = g_allocations;
+        outer.insert(k1, std::move(inner));
+        if (worst < g_allocations - before) worst = g_allocations - before;
+        assert(0 == inner.count());
+    }
+
+    printf("\n\nNested tables: %d tables of %d keys, at most %lu allocations per insert (in %d buckets)",
+           outer.count(), inner_keys, worst, outer.get_size());
+    assert(outer_keys == outer.count() && outer_keys / 2 < outer.get_size());
+    assert(worst < inner_keys);  // one copy of an inner table would take more than this
+
+    // the hot path: find the inner table and update it in place, which allocates nothing
+    //  (only inserts split buckets)
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        before = g_allocations;
+        for (uint32_t k1 = 0; k1 < outer_keys; ++k1)
+        {
+            Outer::iterator it = outer.find(k1);
+            assert(outer.end() != it && inner_keys == it->second.count());
+            it->second[k1 % inner_keys] = 0;
+            (*it).second.insert(k1 % inner_keys, k1);
+
+            pair<Outer::iterator, bool> r = outer.try_emplace(k1);
+            assert(!r.second && k1 == r.first->second[k1 % inner_keys]);
+        }
+        assert(before == g_allocations);
+    }
+
+    // moving the whole thing, either way, costs nothing either
+    Outer moved(std::move(outer));
+    outer = std::move(moved);
+    assert(before == g_allocations);
+    assert(outer_keys == outer.count() && 0 == moved.count());
+
+    // an inner table built in place with the size we want.  (a key is taken out first, so
+    //  the insert doesn't also split a bucket, moving its nodes)
+    Inner last(std::move(outer[outer_keys - 1]));
+    outer.remove(outer_keys - 1);
+    before = g_allocations;
+    outer.emplace(outer_keys, 13u);
+    assert(13 == outer[outer_keys].get_size() && g_allocations - before < 5);
+    outer.remove(outer_keys);
+    outer.insert(outer_keys - 1, std::move(last));
+
+    // a real copy does copy, bucket for bucket
+    before = g_allocations;
+    Outer copy(outer);
+    printf("\nCopying them took %lu allocations", g_allocations - before);
+    assert(outer_keys * inner_keys < g_allocations - before);
+    assert(outer.get_size() == copy.get_size() && outer_keys == copy.count());
+    for (uint32_t k1 = 0; k1 < outer_keys; k1 += 7)
+        for (uint32_t k2 = 0; k2 < inner_keys; ++k2)
+            assert(outer[k1][k2] == copy[k1][k2]);
+
+    copy[0][0] = 12345;
+    assert(12345 != outer[0][0]);
+    outer = copy;
+    assert(12345 == outer[0][0] && outer_keys == outer.count());
+
+    // values are moved through the open-addressing tables too
+    LinearHash<uint32_t, Inner, LinearHashFlat> flat;
+    Inner inner(7);
+    inner[1] = 2;
+    flat.insert(1, std::move(inner));
+    assert(2 == flat[1][1] && 0 == inner.count());
+}
+
+
+// a chained table given an arena takes everything from it: buckets, trees and nodes
+void test_arena_tables()
+{
+    typedef CMCCIArenaAllocator<pair<const uint32_t, uint32_t> > Alloc;
+    typedef LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift, Alloc> ArenaHash;
+
+    const uint32_t keys = 20000;
+    CMCCIArena arena;
+    unsigned long before = g_allocations;
+    {
+        ArenaHash h(1, Alloc(&arena));
+        for (uint32_t k = 0; k < keys; ++k) h[k] = k * 3;
+
+        unsigned long blocks = arena.get_reserved() / MCCI_ARENA_BLOCK_SIZE;
+        printf("\n\nArena table: %d keys in %lu bytes of arena, %lu heap allocations",
+               h.count(), (unsigned long)arena.get_reserved(), g_allocations - before);
+        assert(keys == h.count() && 0 < arena.get_in_use());
+        assert(g_allocations - before <= blocks + 8);  // the blocks, and a few big arrays
+
+        // copies share the arena, and are independent of the original
+        ArenaHash copy(h);
+        copy[0] = 1;
+        assert(0 == h[0] && 1 == copy[0] && keys == copy.count());
+        assert(g_allocations - before < 4 * (blocks + 8));
+
+        for (uint32_t k = 0; k < keys; ++k)
+        {
+            copy.remove(k);
+            h.remove(k);
+        }
+        assert(h.empty() && copy.empty());
+    }
+
+    // with everything destroyed, everything was given back (to the arena's free lists)
+    assert(0 == arena.get_in_use());
+
+    // the arena hands it all out again, so a second fill takes nothing new
+    size_t reserved = arena.get_reserved();
+    {
+        ArenaHash h(1, Alloc(&arena));
+        for (uint32_t k = 0; k < keys; ++k) h[k] = k;
+        assert(reserved == arena.get_reserved());
+    }
+
+    // and releasing it gives it all back
+    arena.release();
+    assert(0 == arena.get_reserved() && 0 == arena.get_in_use());
+}
+
+// a table written out as an image and mapped back in answers every lookup the same way
+void test_image()
+{
+    typedef LinearHashImage<uint32_t, uint32_t> Image;
+    const char* path = "LinearHashTest.image";
+    const uint32_t keys = 50000;
+
+    LinearHash<uint32_t, uint32_t> table;
+    for (uint32_t k = 0; k < keys; ++k)
+        table[((k / 20 + 1) << 16) + k % 20] = k;
+
+    Image::write(table, path);
+
+    Image image;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    image.open(path);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("\n\nImage: %d keys in %d slots, opened in %ld us", image.count(), image.get_size(),
+           (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000);
+
+    assert(keys == image.count() && 4 * keys < 3 * image.get_size());
+    for (uint32_t k = 0; k < keys; ++k)
+    {
+        uint32_t d = 0;
+        assert(image.find(((k / 20 + 1) << 16) + k % 20, d) && k == d);
+        assert(!image.has_key(((k / 20 + 1) << 16) + k % 20 + 20));
+    }
+
+    unsigned int seen = 0;
+    for (Image::iterator it = image.begin(); it != image.end(); ++it, ++seen)
+        assert(table[it->first] == it->second);
+    assert(keys == seen);
+
+    // the same contents make the same image, wherever it sits in memory
+    vector<char> built, rebuilt;
+    Image::build(table, built);
+    Image::build(table, rebuilt);
+    assert(built == rebuilt);
+    const LinearHash<uint32_t, uint32_t> &frozen = table;
+    rebuilt.clear();
+    Image::build(frozen, rebuilt);
+    assert(built == rebuilt);
+    Image attached;
+    attached.attach(&built[0], built.size());
+    assert(attached.has_key(1 << 16) && !attached.has_key(0));
+
+    // images that don't match what the reader expects are refused
+    bool refused = false;
+    try { attached.attach(&built[0], built.size() - 1); } catch (string s) { refused = true; }
+    assert(refused && attached.has_key(1 << 16));
+
+    refused = false;
+    try { LinearHashImage<uint32_t, uint64_t> wrong_data; wrong_data.open(path); } catch (string s) { refused = true; }
+    assert(refused);
+
+    refused = false;
+    try { LinearHashImage<uint32_t, uint32_t, LinearHashMurmur> wrong_hash; wrong_hash.open(path); }
+    catch (string s) { refused = true; }
+    assert(refused);
+
+    // small keys and structured data, like the schema's variable ordinals
+    LinearHash<uint16_t, CheckedValue> dense;
+    for (uint16_t k = 1; k < 1000; k += 3) dense[k] = CheckedValue(k, 7);
+    Image::write(table, path);  // replaced while still mapped by image
+    LinearHashImage<uint16_t, CheckedValue>::write(dense, path);
+    assert(keys == image.count() && image.has_key(1 << 16));
+
+    LinearHashImage<uint16_t, CheckedValue> small;
+    small.open(path);
+    assert(dense.count() == small.count());
+    for (uint16_t k = 0; k < 1000; ++k)
+    {
+        CheckedValue v;
+        assert(small.find(k, v) == (1 == k % 3) && (1 != k % 3 || v.ok(k)));
+    }
+
+    image.close();
+    small.close();
+    unlink(path);
+}
+
+
 int main()
 {
     
@@ -161,6 +930,17 @@ int main()
     test_hash_operations();
     test_multidim_hash();
     test_short_hash();
+    test_flat_hash();
+    test_group_hash();
+    test_dense_hash();
+    test_single_probe();
+    test_hash_policies();
+    test_sparse_iteration();
+    test_incremental_growth();
+    test_concurrent_hash();
+    test_nested_moves();
+    test_arena_tables();
+    test_image();
     
     printf("\n\n");
     
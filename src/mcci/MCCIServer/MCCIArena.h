@@ -0,0 +1,273 @@
+
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+using namespace std;
+
+
+// memory is taken from the global heap in blocks of this many bytes
+#define MCCI_ARENA_BLOCK_SIZE (64 * 1024)
+
+// every allocation is aligned (and sized) to a multiple of this
+#define MCCI_ARENA_ALIGN 16
+
+// small requests are pooled in classes 16 bytes apart, up to this size...
+#define MCCI_ARENA_SMALL_MAX 256
+#define MCCI_ARENA_SMALL_CLASSES (MCCI_ARENA_SMALL_MAX / MCCI_ARENA_ALIGN)
+
+// ...and bigger ones in power-of-2 classes up to the block size; beyond that, they are
+//  passed through to the global heap (but still freed by release)
+#define MCCI_ARENA_CLASSES (MCCI_ARENA_SMALL_CLASSES + 8)
+
+
+/**
+   A region of memory for the many small, same-sized objects in a request bank: tree
+   nodes, subscription maps, and hash table buckets.
+
+   Memory is taken from the global heap in large blocks and handed out sequentially, so
+   objects allocated together sit together.  What is deallocated goes on a free list for
+   its size class and is handed out again, which suits churn (subscriptions come and go
+   constantly).
+
+   release() gives everything back at once without visiting any object, so a structure
+   that lives entirely in an arena can be torn down without destroying it piece by piece
+   -- as long as nothing in it needs its destructor run.
+
+   Use it in standard containers (and in LinearHash) through CMCCIArenaAllocator.
+   Not thread-safe.
+ */
+class CMCCIArena
+{
+
+  protected:
+
+    // each block starts with a pointer to the previous block
+    struct Block
+    {
+        Block* prev;
+    };
+
+    // allocations too big for a block are linked into a list of their own
+    struct Large
+    {
+        Large* prev;
+        Large* next;
+    };
+
+    Block* m_block;         // the block being carved up (the newest)
+    char* m_next;           // its first unused byte
+    size_t m_left;          // and how many remain
+
+    Large* m_large;
+
+    void* m_free[MCCI_ARENA_CLASSES];   // free lists, linked through the freed memory
+
+    size_t m_reserved;      // bytes taken from the global heap
+    size_t m_in_use;        // bytes allocated and not yet deallocated
+
+
+  public:
+
+    CMCCIArena()
+    {
+        this->m_block = NULL;
+        this->m_large = NULL;
+        this->reset();
+    }
+
+    ~CMCCIArena()
+    {
+        this->release();
+    }
+
+
+    // bytes taken from the global heap
+    size_t get_reserved() const { return this->m_reserved; }
+
+    // bytes allocated and not yet deallocated
+    size_t get_in_use() const { return this->m_in_use; }
+
+
+    void* allocate(size_t n)
+    {
+        size_t rounded;
+        unsigned int c = size_class(n, rounded);
+        this->m_in_use += rounded;
+
+        if (MCCI_ARENA_CLASSES == c) return this->allocate_large(rounded);
+
+        // reuse freed memory of the same class if we have any
+        if (this->m_free[c])
+        {
+            void* p = this->m_free[c];
+            this->m_free[c] = *(void**)p;
+            return p;
+        }
+
+        if (this->m_left < rounded) this->add_block();
+
+        void* p = this->m_next;
+        this->m_next += rounded;
+        this->m_left -= rounded;
+        return p;
+    }
+
+
+    void deallocate(void* p, size_t n)
+    {
+        if (!p) return;
+
+        size_t rounded;
+        unsigned int c = size_class(n, rounded);
+        this->m_in_use -= rounded;
+
+        if (MCCI_ARENA_CLASSES == c)
+        {
+            this->deallocate_large(p, rounded);
+        }
+        else
+        {
+            *(void**)p = this->m_free[c];
+            this->m_free[c] = p;
+        }
+    }
+
+
+    // give back all memory at once.  anything still allocated from the arena is gone
+    void release()
+    {
+        while (this->m_block)
+        {
+            Block* prev = this->m_block->prev;
+            ::operator delete(this->m_block);
+            this->m_block = prev;
+        }
+
+        while (this->m_large)
+        {
+            Large* next = this->m_large->next;
+            ::operator delete(this->m_large);
+            this->m_large = next;
+        }
+
+        this->reset();
+    }
+
+
+  protected:
+
+    // don't allow copies; two arenas can't own the same blocks
+    CMCCIArena(const CMCCIArena &rhs);
+    CMCCIArena& operator=(const CMCCIArena &rhs);
+
+
+    void reset()
+    {
+        this->m_next = NULL;
+        this->m_left = 0;
+        for (unsigned int c = 0; c < MCCI_ARENA_CLASSES; ++c)
+            this->m_free[c] = NULL;
+        this->m_reserved = 0;
+        this->m_in_use = 0;
+    }
+
+
+    // the size class of a request, and the size it is rounded up to.  MCCI_ARENA_CLASSES
+    //  means too big for a block
+    static unsigned int size_class(size_t n, size_t &rounded)
+    {
+        if (n <= MCCI_ARENA_SMALL_MAX)
+        {
+            unsigned int c = n ? (n - 1) / MCCI_ARENA_ALIGN : 0;
+            rounded = (c + 1) * MCCI_ARENA_ALIGN;
+            return c;
+        }
+
+        unsigned int c = MCCI_ARENA_SMALL_CLASSES;
+        for (rounded = 2 * MCCI_ARENA_SMALL_MAX; rounded < n && c < MCCI_ARENA_CLASSES; rounded <<= 1) ++c;
+        if (MCCI_ARENA_CLASSES == c) rounded = (n + MCCI_ARENA_ALIGN - 1) & ~(size_t)(MCCI_ARENA_ALIGN - 1);
+        return c;
+    }
+
+
+    // start carving a new block (what is left of the old one is abandoned)
+    void add_block()
+    {
+        Block* b = (Block*)::operator new(MCCI_ARENA_BLOCK_SIZE + MCCI_ARENA_ALIGN);
+        b->prev = this->m_block;
+        this->m_block = b;
+        this->m_next = (char*)b + MCCI_ARENA_ALIGN;
+        this->m_left = MCCI_ARENA_BLOCK_SIZE;
+        this->m_reserved += MCCI_ARENA_BLOCK_SIZE + MCCI_ARENA_ALIGN;
+    }
+
+
+    void* allocate_large(size_t n)
+    {
+        Large* l = (Large*)::operator new(n + MCCI_ARENA_ALIGN);
+        l->prev = NULL;
+        l->next = this->m_large;
+        if (this->m_large) this->m_large->prev = l;
+        this->m_large = l;
+        this->m_reserved += n + MCCI_ARENA_ALIGN;
+        return (char*)l + MCCI_ARENA_ALIGN;
+    }
+
+
+    void deallocate_large(void* p, size_t n)
+    {
+        Large* l = (Large*)((char*)p - MCCI_ARENA_ALIGN);
+        if (l->prev) l->prev->next = l->next;
+        else this->m_large = l->next;
+        if (l->next) l->next->prev = l->prev;
+        this->m_reserved -= n + MCCI_ARENA_ALIGN;
+        ::operator delete(l);
+    }
+
+};
+
+
+/**
+   A standard allocator that takes its memory from a CMCCIArena, or from the global heap
+   if it has none (so a default-constructed one behaves like std::allocator).
+
+   The arena travels with containers when they are moved or swapped.  A copy-constructed
+   container shares the original's arena; copy assignment keeps the target's own.
+ */
+template <typename T>
+class CMCCIArenaAllocator
+{
+  public:
+    typedef T value_type;
+
+    typedef true_type propagate_on_container_move_assignment;
+    typedef true_type propagate_on_container_swap;
+
+    CMCCIArena* m_arena;
+
+    CMCCIArenaAllocator(CMCCIArena* arena = NULL) : m_arena(arena) {}
+
+    template <typename U>
+    CMCCIArenaAllocator(const CMCCIArenaAllocator<U> &rhs) : m_arena(rhs.m_arena) {}
+
+    T* allocate(size_t n)
+    {
+        if (this->m_arena) return (T*)this->m_arena->allocate(n * sizeof(T));
+        return (T*)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (this->m_arena) this->m_arena->deallocate(p, n * sizeof(T));
+        else ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const CMCCIArenaAllocator<U> &rhs) const { return this->m_arena == rhs.m_arena; }
+
+    template <typename U>
+    bool operator!=(const CMCCIArenaAllocator<U> &rhs) const { return this->m_arena != rhs.m_arena; }
+};
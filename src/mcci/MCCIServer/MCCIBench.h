@@ -0,0 +1,40 @@
+
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+
+/**
+   Shared plumbing for the mcci_bench_* programs.
+
+   Results are printed as CSV on stdout, one measurement per row, so runs from different
+   releases can be collected and compared by script; anything meant for people goes to
+   stderr.  Every row starts with the benchmark's name, and the header names the rest.
+ */
+
+
+// a monotonic clock, in seconds
+inline double mcci_bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// keep the compiler from discarding work whose result is otherwise unused
+template <typename T>
+inline void mcci_bench_keep(T const &value)
+{
+    __asm__ __volatile__("" : : "g"(&value) : "memory");
+}
+
+
+// the CSV header, after the benchmark name column
+inline void mcci_bench_header(const char* columns)
+{
+    printf("bench,%s\n", columns);
+}
@@ -0,0 +1,508 @@
+
+#include "MCCIBench.h"
+#include "LinearHash.h"
+#include "LinearHashFlat.h"
+#include "LinearHashDense.h"
+#include "LinearHashGroup.h"
+#include "LinearHashConcurrent.h"
+#include "MCCIArena.h"
+#include <unordered_map>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+/**
+   mcci_bench_hash: insert, lookup (hit, miss, and mixes of the two), erase and iteration
+   throughput for each LinearHash storage, and std::unordered_map for reference, over the
+   key distributions the request banks see; then threads sharing one table, locked or
+   sharded.  How evenly each hash spreads (host << 16) + var keys goes to stderr.
+
+   usage: mcci_bench_hash [operations per measurement]
+
+   One CSV row per measurement on stdout:
+     bench,table,keys,size,op,ops,seconds,ns_per_op
+   where op is insert, hit, miss, mixedN (N% of the lookups hit, in random order),
+   iterate, erase, or threadsN (N threads at once, 1 in 20 operations adding or removing a
+   key and the rest looking one up; ns_per_op is wall time over all of them).
+ */
+
+
+// the operations a table under test must support; LinearHash provides them directly
+template <typename Table, bool PowerOfTwo = false>
+class LinearHashUnderTest
+{
+  protected:
+    Table m_table;
+
+  public:
+    LinearHashUnderTest(Table &&table = Table()) : m_table(std::move(table)) {}
+
+    void reset(unsigned int n)
+    {
+        if (PowerOfTwo)
+            this->m_table.resize_power_of_two(n);
+        else
+            this->m_table.resize_nearest_prime(n);
+    }
+
+    void insert(uint32_t k, uint32_t d) { this->m_table.insert(k, d); }
+    bool has_key(uint32_t k) const { return this->m_table.has_key(k); }
+    void remove(uint32_t k) { this->m_table.remove(k); }
+
+    uint32_t iterate()
+    {
+        uint32_t sum = 0;
+        for (typename Table::iterator it = this->m_table.begin(); it != this->m_table.end(); ++it)
+            sum += it->second;
+        return sum;
+    }
+};
+
+
+// a chained table with everything in an arena, as the two-key banks keep theirs.
+//  (the arena is a base so that it outlives the table)
+struct ArenaHolder
+{
+    CMCCIArena m_arena;
+};
+
+typedef CMCCIArenaAllocator<pair<const uint32_t, uint32_t> > ArenaAllocator;
+typedef LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift, ArenaAllocator> ArenaHash;
+
+class ArenaHashUnderTest : protected ArenaHolder, public LinearHashUnderTest<ArenaHash, true>
+{
+  public:
+    ArenaHashUnderTest() : LinearHashUnderTest<ArenaHash, true>(ArenaHash(ArenaAllocator(&this->m_arena))) {}
+};
+
+
+class UnorderedMapUnderTest
+{
+    unordered_map<uint32_t, uint32_t> m_table;
+
+  public:
+    void reset(unsigned int n)
+    {
+        this->m_table.clear();
+        this->m_table.reserve(n);
+    }
+
+    void insert(uint32_t k, uint32_t d) { this->m_table[k] = d; }
+    bool has_key(uint32_t k) const { return this->m_table.count(k); }
+    void remove(uint32_t k) { this->m_table.erase(k); }
+
+    uint32_t iterate()
+    {
+        uint32_t sum = 0;
+        for (unordered_map<uint32_t, uint32_t>::iterator it = this->m_table.begin(); it != this->m_table.end(); ++it)
+            sum += it->second;
+        return sum;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// a set of keys to store, and as many that look like them but aren't stored
+struct KeySet
+{
+    const char* name;
+    vector<uint32_t> hit;
+    vector<uint32_t> miss;
+};
+
+
+// variable ids: 1 .. n, as the variable bank and the var/rev bank's outer table see them
+void dense_keys(unsigned int n, KeySet &keys)
+{
+    keys.name = "dense";
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        keys.hit.push_back(i + 1);
+        keys.miss.push_back(n + i + 1);
+    }
+}
+
+
+// (host << 16) + var, 20 variables per host, as the host/var and remote banks see them
+void hostvar_keys(unsigned int n, KeySet &keys)
+{
+    keys.name = "hostvar";
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        keys.hit.push_back(((i / 20 + 1) << 16) + (i % 20) + 1);
+        keys.miss.push_back(((i / 20 + 1) << 16) + (i % 20) + 21);
+    }
+}
+
+
+// revision numbers: runs of 32 consecutive revisions (the recent past of one variable),
+//  scattered over the range.  the misses are the revisions just after each run
+void revision_keys(unsigned int n, KeySet &keys)
+{
+    keys.name = "revision";
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        uint32_t base = (i / 32 + 1) * 100003u;
+        keys.hit.push_back(base + i % 32);
+        keys.miss.push_back(base + 32 + i % 32);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+bool g_failed = false;
+
+void report(const char* table, const KeySet &keys, const char* op, unsigned long ops, double seconds)
+{
+    printf("hash,%s,%s,%lu,%s,%lu,%.6f,%.2f\n",
+           table, keys.name, (unsigned long)keys.hit.size(), op, ops, seconds, seconds * 1e9 / ops);
+}
+
+void check(const char* table, const KeySet &keys, const char* op, unsigned long got, unsigned long expected)
+{
+    if (got == expected) return;
+    fprintf(stderr, "ERROR: %s, %s keys, %s: got %lu, expected %lu\n", table, keys.name, op, got, expected);
+    g_failed = true;
+}
+
+
+// each operation over every key, enough times to take about `total` operations
+template <typename Table>
+void bench(const char* name, const KeySet &keys, unsigned long total)
+{
+    unsigned int n = keys.hit.size();
+    unsigned int rounds = total / n + 1;
+    unsigned long ops = (unsigned long)n * rounds;
+    unsigned long found;
+    double t0, t;
+
+    // look keys up and erase them in an order unrelated to how they were added
+    vector<uint32_t> hit(keys.hit), miss(keys.miss);
+    srand(1357);
+    random_shuffle(hit.begin(), hit.end());
+    random_shuffle(miss.begin(), miss.end());
+
+    Table table;
+
+    t = 0;
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        table.reset(n);
+        t0 = mcci_bench_now();
+        for (unsigned int i = 0; i < n; ++i)
+            table.insert(keys.hit[i], i);
+        t += mcci_bench_now() - t0;
+    }
+    report(name, keys, "insert", ops, t);
+
+    found = 0;
+    t0 = mcci_bench_now();
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        mcci_bench_keep(table);  // so no round can be skipped
+        for (unsigned int i = 0; i < n; ++i)
+            found += table.has_key(hit[i]);
+    }
+    report(name, keys, "hit", ops, mcci_bench_now() - t0);
+    check(name, keys, "hit", found, ops);
+
+    found = 0;
+    t0 = mcci_bench_now();
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        mcci_bench_keep(table);  // so no round can be skipped
+        for (unsigned int i = 0; i < n; ++i)
+            found += table.has_key(miss[i]);
+    }
+    report(name, keys, "miss", ops, mcci_bench_now() - t0);
+    check(name, keys, "miss", found, 0);
+
+    // hits and misses at random, as in process_data, where most keys have no subscribers
+    unsigned int percents[] = {10, 50, 90};
+    for (unsigned int p = 0; p < sizeof(percents) / sizeof(percents[0]); ++p)
+    {
+        vector<uint32_t> lookups;
+        unsigned long hits = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            bool h = (unsigned int)(rand() % 100) < percents[p];
+            lookups.push_back(h ? hit[rand() % n] : miss[rand() % n]);
+            hits += h;
+        }
+
+        char op[16];
+        sprintf(op, "mixed%u", percents[p]);
+
+        found = 0;
+        t0 = mcci_bench_now();
+        for (unsigned int r = 0; r < rounds; ++r)
+        {
+            mcci_bench_keep(table);  // so no round can be skipped
+            for (unsigned int i = 0; i < n; ++i)
+                found += table.has_key(lookups[i]);
+        }
+        report(name, keys, op, ops, mcci_bench_now() - t0);
+        check(name, keys, op, found, hits * rounds);
+    }
+
+    uint32_t sum = 0;
+    t0 = mcci_bench_now();
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        mcci_bench_keep(table);
+        sum += table.iterate();
+    }
+    report(name, keys, "iterate", ops, mcci_bench_now() - t0);
+    check(name, keys, "iterate", sum, (uint32_t)((n * (n - 1ul) / 2) * rounds));
+
+    t = 0;
+    for (unsigned int r = 0; r < rounds; ++r)
+    {
+        table.reset(n);
+        for (unsigned int i = 0; i < n; ++i)
+            table.insert(keys.hit[i], i);
+
+        t0 = mcci_bench_now();
+        for (unsigned int i = 0; i < n; ++i)
+            table.remove(hit[i]);
+        t += mcci_bench_now() - t0;
+    }
+    report(name, keys, "erase", ops, t);
+    check(name, keys, "erase", table.iterate(), 0);
+}
+
+
+void bench_all(const KeySet &keys, unsigned long total)
+{
+    fprintf(stderr, "%s keys, %lu of them\n", keys.name, (unsigned long)keys.hit.size());
+
+    bench<LinearHashUnderTest<LinearHash<uint32_t, uint32_t> > >("chained", keys, total);
+    bench<LinearHashUnderTest<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift>, true> >
+        ("chained-ms", keys, total);
+    bench<ArenaHashUnderTest>("chained-arena", keys, total);
+    bench<LinearHashUnderTest<LinearHash<uint32_t, uint32_t, LinearHashFlat> > >("flat", keys, total);
+    bench<LinearHashUnderTest<LinearHash<uint32_t, uint32_t, LinearHashGroup> > >("group", keys, total);
+
+    // direct indexing only works if every key, hit or miss, fits in 16 bits
+    if (*max_element(keys.hit.begin(), keys.hit.end()) < 65536 &&
+        *max_element(keys.miss.begin(), keys.miss.end()) < 65536)
+        bench<LinearHashUnderTest<LinearHash<uint16_t, uint32_t, LinearHashDense> > >("dense", keys, total);
+
+    bench<UnorderedMapUnderTest>("unordered_map", keys, total);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// the single-threaded flat table behind one lock, to compare the concurrent one against
+class LockedFlatHash
+{
+    LinearHash<uint32_t, uint32_t, LinearHashFlat> m_hash;
+    pthread_mutex_t m_lock;
+
+  public:
+    LockedFlatHash() { pthread_mutex_init(&this->m_lock, NULL); }
+    ~LockedFlatHash() { pthread_mutex_destroy(&this->m_lock); }
+
+    bool find(uint32_t k, uint32_t& d)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        LinearHash<uint32_t, uint32_t, LinearHashFlat>::iterator it = this->m_hash.find(k);
+        bool found = it != this->m_hash.end();
+        if (found) d = it->second;
+        pthread_mutex_unlock(&this->m_lock);
+        return found;
+    }
+
+    void insert(uint32_t k, uint32_t d)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_hash.insert(k, d);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+
+    void remove(uint32_t k)
+    {
+        pthread_mutex_lock(&this->m_lock);
+        this->m_hash.remove(k);
+        pthread_mutex_unlock(&this->m_lock);
+    }
+};
+
+
+template <typename Table>
+struct ThreadArgs
+{
+    Table* table;
+    const vector<uint32_t>* keys;
+    unsigned long ops;
+    uint32_t seed;
+    unsigned long found;
+};
+
+// lookups like subscription checks during data fan-out, with 1 in 20 operations
+//  (re)subscribing or unsubscribing
+template <typename Table>
+void* bench_thread(void* p)
+{
+    ThreadArgs<Table>* args = (ThreadArgs<Table>*)p;
+    const vector<uint32_t>& keys = *args->keys;
+    uint32_t x = args->seed;
+
+    for (unsigned long i = 0; i < args->ops; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        uint32_t k = keys[(x >> 8) % keys.size()];
+        uint32_t d;
+
+        switch ((x >> 28) % 40)
+        {
+        case 0: args->table->insert(k, i); break;
+        case 1: args->table->remove(k); break;
+        default: if (args->table->find(k, d)) ++args->found;
+        }
+    }
+    return NULL;
+}
+
+// `total` operations split among 1, 2, 4 ... 32 threads sharing one table
+template <typename Table>
+void bench_threads(const char* name, const KeySet &keys, unsigned long total)
+{
+    for (unsigned int threads = 1; threads <= 32; threads *= 2)
+    {
+        Table table;
+        for (unsigned int i = 0; i < keys.hit.size(); ++i)
+            table.insert(keys.hit[i], i);
+
+        vector<pthread_t> thread(threads);
+        vector<ThreadArgs<Table> > args(threads);
+
+        double t0 = mcci_bench_now();
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            ThreadArgs<Table> a = { &table, &keys.hit, total / threads, i * 2654435761u + 1, 0 };
+            args[i] = a;
+            pthread_create(&thread[i], NULL, bench_thread<Table>, &args[i]);
+        }
+        for (unsigned int i = 0; i < threads; ++i)
+            pthread_join(thread[i], NULL);
+        double t = mcci_bench_now() - t0;
+
+        char op[16];
+        sprintf(op, "threads%u", threads);
+        report(name, keys, op, total / threads * threads, t);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// keys like the remote banks': (host << 16) + var, for a given number of variables per host
+void composite_keys(unsigned int hosts, unsigned int vars, vector<uint32_t>& keys)
+{
+    for (unsigned int h = 0; h < hosts; ++h)
+        for (unsigned int v = 0; v < vars; ++v)
+            keys.push_back(((h + 1) << 16) + v + 1);
+}
+
+
+// how evenly a table spreads a set of keys, sized for them as the banks would be
+template <typename Table>
+void collisions(const char* name, const vector<uint32_t>& keys, bool power_of_two)
+{
+    Table table;
+
+    if (power_of_two)
+        table.resize_power_of_two(keys.size());
+    else
+        table.resize_nearest_prime(keys.size());
+
+    for (unsigned int i = 0; i < keys.size(); ++i)
+        table.insert(keys[i], i);
+
+    fprintf(stderr, "  %-30s size %7d  max_collisions %5d  mean_collisions %7.2f\n",
+            name, table.get_size(), table.max_collisions(), table.mean_collisions());
+}
+
+
+void collision_report(unsigned int hosts, unsigned int vars)
+{
+    vector<uint32_t> keys;
+    composite_keys(hosts, vars, keys);
+
+    fprintf(stderr, "(host << 16) + var, %d hosts x %d variables\n", hosts, vars);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashIdentity> >
+        ("chained identity, prime", keys, false);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashIdentity> >
+        ("chained identity, 2^n", keys, true);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift> >
+        ("chained multiply-shift, prime", keys, false);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMultiplyShift> >
+        ("chained multiply-shift, 2^n", keys, true);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashChained, LinearHashMurmur> >
+        ("chained murmur, 2^n", keys, true);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashFlat, LinearHashMultiplyShift> >
+        ("flat multiply-shift", keys, true);
+    collisions<LinearHash<uint32_t, uint32_t, LinearHashFlat, LinearHashMurmur> >
+        ("flat murmur", keys, true);
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned long total = 2000000;
+    unsigned int sizes[] = {20, 100, 1000, 10000, 100000};
+
+    if (1 < argc) total = strtoul(argv[1], NULL, 10);
+    if (!total)
+    {
+        fprintf(stderr, "usage: %s [operations per measurement]\n", argv[0]);
+        return 1;
+    }
+
+    mcci_bench_header("table,keys,size,op,ops,seconds,ns_per_op");
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        KeySet dense, hostvar, revision;
+        dense_keys(sizes[s], dense);
+        hostvar_keys(sizes[s], hostvar);
+        revision_keys(sizes[s], revision);
+
+        bench_all(dense, total);
+        bench_all(hostvar, total);
+        bench_all(revision, total);
+    }
+
+    fprintf(stderr, "threads sharing one table of 10000 hostvar keys (%ld cores)\n",
+            sysconf(_SC_NPROCESSORS_ONLN));
+    {
+        KeySet hostvar;
+        hostvar_keys(10000, hostvar);
+        bench_threads<LockedFlatHash>("one-lock", hostvar, total);
+        bench_threads<LinearHashConcurrent<uint32_t, uint32_t> >("sharded", hostvar, total);
+    }
+
+    fprintf(stderr, "collisions (mean_collisions: keys per bucket, or probes per lookup, seen by a key)\n");
+    collision_report(200, 3);
+    collision_report(50, 20);
+    collision_report(1000, 64);
+    collision_report(16, 1000);
+
+    return g_failed ? 1 : 0;
+}
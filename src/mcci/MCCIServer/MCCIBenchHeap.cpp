@@ -0,0 +1,648 @@
+
+#include "MCCIBench.h"
+#include "FibonacciHeap.h"
+#include "CompactFibonacciHeap.h"
+#include "TimingWheel.h"
+#include "PairingHeap.h"
+#include "DaryHeap.h"
+#include "MCCIArena.h"
+#include "MCCIRequestBanks.h"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+/**
+   mcci_bench_heap: churn in a timeout heap holding a steady number of requests, as a
+   request bank sees it.  Every step adds a request and takes one away, either because it
+   expired (remove_minimum) or because it was fulfilled or cancelled (remove); or renews
+   one (alter_key), with an expiry every few renewals.  Each queue (FibonacciHeap,
+   CompactFibonacciHeap, PairingHeap, DaryHeap and TimingWheel) is run with nodes from
+   malloc and from an arena.
+
+   Then a recorded stream of subscriptions, renewals, fulfilments and expiry ticks is
+   replayed through a variable/revision request bank on each queue (op "replay", with the
+   bank's own arena), so the queue is measured along with the rest of the bank;
+   expiry ticks use pop_expired, as the server does.  And a bank full of requests is
+   expired all at once, one remove_minimum at a time and in a single pop_expired (and, for
+   the two Fibonacci heaps, a million of them); the memory the bank holds per request is
+   written to stderr as it is filled.
+
+   Last, banks with 1, 10, 100 and 1000 subscribers on each key have every key's
+   subscribers walked, as a production notifies them (op "fanout"), and then fulfilled
+   (op "fulfil"); the "size" column is the number of subscribers per key.  And the
+   six banks of a server are searched for the subscribers to each incoming packet, as
+   process_data does (ops "lookup" and "deliver").
+
+   usage: mcci_bench_heap [operations per measurement]
+
+   One CSV row per measurement on stdout:
+     bench,heap,alloc,size,op,ops,seconds,ns_per_op
+ */
+
+
+bool g_failed = false;
+
+void report(const char* heap, const char* alloc, unsigned int size, const char* op,
+            unsigned long ops, double seconds)
+{
+    printf("heap,%s,%s,%u,%s,%lu,%.6f,%.2f\n", heap, alloc, size, op, ops, seconds, seconds * 1e9 / ops);
+}
+
+
+// a timeout somewhere in the next `window` ticks; never 0, which remove() uses as -infinity
+inline uint32_t next_timeout(uint32_t &x, uint32_t now, uint32_t window)
+{
+    x = x * 1103515245 + 12345;
+    return now + 1 + (x >> 8) % window;
+}
+
+
+// empty a heap after a run, checking it still held as many requests as it should
+template <typename Heap>
+void drain(Heap &heap, unsigned int size)
+{
+    unsigned int left = 0;
+    for (; !heap.empty(); ++left) heap.remove_minimum();
+    if (size != left) g_failed = true;
+}
+
+
+// hold `size` requests; each step adds one and lets the earliest expire
+template <typename Heap>
+void bench_expire(const char* name, const char* alloc, Heap &heap, unsigned int size, unsigned long total)
+{
+    uint32_t x = 1357, now = 0, window = 4 * size;
+
+    for (unsigned int i = 0; i < size; ++i) heap.insert(next_timeout(x, now, window), i);
+
+    double t0 = mcci_bench_now();
+    for (unsigned long i = 0; i < total; ++i)
+    {
+        heap.insert(next_timeout(x, now, window), i);
+        now = heap.minimum()->key();
+        heap.remove_minimum();
+    }
+    report(name, alloc, size, "expire", total, mcci_bench_now() - t0);
+
+    drain(heap, size);
+}
+
+
+// hold `size` requests; each step adds one and cancels the oldest, wherever it is in the heap
+template <typename Heap>
+void bench_cancel(const char* name, const char* alloc, Heap &heap, unsigned int size, unsigned long total)
+{
+    uint32_t x = 2468, now = 0, window = 4 * size;
+    deque<typename Heap::Node*> live;
+
+    for (unsigned int i = 0; i < size; ++i) live.push_back(heap.insert(next_timeout(x, now, window), i));
+
+    double t0 = mcci_bench_now();
+    for (unsigned long i = 0; i < total; ++i)
+    {
+        live.push_back(heap.insert(next_timeout(x, now, window), i));
+        heap.remove(live.front(), 0);
+        live.pop_front();
+    }
+    report(name, alloc, size, "cancel", total, mcci_bench_now() - t0);
+
+    drain(heap, size);
+}
+
+
+// hold `size` requests; each step renews one of them, extending its timeout by the
+//  window, and every fourth step the earliest expires and a new request takes its place.
+//  each request's data is its index in live
+template <typename Heap>
+void bench_renew(const char* name, const char* alloc, Heap &heap, unsigned int size, unsigned long total)
+{
+    uint32_t x = 3579, now = 0, window = 4 * size;
+    vector<typename Heap::Node*> live;
+
+    for (unsigned int i = 0; i < size; ++i) live.push_back(heap.insert(next_timeout(x, now, window), i));
+
+    double t0 = mcci_bench_now();
+    for (unsigned long i = 0; i < total; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        typename Heap::Node* n = live[(x >> 8) % size];
+        heap.alter_key(n, n->key() + window, 0);
+
+        if (3 == i % 4)
+        {
+            typename Heap::Node* m = heap.minimum();
+            unsigned int j = m->data();  // where it is in live
+            now = m->key();
+            heap.remove_minimum();
+            live[j] = heap.insert(next_timeout(x, now, window), j);
+        }
+    }
+    report(name, alloc, size, "renew", total, mcci_bench_now() - t0);
+
+    drain(heap, size);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// one thing that happens to a request bank
+struct Event
+{
+    enum { SUBSCRIBE, FULFIL, TICK } op;
+    VarRevPair key;
+    MCCI_CLIENT_ID_T client;
+    MCCI_TIME_T time;  // the timeout to subscribe with, or the time of a tick
+};
+
+#define REPLAY_CLIENTS 100
+
+
+// clients waiting on the next revision of a variable, about `size` at a time.  each tick
+//  brings 8 new subscriptions with a lease of size / 8 ticks, 16 renewals of recent
+//  subscriptions (moved on to the next revision if theirs has been produced), and 2
+//  productions, each fulfilling everyone waiting on that revision; then whatever's left
+//  past its lease expires
+void record_events(unsigned int size, unsigned long total, vector<Event> &events)
+{
+    unsigned int vars = size / 4 + 1;
+    MCCI_TIME_T lease = size / 8 + 1;
+    vector<MCCI_REVISION_T> revision(vars + 1, 0);
+    vector<Event> recent(256);
+    uint32_t x = 4680;
+
+    for (unsigned int i = 0; i < recent.size(); ++i)
+    {
+        recent[i].key.var = 1 + i % vars;
+        recent[i].key.rev = 1;
+        recent[i].client = i % REPLAY_CLIENTS;
+    }
+
+    Event e;
+    for (MCCI_TIME_T now = 1; events.size() < total; ++now)
+    {
+        for (int i = 0; i < 24; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            e.op = Event::SUBSCRIBE;
+            e.time = now + lease + (x >> 8) % 16;
+
+            if (i < 8)
+            {
+                e.key.var = 1 + (x >> 12) % vars;
+                e.client = (x >> 4) % REPLAY_CLIENTS;
+                recent[(x >> 20) % recent.size()] = e;
+            }
+            else
+            {
+                Event &r = recent[(x >> 20) % recent.size()];
+                e.key.var = r.key.var;
+                e.client = r.client;
+            }
+            e.key.rev = revision[e.key.var] + 1;
+            events.push_back(e);
+        }
+
+        for (int i = 0; i < 2; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            e.op = Event::FULFIL;
+            e.key.var = 1 + (x >> 12) % vars;
+            e.key.rev = ++revision[e.key.var];
+            events.push_back(e);
+        }
+
+        e.op = Event::TICK;
+        e.time = now;
+        events.push_back(e);
+    }
+}
+
+
+// play events through a bank; returns how many requests expired
+template <typename Bank>
+unsigned long replay(Bank &bank, const vector<Event> &events)
+{
+    unsigned long expired = 0;
+
+    for (unsigned int i = 0; i < events.size(); ++i)
+    {
+        const Event &e = events[i];
+        switch (e.op)
+        {
+          case Event::SUBSCRIBE:
+            bank.add(e.key, e.client, e.time);
+            break;
+
+          case Event::FULFIL:
+            if (bank.contains(e.key)) bank.remove_by_key(e.key);
+            break;
+
+          case Event::TICK:
+            expired += bank.pop_expired(e.time);
+            break;
+        }
+    }
+
+    return expired;
+}
+
+
+template <template <typename, typename, typename> class Queue>
+void bench_replay(const char* name, unsigned int size, const vector<Event> &events, unsigned long &expired)
+{
+    BasicVariableRevisionRequestBank<Queue> bank(REPLAY_CLIENTS, size / 4 + 1, 8);
+
+    double t0 = mcci_bench_now();
+    unsigned long n = replay(bank, events);
+    report(name, "pool", size, "replay", events.size(), mcci_bench_now() - t0);
+
+    // every queue must expire the same requests
+    if (!expired) expired = n;
+    if (n != expired) g_failed = true;
+}
+
+
+// a bank holding `size` requests, all of which time out at once (as after a link outage):
+//  taken one at a time (op "storm-each") and in one pop_expired (op "storm-bulk")
+template <template <typename, typename, typename> class Queue>
+void bench_storm(const char* name, unsigned int size)
+{
+    unsigned int vars = size / 4 + 1;
+    BasicVariableRevisionRequestBank<Queue> each(REPLAY_CLIENTS, vars, 8);
+    BasicVariableRevisionRequestBank<Queue> bulk(REPLAY_CLIENTS, vars, 8);
+    uint32_t x = 5791;
+
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        VarRevPair vr;
+        vr.var = 1 + i % vars;
+        vr.rev = 1 + i / vars;
+        MCCI_TIME_T t = next_timeout(x, 0, size);
+        each.add(vr, i % REPLAY_CLIENTS, t);
+        bulk.add(vr, i % REPLAY_CLIENTS, t);
+    }
+
+    fprintf(stderr, "  %s: %.1f bytes per request in the bank's arena, %lu per queue node\n", name,
+            (double)bulk.get_arena().get_in_use() / size,
+            (unsigned long)sizeof(typename BasicVariableRevisionRequestBank<Queue>::HeapNode));
+
+    MCCI_TIME_T now = size + 2;
+    unsigned int n = 0;
+    double t0 = mcci_bench_now();
+    for (; !each.empty() && now > each.minimum_timeout(); ++n)
+        each.remove_minimum();
+    report(name, "pool", size, "storm-each", n, mcci_bench_now() - t0);
+
+    t0 = mcci_bench_now();
+    unsigned int m = bulk.pop_expired(now);
+    report(name, "pool", size, "storm-bulk", m, mcci_bench_now() - t0);
+
+    if (n != size || m != size) g_failed = true;
+}
+
+
+// a bank holding `size` requests admitting bursts of ADMIT_BURST requests for runs of
+//  revisions (as process_request does for a quantity), one add at a time (op
+//  "admit-each") and with add_batch (op "admit-batch")
+#define ADMIT_BURST 16
+
+template <template <typename, typename, typename> class Queue>
+void bench_admit(const char* name, unsigned int size)
+{
+    typedef BasicVariableRevisionRequestBank<Queue> Bank;
+    unsigned int vars = size / 4 + 1;
+    unsigned int bursts = (size < 10000 ? 10000 : size) / ADMIT_BURST;
+    Bank each(REPLAY_CLIENTS, vars, 8);
+    Bank batched(REPLAY_CLIENTS, vars, 8);
+    uint32_t x = 2713;
+
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        VarRevPair vr;
+        vr.var = 1 + i % vars;
+        vr.rev = 1 + i / vars;
+        MCCI_TIME_T t = next_timeout(x, 0, size);
+        each.add(vr, i % REPLAY_CLIENTS, t);
+        batched.add(vr, i % REPLAY_CLIENTS, t);
+    }
+
+    // the bursts ask for revisions beyond any already held
+    vector<typename Bank::Request> requests(bursts * ADMIT_BURST);
+    for (unsigned int i = 0; i < requests.size(); ++i)
+    {
+        unsigned int b = i / ADMIT_BURST;
+        requests[i].key_set.var = 1 + b % vars;
+        requests[i].key_set.rev = 1000 + (b / vars) * ADMIT_BURST + i % ADMIT_BURST;
+        requests[i].client_id = b % REPLAY_CLIENTS;
+        requests[i].timeout = next_timeout(x, 0, size);
+    }
+
+    double t0 = mcci_bench_now();
+    for (unsigned int i = 0; i < requests.size(); ++i)
+        each.add(requests[i].key_set, requests[i].client_id, requests[i].timeout);
+    report(name, "pool", size, "admit-each", requests.size(), mcci_bench_now() - t0);
+
+    vector<typename Bank::Request> burst(ADMIT_BURST);
+    t0 = mcci_bench_now();
+    for (unsigned int b = 0; b < bursts; ++b)
+    {
+        copy(requests.begin() + b * ADMIT_BURST, requests.begin() + (b + 1) * ADMIT_BURST, burst.begin());
+        batched.add_batch(burst);
+    }
+    report(name, "pool", size, "admit-batch", requests.size(), mcci_bench_now() - t0);
+
+    // both must now expire the same requests
+    MCCI_TIME_T now = size + 2;
+    if (each.pop_expired(now) != batched.pop_expired(now) || !each.empty() || !batched.empty())
+        g_failed = true;
+}
+
+
+// a bank holding FANOUT_REQUESTS requests, `subscribers` of them on each key, walking every
+//  key's subscribers (op "fanout", ops counting subscribers) and then fulfilling each key
+//  (op "fulfil"); the memory the bank holds per request is written to stderr
+#define FANOUT_REQUESTS 100000
+#define FANOUT_CLIENTS 1001
+
+// the k'th key, over a thousand variables (their ids are 16 bits) and as many revisions as it takes
+inline VarRevPair fanout_key(unsigned int k)
+{
+    VarRevPair vr;
+    vr.var = 1 + k % 1000;
+    vr.rev = 1 + k / 1000;
+    return vr;
+}
+
+void bench_fanout(unsigned int subscribers, unsigned long total)
+{
+    BasicVariableRevisionRequestBank<FibonacciHeap> bank(FANOUT_CLIENTS, 1000, 8);
+    unsigned int keys = FANOUT_REQUESTS / subscribers;
+    uint32_t x = 409;
+
+    for (unsigned int k = 0; k < keys; ++k)
+    {
+        VarRevPair vr = fanout_key(k);
+        // clients in no particular order, as subscriptions arrive
+        for (unsigned int s = 0; s < subscribers; ++s)
+            bank.add(vr, (s * 7919 + k) % FANOUT_CLIENTS, next_timeout(x, 0, FANOUT_REQUESTS));
+    }
+    fprintf(stderr, "  %u subscribers per key: %.1f bytes per request in the bank's arena\n", subscribers,
+            (double)bank.get_arena().get_reserved() / FANOUT_REQUESTS);
+
+    unsigned long n = 0;
+    unsigned long sum = 0;
+    double t0 = mcci_bench_now();
+    while (n < total)
+    {
+        for (unsigned int k = 0; k < keys; ++k)
+        {
+            VarRevPair vr = fanout_key(k);
+            BasicVariableRevisionRequestBank<FibonacciHeap>::subscriber_iterator it = bank.subscribers_begin(vr);
+            BasicVariableRevisionRequestBank<FibonacciHeap>::subscriber_iterator end = bank.subscribers_end(vr);
+            for (; it != end; ++it, ++n) sum += *it;
+        }
+    }
+    mcci_bench_keep(sum);
+    report("fibonacci", "pool", subscribers, "fanout", n, mcci_bench_now() - t0);
+
+    t0 = mcci_bench_now();
+    for (unsigned int k = 0; k < keys; ++k)
+    {
+        VarRevPair vr = fanout_key(k);
+        bank.remove_by_key(vr);
+    }
+    report("fibonacci", "pool", subscribers, "fulfil", FANOUT_REQUESTS, mcci_bench_now() - t0);
+
+    if (!bank.empty()) g_failed = true;
+}
+
+
+// the six banks of a server holding `size` requests between them, and data arriving for
+//  random (host, variable, revision)s: each packet looks its subscribers up in every bank
+//  (op "lookup"), and gathers them into a table of clients to send to, as process_data
+//  does (op "deliver").  the keys are drawn from DELIVER_HOSTS hosts, DELIVER_VARS
+//  variables and DELIVER_REVS upcoming revisions
+#define DELIVER_HOSTS 16
+#define DELIVER_VARS 256
+#define DELIVER_REVS 8
+
+struct DeliverBanks
+{
+    AllRequestBank all;
+    HostRequestBank host;
+    VariableRequestBank var;
+    HostVariableRequestBank hostvar;
+    RemoteRevisionRequestBank remote;
+    VariableRevisionRequestBank varrev;
+
+    DeliverBanks()
+      : all(REPLAY_CLIENTS, 1), host(REPLAY_CLIENTS, DELIVER_HOSTS), var(REPLAY_CLIENTS, DELIVER_VARS),
+        hostvar(REPLAY_CLIENTS, DELIVER_HOSTS * DELIVER_VARS),
+        remote(REPLAY_CLIENTS, DELIVER_HOSTS * DELIVER_VARS, DELIVER_REVS),
+        varrev(REPLAY_CLIENTS, DELIVER_VARS, DELIVER_REVS) {}
+
+    // call f with each subscriber to data from host h for revision r of variable v
+    template <typename F> void subscribers(MCCI_NODE_ADDRESS_T h, MCCI_VARIABLE_T v, MCCI_REVISION_T r, F &f) const
+    {
+        HostVarPair hv;
+        hv.host = h;
+        hv.var = v;
+        HostVarRevTuple hvr;
+        hvr.host = h;
+        hvr.var = v;
+        hvr.rev = r;
+        VarRevPair vr;
+        vr.var = v;
+        vr.rev = r;
+
+        for (AllRequestBank::subscriber_iterator it = all.subscribers_begin(1); it != all.subscribers_end(1); ++it)
+            f(*it);
+        for (HostRequestBank::subscriber_iterator it = host.subscribers_begin(h); it != host.subscribers_end(h); ++it)
+            f(*it);
+        for (VariableRequestBank::subscriber_iterator it = var.subscribers_begin(v); it != var.subscribers_end(v); ++it)
+            f(*it);
+        for (HostVariableRequestBank::subscriber_iterator it = hostvar.subscribers_begin(hv);
+             it != hostvar.subscribers_end(hv); ++it)
+            f(*it);
+        for (RemoteRevisionRequestBank::subscriber_iterator it = remote.subscribers_begin(hvr);
+             it != remote.subscribers_end(hvr); ++it)
+            f(*it);
+        for (VariableRevisionRequestBank::subscriber_iterator it = varrev.subscribers_begin(vr);
+             it != varrev.subscribers_end(vr); ++it)
+            f(*it);
+    }
+};
+
+struct CountSubscribers
+{
+    unsigned long n;
+    CountSubscribers() : n(0) {}
+    void operator()(MCCI_CLIENT_ID_T c) { n += 1 + c; }
+};
+
+struct GatherSubscribers
+{
+    LinearHash<MCCI_CLIENT_ID_T, bool> hits;
+    GatherSubscribers() : hits(100) {}
+    void operator()(MCCI_CLIENT_ID_T c) { hits[c] = true; }
+};
+
+void bench_deliver(unsigned int size, unsigned long total)
+{
+    DeliverBanks banks;
+    uint32_t x = 8191;
+
+    // a few subscribers to everything, and the rest split among the other banks
+    banks.all.add(1, 0, size);
+    banks.all.add(1, 1, size);
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        MCCI_NODE_ADDRESS_T h = (x >> 8) % DELIVER_HOSTS;
+        MCCI_VARIABLE_T v = (x >> 12) % DELIVER_VARS;
+        MCCI_REVISION_T r = 1 + (x >> 20) % DELIVER_REVS;
+        MCCI_CLIENT_ID_T c = (x >> 24) % REPLAY_CLIENTS;
+        HostVarPair hv;
+        hv.host = h;
+        hv.var = v;
+        HostVarRevTuple hvr;
+        hvr.host = h;
+        hvr.var = v;
+        hvr.rev = r;
+        VarRevPair vr;
+        vr.var = v;
+        vr.rev = r;
+
+        switch (i % 5)
+        {
+          case 0: banks.host.add(h, c, size); break;
+          case 1: banks.var.add(v, c, size); break;
+          case 2: banks.hostvar.add(hv, c, size); break;
+          case 3: banks.remote.add(hvr, c, size); break;
+          default: banks.varrev.add(vr, c, size); break;
+        }
+    }
+
+    vector<uint32_t> packets(4096);
+    for (unsigned int i = 0; i < packets.size(); ++i) packets[i] = x = x * 1103515245 + 12345;
+
+    CountSubscribers count;
+    double t0 = mcci_bench_now();
+    for (unsigned long i = 0; i < total; ++i)
+    {
+        uint32_t p = packets[i % packets.size()];
+        banks.subscribers((p >> 8) % DELIVER_HOSTS, (p >> 12) % DELIVER_VARS, 1 + (p >> 20) % DELIVER_REVS, count);
+    }
+    mcci_bench_keep(count.n);
+    report("fibonacci", "pool", size, "lookup", total, mcci_bench_now() - t0);
+
+    unsigned long sent = 0;
+    t0 = mcci_bench_now();
+    for (unsigned long i = 0; i < total; ++i)
+    {
+        uint32_t p = packets[i % packets.size()];
+        GatherSubscribers gather;
+        banks.subscribers((p >> 8) % DELIVER_HOSTS, (p >> 12) % DELIVER_VARS, 1 + (p >> 20) % DELIVER_REVS, gather);
+        for (LinearHash<MCCI_CLIENT_ID_T, bool>::iterator it = gather.hits.begin(); it != gather.hits.end(); ++it)
+            sent += it->first;
+    }
+    mcci_bench_keep(sent);
+    report("fibonacci", "pool", size, "deliver", total, mcci_bench_now() - t0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+template <template <typename, typename, typename> class Queue>
+void bench_queue(const char* name, unsigned int size, unsigned long total)
+{
+    typedef typename Queue<uint32_t, uint32_t, std::allocator<char> >::Node Node;
+
+    {
+        Queue<uint32_t, uint32_t, std::allocator<Node> > heap;
+        bench_expire(name, "malloc", heap, size, total);
+        bench_cancel(name, "malloc", heap, size, total);
+        bench_renew(name, "malloc", heap, size, total);
+    }
+
+    {
+        CMCCIArena arena;
+        Queue<uint32_t, uint32_t, CMCCIArenaAllocator<Node> > heap((CMCCIArenaAllocator<Node>(&arena)));
+        bench_expire(name, "pool", heap, size, total);
+        bench_cancel(name, "pool", heap, size, total);
+        bench_renew(name, "pool", heap, size, total);
+        fprintf(stderr, "  %s: %.1f bytes per request in the queue's arena\n", name,
+                (double)arena.get_reserved() / size);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned long total = 1000000;
+    unsigned int sizes[] = {100, 1000, 10000, 100000};
+
+    if (1 < argc) total = strtoul(argv[1], NULL, 10);
+    if (!total)
+    {
+        fprintf(stderr, "usage: %s [operations per measurement]\n", argv[0]);
+        return 1;
+    }
+
+    mcci_bench_header("heap,alloc,size,op,ops,seconds,ns_per_op");
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        fprintf(stderr, "%u requests outstanding\n", sizes[s]);
+        bench_queue<FibonacciHeap>("fibonacci", sizes[s], total);
+        bench_queue<CompactFibonacciHeap>("compact", sizes[s], total);
+        bench_queue<PairingHeap>("pairing", sizes[s], total);
+        bench_queue<DaryHeap>("dary", sizes[s], total);
+        bench_queue<TimingWheel>("wheel", sizes[s], total);
+
+        vector<Event> events;
+        unsigned long expired = 0;
+        record_events(sizes[s], total, events);
+        bench_replay<FibonacciHeap>("fibonacci", sizes[s], events, expired);
+        bench_replay<CompactFibonacciHeap>("compact", sizes[s], events, expired);
+        bench_replay<PairingHeap>("pairing", sizes[s], events, expired);
+        bench_replay<DaryHeap>("dary", sizes[s], events, expired);
+        bench_replay<TimingWheel>("wheel", sizes[s], events, expired);
+
+        bench_storm<FibonacciHeap>("fibonacci", sizes[s]);
+        bench_storm<CompactFibonacciHeap>("compact", sizes[s]);
+        bench_storm<PairingHeap>("pairing", sizes[s]);
+        bench_storm<DaryHeap>("dary", sizes[s]);
+        bench_storm<TimingWheel>("wheel", sizes[s]);
+
+        bench_admit<FibonacciHeap>("fibonacci", sizes[s]);
+        bench_admit<CompactFibonacciHeap>("compact", sizes[s]);
+        bench_admit<PairingHeap>("pairing", sizes[s]);
+        bench_admit<DaryHeap>("dary", sizes[s]);
+        bench_admit<TimingWheel>("wheel", sizes[s]);
+
+        bench_deliver(sizes[s], total);
+    }
+
+    // subscribers fanned out to, from a few per key to a thousand
+    fprintf(stderr, "%u requests outstanding\n", FANOUT_REQUESTS);
+    unsigned int fanouts[] = {1, 10, 100, 1000};
+    for (unsigned int f = 0; f < sizeof(fanouts) / sizeof(fanouts[0]); ++f)
+        bench_fanout(fanouts[f], total);
+
+    // and the two Fibonacci heaps at the size of a busy server
+    fprintf(stderr, "1000000 requests outstanding\n");
+    bench_storm<FibonacciHeap>("fibonacci", 1000000);
+    bench_storm<CompactFibonacciHeap>("compact", 1000000);
+
+    if (g_failed) fprintf(stderr, "ERROR: a heap lost track of its requests, or expired different ones\n");
+    return g_failed ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+
+#include "MCCIBench.h"
+#include "MCCIRequestBanks.h"
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+/**
+   mcci_bench_timeouts: a variable/revision request bank run through a timeout trace shaped
+   like a server's, once on each queue a RequestBank can keep its timeouts in
+   (FibonacciHeap, CompactFibonacciHeap, PairingHeap, DaryHeap and TimingWheel).
+
+   The trace is recorded once per size, and replayed through each bank.  Clients subscribe
+   to the next revision of a variable at Poisson-distributed times, each with a lease of
+   LEASE ticks; about half renew their subscription three quarters of the way through its
+   lease, for as long as the revision hasn't been produced.  Productions also come at
+   Poisson-distributed times, each fulfilling everyone waiting on the revision with
+   remove_by_key; and every ENFORCE_PERIOD ticks, whatever is past its lease expires with
+   pop_expired, as enforce_timeouts does.  Subscriptions arrive at a rate that keeps about
+   `size` requests outstanding.
+
+   Each operation is timed on its own, so the latencies include a clock read (some tens of
+   nanoseconds); the "all" row's ops_per_sec is from the time of the whole replay.
+
+   usage: mcci_bench_timeouts [operations per measurement]
+
+   One CSV row per measurement on stdout:
+     bench,queue,size,op,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns
+ */
+
+
+#define LEASE 1000
+#define ENFORCE_PERIOD 10
+#define TRACE_CLIENTS 100
+
+
+bool g_failed = false;
+
+
+struct Op
+{
+    enum { SUBSCRIBE, FULFIL, ENFORCE, KINDS } op;
+    VarRevPair key;
+    MCCI_CLIENT_ID_T client;
+    MCCI_TIME_T time;  // the timeout to subscribe with, or the time to enforce
+};
+
+const char* op_names[] = {"subscribe", "fulfil", "enforce"};
+
+
+// a uniform number in (0, 1), and the wait until the next event of a Poisson process
+struct TraceRandom
+{
+    uint64_t x;
+
+    TraceRandom(uint64_t seed) : x(seed) {}
+
+    double uniform()
+    {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        return ((x >> 11) + 0.5) / 9007199254740992.0;
+    }
+
+    double wait(double rate) { return -log(this->uniform()) / rate; }
+
+    unsigned int below(unsigned int n) { return (unsigned int)(this->uniform() * n); }
+};
+
+
+void record_trace(unsigned int size, unsigned long total, vector<Op> &ops)
+{
+    unsigned int vars = size / 8 + 1;
+    double arrivals = (double)size / LEASE;             // new subscriptions per tick
+    double productions = (double)vars / (2 * LEASE);    // about half are fulfilled in time
+    vector<MCCI_REVISION_T> revision(vars + 1, 0);
+    multimap<MCCI_TIME_T, Op> renewals;
+    TraceRandom random(size);
+
+    double next_arrival = random.wait(arrivals);
+    double next_production = random.wait(productions);
+    Op o;
+    for (MCCI_TIME_T now = 1; ops.size() < total; ++now)
+    {
+        for (; next_arrival < now; next_arrival += random.wait(arrivals))
+        {
+            o.op = Op::SUBSCRIBE;
+            o.key.var = 1 + random.below(vars);
+            o.key.rev = revision[o.key.var] + 1;
+            o.client = random.below(TRACE_CLIENTS);
+            o.time = now + LEASE;
+            ops.push_back(o);
+            if (random.uniform() < 0.5) renewals.insert(make_pair(now + LEASE * 3 / 4, o));
+        }
+
+        while (!renewals.empty() && renewals.begin()->first <= now)
+        {
+            o = renewals.begin()->second;
+            renewals.erase(renewals.begin());
+            if (revision[o.key.var] >= o.key.rev) continue;  // fulfilled already
+
+            o.time = now + LEASE;
+            ops.push_back(o);
+            if (random.uniform() < 0.5) renewals.insert(make_pair(now + LEASE * 3 / 4, o));
+        }
+
+        for (; next_production < now; next_production += random.wait(productions))
+        {
+            o.op = Op::FULFIL;
+            o.key.var = 1 + random.below(vars);
+            o.key.rev = ++revision[o.key.var];
+            ops.push_back(o);
+        }
+
+        if (0 == now % ENFORCE_PERIOD)
+        {
+            o.op = Op::ENFORCE;
+            o.time = now;
+            ops.push_back(o);
+        }
+    }
+}
+
+
+// one row: the count, total time and rate of some operations, and their latency percentiles
+void report(const char* queue, unsigned int size, const char* op, vector<double> &latencies,
+            double seconds)
+{
+    if (latencies.empty()) return;
+
+    unsigned long n = latencies.size();
+    if (!seconds)
+        for (unsigned long i = 0; i < n; ++i) seconds += latencies[i];
+
+    double p[3] = {0.5, 0.99, 0.999};
+    double ns[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        vector<double>::iterator at = latencies.begin() + (unsigned long)(p[i] * (n - 1));
+        nth_element(latencies.begin(), at, latencies.end());
+        ns[i] = *at * 1e9;
+    }
+    double most = *max_element(latencies.begin(), latencies.end()) * 1e9;
+
+    printf("timeouts,%s,%u,%s,%lu,%.6f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+           queue, size, op, n, seconds, n / seconds, ns[0], ns[1], ns[2], most);
+}
+
+
+template <template <typename, typename, typename> class Queue>
+void bench_trace(const char* name, unsigned int size, const vector<Op> &ops, unsigned long &expired)
+{
+    BasicVariableRevisionRequestBank<Queue> bank(TRACE_CLIENTS, size / 8 + 1, 8);
+    vector<double> latencies[Op::KINDS];
+    unsigned long n = 0;
+
+    for (int k = 0; k < Op::KINDS; ++k) latencies[k].reserve(ops.size());
+
+    double start = mcci_bench_now();
+    for (unsigned long i = 0; i < ops.size(); ++i)
+    {
+        const Op &o = ops[i];
+        double t0 = mcci_bench_now();
+        switch (o.op)
+        {
+          case Op::SUBSCRIBE:
+            bank.add(o.key, o.client, o.time);
+            break;
+
+          case Op::FULFIL:
+            if (bank.contains(o.key)) bank.remove_by_key(o.key);
+            break;
+
+          case Op::ENFORCE:
+            n += bank.pop_expired(o.time);
+            break;
+
+          default:
+            break;
+        }
+        latencies[o.op].push_back(mcci_bench_now() - t0);
+    }
+    double seconds = mcci_bench_now() - start;
+
+    vector<double> all;
+    all.reserve(ops.size());
+    for (int k = 0; k < Op::KINDS; ++k)
+    {
+        all.insert(all.end(), latencies[k].begin(), latencies[k].end());
+        report(name, size, op_names[k], latencies[k], 0);
+    }
+    report(name, size, "all", all, seconds);
+
+    // every queue must expire the same requests
+    if (!expired) expired = n;
+    if (n != expired) g_failed = true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    unsigned long total = 1000000;
+    unsigned int sizes[] = {1000, 10000, 100000};
+
+    if (1 < argc) total = strtoul(argv[1], NULL, 10);
+    if (!total)
+    {
+        fprintf(stderr, "usage: %s [operations per measurement]\n", argv[0]);
+        return 1;
+    }
+
+    mcci_bench_header("queue,size,op,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns");
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        vector<Op> ops;
+        unsigned long expired = 0;
+        record_trace(sizes[s], total, ops);
+        fprintf(stderr, "about %u requests outstanding, %lu operations\n", sizes[s], (unsigned long)ops.size());
+
+        bench_trace<FibonacciHeap>("fibonacci", sizes[s], ops, expired);
+        bench_trace<CompactFibonacciHeap>("compact", sizes[s], ops, expired);
+        bench_trace<PairingHeap>("pairing", sizes[s], ops, expired);
+        bench_trace<DaryHeap>("dary", sizes[s], ops, expired);
+        bench_trace<TimingWheel>("wheel", sizes[s], ops, expired);
+        fprintf(stderr, "  %lu expired\n", expired);
+    }
+
+    if (g_failed) fprintf(stderr, "ERROR: the queues expired different numbers of requests\n");
+    return g_failed ? 1 : 0;
+}
@@ -3,17 +3,80 @@
 
 #include "MCCITypes.h"
 #include "LinearHash.h"
+#include "LinearHashFlat.h"
 #include "FibonacciHeap.h"
+#include "TimingWheel.h"
+#include "PairingHeap.h"
+#include "DaryHeap.h"
+#include "CompactFibonacciHeap.h"
+#include "ClientMap.h"
+#include "MCCIArena.h"
 #include <map>
+#include <unordered_set>
 #include <list>
 #include <ostream>
 
 using namespace std;
 
+
+// the counters in RequestBankStats are only kept when this is 1; otherwise the code that
+//  keeps them is compiled out, and get_stats() is all zeros.  the Fibonacci heap's own
+//  are kept if FIBONACCI_HEAP_STATS
+#ifndef REQUEST_BANK_STATS
+#define REQUEST_BANK_STATS 0
+#endif
+
+// what a RequestBank has done since it was made (or its stats reset)
+struct RequestBankStats
+{
+    unsigned long adds;              // new requests, singly or in batches
+    unsigned long renewals;          // requests added again, moving their timeouts
+    unsigned long batches;           // calls to add_batch
+    unsigned long fulfilments;       // calls to remove_by_key
+    unsigned long fulfilled;         // the requests they removed
+    unsigned long expiry_calls;      // pop_expired
+    unsigned long expired;           // by pop_expired and remove_minimum
+    unsigned int most_expired;       // by one pop_expired
+    FibonacciHeapStats timeouts;     // the queue's, if it's a FibonacciHeap
+
+    RequestBankStats()
+      : adds(0), renewals(0), batches(0), fulfilments(0), fulfilled(0),
+        expiry_calls(0), expired(0), most_expired(0) {}
+};
+
+inline ostream& operator<<(ostream& out, const RequestBankStats& s)
+{
+    return out << "adds=" << s.adds << " renewals=" << s.renewals << " batches=" << s.batches
+               << " fulfilments=" << s.fulfilments << " fulfilled=" << s.fulfilled
+               << " expiry_calls=" << s.expiry_calls << " expired=" << s.expired
+               << " most_expired=" << s.most_expired << " timeouts: " << s.timeouts;
+}
+
+// the counters of a bank's timeout queue: only a FibonacciHeap keeps any
+template <typename Queue> FibonacciHeapStats timeout_stats(const Queue&) { return FibonacciHeapStats(); }
+template <typename K, typename D, typename A> FibonacciHeapStats timeout_stats(const FibonacciHeap<K, D, A>& q)
+{ return q.stats(); }
+
+template <typename Queue> void reset_timeout_stats(Queue&) {}
+template <typename K, typename D, typename A> void reset_timeout_stats(FibonacciHeap<K, D, A>& q)
+{ q.reset_stats(); }
+
+
+// whether RequestBank::add_batch builds a batch in a queue of its own and merges it in.
+//  a TimingWheel is too big to make per batch (and inserts in O(1) anyway), and a
+//  CompactFibonacciHeap would take a chunk in with every batch, so theirs are added in place
+template <typename Queue> struct TimeoutsMergeBatches { static const bool value = true; };
+template <typename K, typename D, typename A> struct TimeoutsMergeBatches<TimingWheel<K, D, A> >
+{ static const bool value = false; };
+template <typename K, typename D, typename A> struct TimeoutsMergeBatches<CompactFibonacciHeap<K, D, A> >
+{ static const bool value = false; };
+
+
 // declare class to enable declaration of ostream operator
-template <typename KeySet> class RequestBank;
-template <typename KeySet>
-ostream& operator<<(ostream &, const RequestBank<KeySet>&);
+template <typename Derived, typename KeySet, template <typename, typename, typename> class Timeouts>
+class RequestBank;
+template <typename Derived, typename KeySet, template <typename, typename, typename> class Timeouts>
+ostream& operator<<(ostream &, const RequestBank<Derived, KeySet, Timeouts>&);
 
 
 /**
@@ -21,8 +84,45 @@ ostream& operator<<(ostream &, const RequestBank<KeySet>&);
    given key (key set, implementation depending), and removed both by the key 
    and by the passing of time.  the number of open requests per subscriber is
    tracked.
+
+   the tables that find requests by key are the derived class's, and so is turning a key
+   set into keys: Derived is the final bank class (as in class B : public RequestBank<B,
+   ...>), and RequestBank reaches them through it, so there are no virtual calls and they
+   can all be inlined.  Derived must provide
+     HeapNode* get_by_fq(key_set, client_id) const;   add_by_fq(key_set, client_id, node)
+     SubscriptionMap* get_by_pq(key_set) const;        remove_by_fq(key_set, client_id)
+     remove_by_pq(key_set);                            remove_all()
+   which RequestBankOneKey and RequestBankTwoKeys do, given get_key (or get_key_1 and
+   get_key_2) from the class below them.
+
+   each bank keeps its heap nodes and subscription maps in an arena of its own, which
+   reuses what removed requests give back; RequestBankTwoKeys keeps both levels of its
+   tables there too.  (RequestBankOneKey's flat or dense table is a few big arrays, which
+   those storages take from the global heap.)  releasing the arena frees all of it at
+   once.
+
+   the timeouts are kept in a Timeouts<MCCI_TIME_T, LookupSet, Alloc>, one of
+     FibonacciHeap (the default), CompactFibonacciHeap (the same, with its nodes linked
+     by 32-bit index in chunks), PairingHeap, DaryHeap, or TimingWheel (whose renewals
+     and cancellations are O(1)).
+   any class template that looks like them will do.  the pointer to a Timeouts::Node
+   returned by insert() is the request's handle, and must stay valid until the node is
+   removed.  the queue must provide:
+     Node* insert(key, data);          Node::key(), Node::data()
+     Node* minimum() const;            void remove_minimum();
+     unsigned int pop_expired(key, cb), calling cb(const Node*) for each node with a key
+       before the given one as it is removed
+     void remove(Node*, minus_infinity);
+     void alter_key(Node*, key, minus_infinity);
+     bool empty() const;               unsigned int size() const;
+     void clear(), removing every node in one pass
+     void merge(Queue& other), taking all of other's nodes (from the same allocator)
+       without moving them, and leaving it empty (see TimeoutsMergeBatches)
+     a constructor from the allocator, and operator<< for printing
+   (minus_infinity, a key below any in use, is only needed by FibonacciHeap.)
  */
-template<typename KeySet>
+template<typename Derived, typename KeySet,
+         template <typename, typename, typename> class Timeouts = FibonacciHeap>
 class RequestBank
 {
   public:
@@ -36,23 +136,43 @@ class RequestBank
     friend std::ostream& operator<<(std::ostream &out, LookupSet const &rhs)
     { return out << "(key_set " << rhs.key_set << ", client_id " << rhs.client_id << ")"; }
 
+    // one entry of a batch for add_batch
+    typedef struct
+    {
+        KeySet key_set;
+        MCCI_CLIENT_ID_T client_id;
+        MCCI_TIME_T timeout;
+    } Request;
+
+    // the timeouts, with their nodes in the bank's arena
+    typedef CMCCIArenaAllocator<LookupSet> TimeoutAllocator;
+    typedef Timeouts<MCCI_TIME_T, LookupSet, TimeoutAllocator> TimeoutHeap;
+
     // holds the time-sensitive view of the data
-    typedef FibonacciHeapNode<MCCI_TIME_T, LookupSet> HeapNode;
+    typedef typename TimeoutHeap::Node HeapNode;
 
-    // holds the subscription information
-    typedef map<MCCI_CLIENT_ID_T, HeapNode*> SubscriptionMap;
+    // holds the subscription information, in the bank's arena: the few subscribers of a
+    //  typical key inside the map, and more in arrays of its own
+    typedef CMCCIArenaAllocator<pair<MCCI_CLIENT_ID_T, HeapNode*> > SubscriptionMapAllocator;
+    typedef ClientMap<MCCI_CLIENT_ID_T, HeapNode*, SubscriptionMapAllocator> SubscriptionMap;
 
     // for iterating over subscriber information
     typedef typename SubscriptionMap::iterator SubscriptionMapIterator;
     
+  protected:
+    // constructed before, and released after, everything kept in it
+    CMCCIArena m_arena;
+
   private:
     unsigned int* m_outstanding_requests; // FIXME -- convert to vector
     unsigned int m_max_client_id;
-    FibonacciHeap<MCCI_TIME_T, LookupSet> m_timeouts;
+    TimeoutHeap m_timeouts;
+    RequestBankStats m_stats;  // only kept if REQUEST_BANK_STATS; not its timeouts
 
 
   public:
     RequestBank(unsigned int max_client_id)
+      : m_timeouts(TimeoutAllocator(&m_arena))
     {
         this->m_outstanding_requests = new unsigned int[max_client_id]();
         this->m_max_client_id = max_client_id;
@@ -60,9 +180,9 @@ class RequestBank
         //this->m_timeouts.m_debug = true;
     }
     
-    virtual ~RequestBank() { delete[] this->m_outstanding_requests; }
+    ~RequestBank() { delete[] this->m_outstanding_requests; }
 
-    friend std::ostream& operator<<(ostream &out, RequestBank<KeySet> const &rhs)
+    friend std::ostream& operator<<(ostream &out, RequestBank<Derived, KeySet, Timeouts> const &rhs)
     { return out << rhs.m_timeouts; }
     
     
@@ -74,7 +194,7 @@ class RequestBank
     {
         if (client_id > this->m_max_client_id) throw string("Client ID too high");
          
-        HeapNode* n = this->get_by_fq(key_set, client_id);
+        HeapNode* n = this->derived().get_by_fq(key_set, client_id);
 
         // early exit for brand new nodes; just add them
         if (NULL == n)
@@ -86,9 +206,10 @@ class RequestBank
             n = this->m_timeouts.insert(timeout, l);
             if (!n) throw string("Couldn't insert new node");
 
-            this->add_by_fq(key_set, client_id, n);
+            this->derived().add_by_fq(key_set, client_id, n);
             
             this->m_outstanding_requests[client_id] += 1; // add what wasn't there
+            if (REQUEST_BANK_STATS) ++this->m_stats.adds;
 
             return;
         }
@@ -97,15 +218,86 @@ class RequestBank
         // assert n->data().client_id == client_id
         
         this->m_timeouts.alter_key(n, timeout, 0);
+        if (REQUEST_BANK_STATS) ++this->m_stats.renewals;
 
         return;  // no action
     }
 
+    // add (OR UPDATE) a batch of entries, with the same result as add()ing them in order.
+    //  the new ones are put in a queue of their own, which is merged into the bank's in
+    //  one step, so a burst touches the bank's queue once rather than once per request
+    //  (unless TimeoutsMergeBatches says otherwise)
+    void add_batch(vector<Request> const &requests)
+    {
+        for (unsigned int i = 0; i < requests.size(); ++i)
+            if (requests[i].client_id > this->m_max_client_id) throw string("Client ID too high");
+        if (REQUEST_BANK_STATS) ++this->m_stats.batches;
+
+        if (!TimeoutsMergeBatches<TimeoutHeap>::value)
+        {
+            for (unsigned int i = 0; i < requests.size(); ++i)
+                this->add(requests[i].key_set, requests[i].client_id, requests[i].timeout);
+            return;
+        }
+
+        // a request already held is renewed where it is: in the bank's queue, or in the
+        //  batch if it was added earlier in this one
+        TimeoutHeap batch((TimeoutAllocator(&this->m_arena)));
+        unordered_set<HeapNode*> added;
+        try
+        {
+            for (unsigned int i = 0; i < requests.size(); ++i)
+            {
+                Request const &r = requests[i];
+                HeapNode* n = this->derived().get_by_fq(r.key_set, r.client_id);
+                if (NULL != n)
+                {
+                    if (added.count(n))
+                        batch.alter_key(n, r.timeout, 0);
+                    else
+                        this->m_timeouts.alter_key(n, r.timeout, 0);
+                    if (REQUEST_BANK_STATS) ++this->m_stats.renewals;
+                    continue;
+                }
+
+                LookupSet l;
+                l.key_set = r.key_set;
+                l.client_id = r.client_id;
+
+                n = batch.insert(r.timeout, l);
+                if (!n) throw string("Couldn't insert new node");
+
+                // a node the tables don't know about mustn't outlive this
+                try
+                {
+                    added.insert(n);
+                    this->derived().add_by_fq(r.key_set, r.client_id, n);
+                }
+                catch (...)
+                {
+                    added.erase(n);
+                    batch.remove(n, 0);
+                    throw;
+                }
+                this->m_outstanding_requests[r.client_id] += 1;
+                if (REQUEST_BANK_STATS) ++this->m_stats.adds;
+            }
+        }
+        catch (...)
+        {
+            // the requests added before the failure are held, as add() would have left them
+            this->m_timeouts.merge(batch);
+            throw;
+        }
+
+        this->m_timeouts.merge(batch);
+    }
+
     // whether there are any requests
     bool empty() const { return this->m_timeouts.empty(); }
 
     // number of requests
-    bool size() const { return this->m_timeouts.size(); }
+    unsigned int size() const { return this->m_timeouts.size(); }
     
     // get the timeout of the node that will expire first
     MCCI_TIME_T minimum_timeout() const { return this->m_timeouts.minimum()->key(); }
@@ -115,9 +307,37 @@ class RequestBank
     {
         LookupSet l = this->m_timeouts.minimum()->data();
         
-        this->remove_by_fq(l.key_set, l.client_id);
+        this->derived().remove_by_fq(l.key_set, l.client_id);
         this->m_outstanding_requests[l.client_id] -= 1;
         this->m_timeouts.remove_minimum();
+        if (REQUEST_BANK_STATS) ++this->m_stats.expired;
+    }
+
+    // remove every request whose timeout is before `now`, in no particular order, passing
+    //  each one's LookupSet to cb.  the queue is walked once, and put back in order once,
+    //  rather than once per request.  returns the number removed
+    template <typename Callback> unsigned int pop_expired(MCCI_TIME_T now, Callback cb)
+    {
+        Expire<Callback> expire(this, cb);
+        unsigned int expired = this->m_timeouts.pop_expired(now, expire);
+        if (REQUEST_BANK_STATS)
+        {
+            ++this->m_stats.expiry_calls;
+            this->m_stats.expired += expired;
+            if (expired > this->m_stats.most_expired) this->m_stats.most_expired = expired;
+        }
+        return expired;
+    }
+
+    unsigned int pop_expired(MCCI_TIME_T now) { return this->pop_expired(now, IgnoreExpired()); }
+
+    // remove every request, in time linear in their number.  the memory goes back to the
+    //  arena for the bank to reuse
+    void clear()
+    {
+        this->m_timeouts.clear();
+        this->derived().remove_all();
+        fill(this->m_outstanding_requests, this->m_outstanding_requests + this->m_max_client_id, 0);
     }
 
     
@@ -126,30 +346,35 @@ class RequestBank
     {
         SubscriptionMap* removals;
         
-        removals = this->get_by_pq(key_set);
+        removals = this->derived().get_by_pq(key_set);
+        if (REQUEST_BANK_STATS)
+        {
+            ++this->m_stats.fulfilments;
+            this->m_stats.fulfilled += removals->size();
+        }
 
         // remove all the nodes and adjust the open requests listing
         for (SubscriptionMapIterator it = removals->begin(); it != removals->end(); ++it)
         {
-            this->m_outstanding_requests[it->first] =- 1;
+            this->m_outstanding_requests[it->first] -= 1;
             this->m_timeouts.remove(it->second, 0);
             // remove op has deleted the allocated memory
         }
 
         // remove all custom structure nodes in one shot
-        this->remove_by_pq(key_set);
+        this->derived().remove_by_pq(key_set);
     }
     
     // does this structure contain the given node?
     bool contains(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const
     {
-        return this->get_by_fq(key_set, client_id);
+        return this->derived().get_by_fq(key_set, client_id);
     }
 
     // does this structure contain the given key set?
     bool contains(KeySet const key_set) const
     {
-        return this->get_by_pq(key_set);
+        return this->derived().get_by_pq(key_set);
     }
     
     // number of open requests for a given client
@@ -158,25 +383,49 @@ class RequestBank
         return this->m_outstanding_requests[client_id];
     }
 
+    // the memory that holds this bank's subscriptions
+    const CMCCIArena& get_arena() const { return this->m_arena; }
+
+    // counters of the bank's work, and its queue's (see REQUEST_BANK_STATS)
+    RequestBankStats get_stats() const
+    {
+        RequestBankStats s = this->m_stats;
+        s.timeouts = timeout_stats(this->m_timeouts);
+        return s;
+    }
+
+    void reset_stats()
+    {
+        this->m_stats = RequestBankStats();
+        reset_timeout_stats(this->m_timeouts);
+    }
+
     
-    // iterator class that just covers the client ids -- the keys
-    class subscriber_iterator : public SubscriptionMapIterator
+    // iterator class that just covers the client ids -- the keys.  the subscribers of a
+    //  key are contiguous, so this steps along an array
+    class subscriber_iterator
     {
+        SubscriptionMapIterator m_it;
+
       public:
-        subscriber_iterator() : SubscriptionMapIterator() {}
-        subscriber_iterator(SubscriptionMapIterator s) : SubscriptionMapIterator(s) {}
+        subscriber_iterator() : m_it(NULL) {}
+        subscriber_iterator(SubscriptionMapIterator s) : m_it(s) {}
 
-        MCCI_CLIENT_ID_T* operator->() const
-        { return (MCCI_CLIENT_ID_T* const)&(SubscriptionMapIterator::operator->()->first); }
+        MCCI_CLIENT_ID_T* operator->() const { return &this->m_it->first; }
         
-        MCCI_CLIENT_ID_T operator*() const
-        { return SubscriptionMapIterator::operator*().first; }
+        MCCI_CLIENT_ID_T operator*() const { return this->m_it->first; }
+
+        subscriber_iterator& operator++() { ++this->m_it; return *this; }
+        subscriber_iterator operator++(int) { return subscriber_iterator(this->m_it++); }
+
+        bool operator==(const subscriber_iterator &rhs) const { return this->m_it == rhs.m_it; }
+        bool operator!=(const subscriber_iterator &rhs) const { return this->m_it != rhs.m_it; }
     };
 
     // iteration points: begin
     subscriber_iterator subscribers_begin(KeySet const key_set) const
     {
-        SubscriptionMap* sm = this->get_by_pq(key_set);
+        SubscriptionMap* sm = this->derived().get_by_pq(key_set);
         if (sm) return sm->begin();
         return subscriber_iterator();
     }
@@ -184,30 +433,48 @@ class RequestBank
     // iteration points: begin
     subscriber_iterator subscribers_end(KeySet const key_set) const
     {
-        SubscriptionMap* sm = this->get_by_pq(key_set);
+        SubscriptionMap* sm = this->derived().get_by_pq(key_set);
         if (sm) return sm->end();
         return subscriber_iterator();
    }
     
   protected:
 
-    // return a pointer to a heap node based on the fully-qualified information, NULL if d.n.e.
-    // (fully-qualified information means key set and client id)
-    virtual HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const = 0;
+    // takes each expired request out of the tables as the queue lets go of its node
+    template <typename Callback> struct Expire
+    {
+        RequestBank<Derived, KeySet, Timeouts>* bank;
+        Callback cb;
 
-    // return a pointer to a client_id -> heapnode map based on the partially-qualified info
-    virtual SubscriptionMap* get_by_pq(KeySet const key_set) const = 0;
-    
-    // assume that this entry is unique and add it to the structure
-    virtual void add_by_fq(KeySet const key_set,
-                           MCCI_CLIENT_ID_T client_id,
-                           HeapNode* const node_ptr) = 0;
+        Expire(RequestBank<Derived, KeySet, Timeouts>* b, Callback c) : bank(b), cb(c) {}
 
-    // remove a node from the custom container (not the heap) based on its key
-    virtual void remove_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) = 0;
+        void operator()(const HeapNode* n)
+        {
+            LookupSet l = n->data();
+            this->bank->derived().remove_by_fq(l.key_set, l.client_id);
+            this->bank->m_outstanding_requests[l.client_id] -= 1;
+            this->cb(l);
+        }
+    };
 
-    // remove a partially-qualified set of nodes from the custom container (don't delete HeapNodes)
-    virtual void remove_by_pq(KeySet const key_set) = 0;
+    struct IgnoreExpired { void operator()(LookupSet const &) const {} };
+
+    // an empty subscription map, placed in the arena along with its nodes
+    SubscriptionMap* new_subscription_map()
+    {
+        void* p = this->m_arena.allocate(sizeof(SubscriptionMap));
+        return new (p) SubscriptionMap(SubscriptionMapAllocator(&this->m_arena));
+    }
+
+    void delete_subscription_map(SubscriptionMap* m)
+    {
+        m->~SubscriptionMap();
+        this->m_arena.deallocate(m, sizeof(SubscriptionMap));
+    }
+
+    // the bank this is, whose tables hold the requests
+    Derived& derived() { return static_cast<Derived&>(*this); }
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
 
 };
 
@@ -218,104 +485,106 @@ class RequestBank
 
 
 
-// class that stores requests using a single key into a linear hash
-template<typename KeySet, typename Key>
-    class RequestBankOneKey : public RequestBank<KeySet>
+// class that stores requests using a single key into a linear hash.  Derived provides
+//  Key get_key(KeySet) const
+template<typename Derived, typename KeySet, typename Key,
+         template <typename, typename, typename> class Timeouts = FibonacciHeap>
+    class RequestBankOneKey : public RequestBank<Derived, KeySet, Timeouts>
 {
 
   public:
-    typedef typename RequestBank<KeySet>::HeapNode HeapNode;
-    typedef typename RequestBank<KeySet>::SubscriptionMap SubscriptionMap;
-    typedef typename RequestBank<KeySet>::subscriber_iterator subscriber_iterator;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::HeapNode HeapNode;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::SubscriptionMap SubscriptionMap;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::SubscriptionMapIterator SubscriptionMapIterator;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::subscriber_iterator subscriber_iterator;
         
   protected:
-    typedef LinearHash<Key, SubscriptionMap*> LinearHashBank;
+    // host and variable ids index the bank directly; wider keys are hashed
+    typedef LinearHash<Key, SubscriptionMap*, typename LinearHashTraits<Key, LinearHashFlat>::storage> LinearHashBank;
     typedef typename LinearHashBank::iterator LinearHashBankIterator;
     
     LinearHashBank m_bank;
 
   public:
     
-    virtual Key get_key(KeySet const key_set) const = 0; //{ return (Key)key_set; };
-    
     RequestBankOneKey(unsigned int max_clients, unsigned int size)
-      : RequestBank<KeySet>(max_clients)
+      : RequestBank<Derived, KeySet, Timeouts>(max_clients)
     {
         this->m_bank.resize_nearest_prime(size);
     }
     
-    virtual ~RequestBankOneKey()
-    {
-        // free all map objects that exist in LinearHashBank.
-        LinearHashBankIterator it;
-        for (it = this->m_bank.begin(); it != this->m_bank.end(); ++it)
-            if (NULL != it->second)
-                delete it->second;
-    }
+    // the map objects live in the arena, which frees them all at once
+    ~RequestBankOneKey() {}
 
     // assume that this entry is unique and add it to the structure
-    virtual void add_by_fq(KeySet const key_set,
-                           MCCI_CLIENT_ID_T client_id,
-                           HeapNode* const node_ptr)
+    void add_by_fq(KeySet const key_set,
+                   MCCI_CLIENT_ID_T client_id,
+                   HeapNode* const node_ptr)
     {
-        Key k = this->get_key(key_set);
-
         // init hash entry if it doesn't exist
-        this->m_bank.has_key(k);
-        if (!this->m_bank.has_key(k))
-        {
-            this->m_bank[k] = new SubscriptionMap();
-            if (NULL == this->m_bank[k]) throw string("Couldn't allocate new SubscriptionMap");
-        }
+        SubscriptionMap* &m = this->m_bank.try_emplace(this->derived().get_key(key_set), (SubscriptionMap*)NULL).first->second;
+        if (NULL == m) m = this->new_subscription_map();
 
-        (*(this->m_bank[k]))[client_id] = node_ptr;  // add to map
+        (*m)[client_id] = node_ptr;  // add to map
     }
     
     // return a pointer to a heap node based on the fully-qualified information, NULL if d.n.e.
     // (fully-qualified information means key set and client id)
-    virtual HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const
+    HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const
     {
-        Key k = this->get_key(key_set);
-
-        if (!this->m_bank.has_key(k)) return NULL;
+        LinearHashBankIterator it = this->m_bank.find(this->derived().get_key(key_set));
+        if (this->m_bank.end() == it) return NULL;
 
-        if (NULL == this->m_bank[k])
+        if (NULL == it->second)
         {
             stringstream s;
-            s << "Improper cleanup is happening, key = " << k;
+            s << "Improper cleanup is happening, key = " << it->first;
             throw string(s.str());
         }
 
-        if (this->m_bank[k]->find(client_id) == this->m_bank[k]->end()) return NULL;
-
-        return (*(this->m_bank[k]))[client_id];
+        SubscriptionMapIterator sit = it->second->find(client_id);
+        return it->second->end() == sit ? NULL : sit->second;
     }
 
     // return a pointer to a client_id -> heapnode map based on the partially-qualified info
-    virtual SubscriptionMap* get_by_pq(KeySet const key_set) const
+    SubscriptionMap* get_by_pq(KeySet const key_set) const
     {
-        Key k = this->get_key(key_set);
-        return this->m_bank.has_key(k) ? this->m_bank[k] : NULL;
+        LinearHashBankIterator it = this->m_bank.find(this->derived().get_key(key_set));
+        return this->m_bank.end() == it ? NULL : it->second;
     }
 
     // remove a node from the custom container (not the heap) based on its key
-    virtual void remove_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id)
+    void remove_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id)
     {
-        Key k = this->get_key(key_set);
-        this->m_bank[k]->erase(client_id);
+        LinearHashBankIterator it = this->m_bank.find(this->derived().get_key(key_set));
+        if (this->m_bank.end() == it) return;
+
+        it->second->erase(client_id);
 
         // clean up if the subscriber map is empty
-        if (this->m_bank[k]->empty()) this->remove_by_pq(key_set);
+        if (it->second->empty())
+        {
+            this->delete_subscription_map(it->second);
+            this->m_bank.erase(it);
+        }
     }
 
     // remove a partially-qualified set of nodes from the custom container (don't delete HeapNodes)
-    virtual void remove_by_pq(KeySet const key_set)
+    void remove_by_pq(KeySet const key_set)
     {
-        Key k = this->get_key(key_set);
-        
-        delete this->m_bank[k];
-        this->m_bank[k] = NULL;
-        this->m_bank.remove(k);
+        LinearHashBankIterator it = this->m_bank.find(this->derived().get_key(key_set));
+        if (this->m_bank.end() == it) return;
+
+        this->delete_subscription_map(it->second);
+        this->m_bank.erase(it);
+    }
+
+    // empty the custom container (don't delete HeapNodes)
+    void remove_all()
+    {
+        for (LinearHashBankIterator it = this->m_bank.begin(); it != this->m_bank.end(); ++it)
+            this->delete_subscription_map(it->second);
+        this->m_bank.clear();
     }
 };
 
@@ -323,119 +592,143 @@ template<typename KeySet, typename Key>
 ////////////////////////////////////////////////////////////////////////////////
 
 
-template<typename KeySet, typename Key1, typename Key2>
-    class RequestBankTwoKeys : public RequestBank<KeySet>
+// class that stores requests under two keys, a linear hash of linear hashes.  Derived
+//  provides Key1 get_key_1(KeySet) const and Key2 get_key_2(KeySet) const
+template<typename Derived, typename KeySet, typename Key1, typename Key2,
+         template <typename, typename, typename> class Timeouts = FibonacciHeap>
+    class RequestBankTwoKeys : public RequestBank<Derived, KeySet, Timeouts>
 {
   public:
-    typedef typename RequestBank<KeySet>::HeapNode HeapNode;
-    typedef typename RequestBank<KeySet>::SubscriptionMap SubscriptionMap;
-    typedef typename RequestBank<KeySet>::subscriber_iterator subscriber_iterator;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::HeapNode HeapNode;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::SubscriptionMap SubscriptionMap;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::SubscriptionMapIterator SubscriptionMapIterator;
+    typedef typename RequestBank<Derived, KeySet, Timeouts>::subscriber_iterator subscriber_iterator;
 
   protected:
-    typedef LinearHash<Key2, SubscriptionMap*> LinearHashKey2;
-    typedef LinearHash<Key1, LinearHashKey2> LinearHashKey1;
+    // both levels are chained, so their trees come from the bank's arena
+    typedef CMCCIArenaAllocator<pair<const Key2, SubscriptionMap*> > LinearHashKey2Allocator;
+    typedef LinearHash<Key2, SubscriptionMap*, LinearHashChained,
+                       typename LinearHashDefaultHash<LinearHashChained>::type,
+                       LinearHashKey2Allocator> LinearHashKey2;
+
+    // the outer keys may be composite, like (host << 16) + var, so they are mixed and the
+    //  table is a power of 2
+    typedef CMCCIArenaAllocator<pair<const Key1, LinearHashKey2> > LinearHashKey1Allocator;
+    typedef LinearHash<Key1, LinearHashKey2, LinearHashChained, LinearHashMultiplyShift,
+                       LinearHashKey1Allocator> LinearHashKey1;
 
     typedef typename LinearHashKey2::iterator LinearHashKey2Iterator;
     typedef typename LinearHashKey1::iterator LinearHashKey1Iterator;
     
-    LinearHashKey1 m_bank;
+    // the table itself is in the arena too, and is never destroyed: the arena frees it
+    LinearHashKey1* m_bank;
     unsigned int m_size_key1;
     unsigned int m_size_key2;
 
   public:
     RequestBankTwoKeys(unsigned int max_clients, unsigned int num_key1, unsigned int num_key2)
-        : RequestBank<KeySet>(max_clients)
+        : RequestBank<Derived, KeySet, Timeouts>(max_clients)
     {
         this->m_size_key1 = num_key1;
         this->m_size_key2 = num_key2;
-        this->m_bank.resize_nearest_prime(this->m_size_key1);
-    }
-    
-    virtual Key1 get_key_1(KeySet const key_set) const = 0;
-    virtual Key2 get_key_2(KeySet const key_set) const = 0;
 
-    virtual ~RequestBankTwoKeys()
-    {
-        LinearHashKey1Iterator it1;
-        LinearHashKey2Iterator it2;
-        
-        // free all map objects that exist in LinearHash.
-        for (it1 = this->m_bank.begin(); it1 != this->m_bank.end(); ++it1)
-            // TODO: it1->second == m_bank[it1->first] ?
-            for (it2 = this->m_bank[it1->first].begin(); it2 != this->m_bank[it1->first].end(); ++it2)
-                if (NULL != it2->second)
-                    delete it2->second;
+        void* p = this->m_arena.allocate(sizeof(LinearHashKey1));
+        this->m_bank = new (p) LinearHashKey1(LinearHashKey1Allocator(&this->m_arena));
+        this->m_bank->resize_power_of_two(this->m_size_key1);
     }
+    
+    // both tables and the map objects live in the arena, which frees them all at once
+    ~RequestBankTwoKeys() {}
 
     // assume that this entry is unique and add it to the structure
-    virtual void add_by_fq(KeySet const key_set,
-                           MCCI_CLIENT_ID_T client_id,
-                           HeapNode* const node_ptr)
+    void add_by_fq(KeySet const key_set,
+                   MCCI_CLIENT_ID_T client_id,
+                   HeapNode* const node_ptr)
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
-
-        // init hash entry if it doesn't exist
-        if (!this->m_bank.has_key(k1)) this->m_bank[k1].resize_nearest_prime(this->m_size_key2);
-        if (!this->m_bank[k1].has_key(k2)) this->m_bank[k1][k2] = new SubscriptionMap();
-        if (NULL == this->m_bank[k1][k2]) throw string("Couldn't allocate new SubscriptionMap");
-        (*(this->m_bank[k1][k2]))[client_id] = node_ptr;  // add to map
+        // init hash entries if they don't exist
+        pair<LinearHashKey1Iterator, bool> r =
+            this->m_bank->try_emplace(this->derived().get_key_1(key_set), LinearHashKey2Allocator(&this->m_arena));
+        LinearHashKey2 &bank2 = r.first->second;
+        if (r.second) bank2.resize_nearest_prime(this->m_size_key2);
+
+        SubscriptionMap* &m = bank2.try_emplace(this->derived().get_key_2(key_set), (SubscriptionMap*)NULL).first->second;
+        if (NULL == m) m = this->new_subscription_map();
+        (*m)[client_id] = node_ptr;  // add to map
     }
     
     // return a pointer to a heap node based on the fully-qualified information, NULL if d.n.e.
     // (fully-qualified information means key set and client id)
-    virtual HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const 
-    {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
-        if (!this->m_bank.has_key(k1)) return NULL;
-        if (!this->m_bank[k1].has_key(k2)) return NULL;
-        if (NULL == this->m_bank[k1][k2]) throw string("k1 and k2 point to NULL");
-        if (this->m_bank[k1][k2]->find(client_id) == this->m_bank[k1][k2]->end()) return NULL;
-        return (*(this->m_bank[k1][k2]))[client_id];
+    HeapNode* get_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id) const 
+    {
+        LinearHashKey1Iterator it1 = this->m_bank->find(this->derived().get_key_1(key_set));
+        if (this->m_bank->end() == it1) return NULL;
+
+        LinearHashKey2Iterator it2 = it1->second.find(this->derived().get_key_2(key_set));
+        if (it1->second.end() == it2) return NULL;
+
+        if (NULL == it2->second) throw string("k1 and k2 point to NULL");
+        SubscriptionMapIterator sit = it2->second->find(client_id);
+        return it2->second->end() == sit ? NULL : sit->second;
     }
 
     // return a pointer to a client_id -> heapnode map based on the partially-qualified info
-    virtual SubscriptionMap* get_by_pq(KeySet const key_set) const
+    SubscriptionMap* get_by_pq(KeySet const key_set) const
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
+        LinearHashKey1Iterator it1 = this->m_bank->find(this->derived().get_key_1(key_set));
+        if (this->m_bank->end() == it1) return NULL;
 
-        if (!this->m_bank.has_key(k1)) return NULL;
-        if (!this->m_bank[k1].has_key(k2)) return NULL;
-        return this->m_bank[k1][k2];
+        LinearHashKey2Iterator it2 = it1->second.find(this->derived().get_key_2(key_set));
+        return it1->second.end() == it2 ? NULL : it2->second;
     }
 
     // remove a node from the custom container (not the heap) based on its key
-    virtual void remove_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id)
+    void remove_by_fq(KeySet const key_set, MCCI_CLIENT_ID_T client_id)
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
-        SubscriptionMap* m = this->m_bank[k1][k2];
-        
+        LinearHashKey1Iterator it1 = this->m_bank->find(this->derived().get_key_1(key_set));
+        if (this->m_bank->end() == it1) return;
+
+        LinearHashKey2Iterator it2 = it1->second.find(this->derived().get_key_2(key_set));
+        if (it1->second.end() == it2) return;
+
+        SubscriptionMap* m = it2->second;
         m->erase(client_id);
         
         if (m->empty())
         {
-            delete m;
-            this->m_bank[k1][k2] = NULL;
-            this->m_bank[k1].remove(k2);
-
-            if (this->m_bank[k1].empty())
-            {
-                this->m_bank.remove(k1);
-            }
+            this->delete_subscription_map(m);
+            this->erase(it1, it2);
         }
     }
 
     // remove a partially-qualified set of nodes from the custom container (don't delete HeapNodes)
-    virtual void remove_by_pq(KeySet const key_set)
+    void remove_by_pq(KeySet const key_set)
+    {
+        LinearHashKey1Iterator it1 = this->m_bank->find(this->derived().get_key_1(key_set));
+        if (this->m_bank->end() == it1) return;
+
+        LinearHashKey2Iterator it2 = it1->second.find(this->derived().get_key_2(key_set));
+        if (it1->second.end() == it2) return;
+
+        this->delete_subscription_map(it2->second);
+        this->erase(it1, it2);
+    }
+
+    // empty the custom container (don't delete HeapNodes); the inner tables go with the outer
+    void remove_all()
     {
-        Key1 k1 = this->get_key_1(key_set);
-        Key2 k2 = this->get_key_2(key_set);
+        for (LinearHashKey1Iterator it1 = this->m_bank->begin(); it1 != this->m_bank->end(); ++it1)
+            for (LinearHashKey2Iterator it2 = it1->second.begin(); it2 != it1->second.end(); ++it2)
+                this->delete_subscription_map(it2->second);
+        this->m_bank->clear();
+    }
 
-        delete this->m_bank[k1][k2];
-        this->m_bank[k1][k2] = NULL;
+  protected:
+
+    // drop an inner entry, and the outer one along with it if nothing is left
+    void erase(LinearHashKey1Iterator it1, LinearHashKey2Iterator it2)
+    {
+        it1->second.erase(it2);
+        if (it1->second.empty()) this->m_bank->erase(it1);
     }
 };
 
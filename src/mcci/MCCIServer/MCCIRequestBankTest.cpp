@@ -1,4 +1,8 @@
 
+// these tests check the banks' counters, so they are kept
+#define REQUEST_BANK_STATS 1
+#define FIBONACCI_HEAP_STATS 1
+
 #include "MCCIRequestBank.h"
 #include "MCCIRequestBanks.h"
 #include <string>
@@ -7,13 +11,13 @@
 using namespace std;
 
 
-class TestRequestBank : public RequestBankOneKey<int, int>
+class TestRequestBank : public RequestBankOneKey<TestRequestBank, int, int>
 {
   public:
     TestRequestBank(unsigned int max_clients, unsigned int size) :
-    RequestBankOneKey<int, int>(max_clients, size) { }
+    RequestBankOneKey<TestRequestBank, int, int>(max_clients, size) { }
 
-    virtual int get_key(int const key_set) const { return key_set; }
+    int get_key(int const key_set) const { return key_set; }
 };
 
 
@@ -32,18 +36,18 @@ inline std::ostream& operator<<(std::ostream &out, KeyPair const &rhs)
 { return out << "(key1 " << rhs.key1 << ", key2 " << rhs.key2 << ")"; }
   
 
-class Test2KeyRequestBank : public RequestBankTwoKeys<KeyPair, short, long>
+class Test2KeyRequestBank : public RequestBankTwoKeys<Test2KeyRequestBank, KeyPair, short, long>
 {
   public:
     Test2KeyRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
-        RequestBankTwoKeys<KeyPair, short, long>(max_clients, size1, size2) { }
+        RequestBankTwoKeys<Test2KeyRequestBank, KeyPair, short, long>(max_clients, size1, size2) { }
 
-    virtual short get_key_1(KeyPair key_set) const
+    short get_key_1(KeyPair key_set) const
     {
         return key_set.key1;
     }
 
-    virtual long get_key_2(KeyPair key_set) const
+    long get_key_2(KeyPair key_set) const
     {
         return key_set.key2;
     }
@@ -190,6 +194,397 @@ void test3()
     VariableRevisionRequestBank m_bank_varrev(mxc, 100, 20);
 }
 
+// fulfilled requests must leave nothing behind, so the same keys can be requested again
+void test4()
+{
+    Test2KeyRequestBank bb(501, 10, 10);
+
+    for (int round = 0; round < 3; ++round)
+    {
+        printf("\nRound %d: adding 2 clients for key (8, 800)", round);
+        bb.add(new_kp(8, 800), 3, 5008);
+        bb.add(new_kp(8, 800), 4, 5009);
+        bb.add(new_kp(8, 900), 4, 5010);
+
+        printf("\nRequestbank contains key (8, 800) for client 4? %d", bb.contains(new_kp(8, 800), 4)); // 1
+
+        bb.remove_by_key(new_kp(8, 800));
+        printf("\nAfter remove_by_key, contains key (8, 800)? %d", bb.contains(new_kp(8, 800))); // 0
+        printf("\n                     contains key (8, 900)? %d", bb.contains(new_kp(8, 900))); // 1
+        if (bb.contains(new_kp(8, 800))) throw string("remove_by_key left the key behind");
+        if (!bb.contains(new_kp(8, 900), 4)) throw string("remove_by_key took a neighbouring key");
+
+        bb.remove_minimum();
+    }
+
+    printf("\nRequestbank is empty after all that? %d", bb.empty());
+}
+
+
+// subscribe and fulfil the same keys over and over, returning the bank's footprint
+size_t churn(Test2KeyRequestBank &bb, int rounds)
+{
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (int k = 0; k < 50; ++k)
+            for (int c = 0; c < 4; ++c)
+                bb.add(new_kp(k % 7, k * 100), c, 1000 * round + k + 1);
+
+        for (int k = 0; k < 50; ++k) bb.remove_by_key(new_kp(k % 7, k * 100));
+        if (!bb.empty()) throw string("churn left requests behind");
+    }
+    return bb.get_arena().get_reserved();
+}
+
+// a bank's arena reuses what fulfilled requests give back
+void test5()
+{
+    Test2KeyRequestBank pooled(501, 10, 10);
+
+    size_t pooled_warm = churn(pooled, 1);
+    size_t pooled_after = churn(pooled, 20);
+    printf("\nPooled arena: %lu bytes after 1 round, %lu after 20 more", pooled_warm, pooled_after);
+    if (pooled_warm != pooled_after) throw string("pooled arena grew under churn");
+    if (pooled.get_arena().get_in_use() > pooled_after) throw string("arena in-use count is off");
+
+    // leave requests outstanding; the bank is torn down with them in place
+    for (int k = 0; k < 50; ++k) pooled.add(new_kp(k, k), 1, k + 1);
+}
+
+
+// two variable/revision banks must hold the same requests, and agree on what's next to go
+template <typename Reference, typename Bank>
+void check_banks_agree(Reference &heap, Bank &other, MCCI_TIME_T now, const string &name)
+{
+    if (!other.empty() && now > other.minimum_timeout())
+        throw name + " kept an expired request";
+    if (heap.empty() != other.empty()
+        || (!heap.empty() && heap.minimum_timeout() != other.minimum_timeout()))
+        throw name + " has a different next timeout";
+
+    for (MCCI_CLIENT_ID_T c = 0; c < 10; ++c)
+        if (heap.get_outstanding_request_count(c) != other.get_outstanding_request_count(c))
+            throw name + " counts a client's requests differently";
+
+    for (MCCI_VARIABLE_T v = 1; v <= 5; ++v)
+        for (MCCI_REVISION_T r = 0; r < 7; ++r)
+            for (MCCI_CLIENT_ID_T c = 0; c < 10; ++c)
+            {
+                VarRevPair vr;
+                vr.var = v;
+                vr.rev = r;
+                if (heap.contains(vr, c) != other.contains(vr, c))
+                    throw name + " bank differs from heap bank";
+            }
+}
+
+// the same traffic through a bank on another timeout queue and one on the Fibonacci heap:
+//  renewals, fulfilments and expiry must leave both holding the same requests after every tick
+template <template <typename, typename, typename> class Timeouts>
+void compare_banks(const char* name)
+{
+    BasicVariableRevisionRequestBank<FibonacciHeap> heap(100, 10, 10);
+    BasicVariableRevisionRequestBank<Timeouts> other(100, 10, 10);
+    unsigned int x = 1;
+    unsigned int expired = 0;
+
+    for (MCCI_TIME_T now = 1; now < 3000; ++now)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            VarRevPair vr;
+            vr.var = 1 + (x >> 8) % 5;
+            vr.rev = (x >> 12) % 7;
+            MCCI_CLIENT_ID_T c = (x >> 16) % 10;
+            MCCI_TIME_T t = now + 1 + (x >> 20) % (0 == i ? 20 : 700);  // new, or a renewal
+
+            heap.add(vr, c, t);
+            other.add(vr, c, t);
+
+            if (0 == (x >> 24) % 11)
+            {
+                heap.remove_by_key(vr);
+                other.remove_by_key(vr);
+            }
+        }
+
+        // one at a time from the reference, all at once from the other
+        unsigned int due = 0;
+        while (!heap.empty() && now > heap.minimum_timeout())
+        {
+            heap.remove_minimum();
+            ++due;
+        }
+        if (due != other.pop_expired(now))
+            throw string(name) + " expired a different number of requests";
+        check_banks_agree(heap, other, now, name);
+        expired += due;
+    }
+
+    printf("\nFibonacci heap and %s banks agree through %u expiries", name, expired);
+}
+
+// bursts of requests for runs of revisions, added one at a time to the reference and as a
+//  batch to the other; a burst may renew requests, and name the same one twice
+template <template <typename, typename, typename> class Timeouts>
+void compare_batches(const char* name)
+{
+    typedef BasicVariableRevisionRequestBank<Timeouts> Bank;
+    BasicVariableRevisionRequestBank<FibonacciHeap> heap(100, 10, 10);
+    Bank other(100, 10, 10);
+    vector<typename Bank::Request> batch;
+    unsigned int x = 7;
+    unsigned int added = 0;
+
+    for (MCCI_TIME_T now = 1; now < 2000; ++now)
+    {
+        x = x * 1103515245 + 12345;
+        batch.clear();
+        for (unsigned int i = 0; i < (x >> 8) % 9; ++i)
+        {
+            typename Bank::Request r;
+            r.key_set.var = 1 + (x >> 12) % 5;
+            r.key_set.rev = (((x >> 16) % 7) + i % 6) % 7;  // 6 and 7 repeat 0 and 1
+            r.client_id = (0 == i % 4) ? (x >> 20) % 10 : (x >> 24) % 10;
+            r.timeout = now + 1 + (x >> 4) % 300 + i;
+            batch.push_back(r);
+
+            heap.add(r.key_set, r.client_id, r.timeout);
+        }
+        other.add_batch(batch);
+        added += batch.size();
+
+        if (0 == (x >> 28) % 5)
+        {
+            VarRevPair vr;
+            vr.var = 1 + (x >> 12) % 5;
+            vr.rev = (x >> 16) % 7;
+            if (heap.contains(vr))
+            {
+                heap.remove_by_key(vr);
+                other.remove_by_key(vr);
+            }
+        }
+
+        while (!heap.empty() && now > heap.minimum_timeout()) heap.remove_minimum();
+        other.pop_expired(now);
+        check_banks_agree(heap, other, now, string(name) + " (batched)");
+    }
+
+    printf("\nrequests added singly and in batches of up to 8 agree for %s, %u added", name, added);
+}
+
+void test6()
+{
+    compare_banks<FibonacciHeap>("fibonacci heap");
+    compare_banks<CompactFibonacciHeap>("compact fibonacci heap");
+    compare_banks<TimingWheel>("timing wheel");
+    compare_banks<PairingHeap>("pairing heap");
+    compare_banks<DaryHeap>("d-ary heap");
+
+    compare_batches<FibonacciHeap>("fibonacci heap");
+    compare_batches<CompactFibonacciHeap>("compact fibonacci heap");
+    compare_batches<TimingWheel>("timing wheel");
+    compare_batches<PairingHeap>("pairing heap");
+    compare_batches<DaryHeap>("d-ary heap");
+}
+
+// fill a bank, clear it, and fill it again: each time it must come back empty, with the
+//  arena's memory reused
+template <typename Bank>
+void fill_and_clear(Bank &b, const char* name, size_t &in_use, size_t &reserved)
+{
+    for (int k = 0; k < 300; ++k)
+        for (int c = 0; c < 4; ++c)
+            b.add(new_kp(k % 7, k * 100), c, (k * 37) % 101 + 1);
+
+    b.clear();
+    if (!b.empty()) throw string(name) + " isn't empty after clear";
+    for (int c = 0; c < 4; ++c)
+        if (b.get_outstanding_request_count(c)) throw string(name) + " still counts requests after clear";
+    if (b.contains(new_kp(3, 300), 1)) throw string(name) + " still holds a request after clear";
+
+    if (in_use && (in_use != b.get_arena().get_in_use() || reserved != b.get_arena().get_reserved()))
+        throw string(name) + " arena isn't back where it was after clear";
+    in_use = b.get_arena().get_in_use();
+    reserved = b.get_arena().get_reserved();
+}
+
+void test7()
+{
+    Test2KeyRequestBank bb(10, 10, 10);
+    size_t in_use = 0, reserved = 0;
+    for (int i = 0; i < 3; ++i) fill_and_clear(bb, "two-key bank", in_use, reserved);
+    printf("\nTwo-key bank cleared three times, %lu bytes in use after each", in_use);
+
+    BasicVariableRevisionRequestBank<TimingWheel> vr(10, 10, 10);
+    for (MCCI_REVISION_T r = 1; r < 200; ++r)
+    {
+        VarRevPair k;
+        k.var = r % 5 + 1;
+        k.rev = r;
+        vr.add(k, r % 10, r);
+    }
+    vr.clear();
+    if (!vr.empty() || vr.get_outstanding_request_count(3)) throw string("variable/revision bank isn't empty after clear");
+}
+
+
+// the counters of a bank and its heap, through adds, renewals, a batch, a fulfilment
+//  and an expiry
+void test8()
+{
+    BasicVariableRevisionRequestBank<FibonacciHeap> b(10, 10, 10);
+    VarRevPair vr[5];
+    for (int i = 1; i <= 4; ++i)
+    {
+        vr[i].var = 1;
+        vr[i].rev = i;
+    }
+
+    b.add(vr[1], 1, 10);
+    b.add(vr[2], 1, 20);
+    b.add(vr[3], 1, 30);
+    b.add(vr[2], 1, 5);    // lowered
+    b.add(vr[3], 1, 40);   // raised
+
+    vector<BasicVariableRevisionRequestBank<FibonacciHeap>::Request> batch(2);
+    batch[0].key_set = vr[4];
+    batch[0].client_id = 1;
+    batch[0].timeout = 50;
+    batch[1].key_set = vr[1];
+    batch[1].client_id = 1;
+    batch[1].timeout = 15;  // raised
+    b.add_batch(batch);
+
+    b.remove_by_key(vr[4]);
+    if (3 != b.get_outstanding_request_count(1)) throw string("a fulfilment miscounted the client's requests");
+    if (2 != b.pop_expired(25)) throw string("expired the wrong requests");
+    if (1 != b.get_outstanding_request_count(1)) throw string("expiry miscounted the client's requests");
+
+    RequestBankStats s = b.get_stats();
+    cout << "\nbank counters: " << s;
+    if (4 != s.adds || 3 != s.renewals || 1 != s.batches)
+        throw string("counted adds wrong");
+    if (1 != s.fulfilments || 1 != s.fulfilled)
+        throw string("counted fulfilments wrong");
+    if (1 != s.expiry_calls || 2 != s.expired || 2 != s.most_expired)
+        throw string("counted expiry wrong");
+
+    // the batch's own queue did its insert
+    if (3 != s.timeouts.inserts || 1 != s.timeouts.keys_lowered || 2 != s.timeouts.keys_raised)
+        throw string("counted the heap's inserts and renewals wrong");
+    if (1 != s.timeouts.expiry_calls || 2 != s.timeouts.expired || !s.timeouts.consolidations)
+        throw string("counted the heap's expiry wrong");
+
+    b.reset_stats();
+    s = b.get_stats();
+    if (s.adds || s.expired || s.timeouts.inserts || s.timeouts.consolidations)
+        throw string("counters weren't reset");
+}
+
+
+// a subscription map against std::map, through growing past its inline entries, churn,
+//  and shrinking back: the same entries, found the same way, and all of them iterated
+void test9()
+{
+    CMCCIArena arena;
+    {
+        typedef ClientMap<MCCI_CLIENT_ID_T, int, CMCCIArenaAllocator<pair<MCCI_CLIENT_ID_T, int> > > Map;
+        Map m((CMCCIArenaAllocator<pair<MCCI_CLIENT_ID_T, int> >(&arena)));
+        map<MCCI_CLIENT_ID_T, int> reference;
+        unsigned int x = 11;
+
+        for (int i = 0; i < 100000; ++i)
+        {
+            x = x * 1103515245 + 12345;
+            unsigned int range = (i / 10000) % 2 ? 3000 : 12;  // few subscribers, then many
+            MCCI_CLIENT_ID_T c = (x >> 8) % range;
+
+            if ((x >> 20) % 3)
+            {
+                m[c] = i;
+                reference[c] = i;
+            }
+            else if (m.erase(c) != reference.erase(c))
+            {
+                throw string("subscription map erased differently");
+            }
+
+            if (m.size() != reference.size()) throw string("subscription map has the wrong size");
+            Map::iterator it = m.find(c);
+            if ((m.end() == it) != (0 == reference.count(c)) || (m.end() != it && it->second != reference[c]))
+                throw string("subscription map found the wrong entry");
+        }
+
+        unsigned int n = 0;
+        for (Map::iterator it = m.begin(); it != m.end(); ++it, ++n)
+            if (reference[it->first] != it->second) throw string("subscription map iterated a wrong entry");
+        if (n != reference.size()) throw string("subscription map iterated the wrong number");
+        printf("\nsubscription map agrees with std::map, %u entries at the end", n);
+    }
+    if (arena.get_in_use()) throw string("subscription map left memory behind");
+}
+
+
+// a bank whose tables refuse one key, as if they had run out of memory
+class RefusingRequestBank : public RequestBankOneKey<RefusingRequestBank, int, int>
+{
+  public:
+    RefusingRequestBank(unsigned int max_clients, unsigned int size) :
+    RequestBankOneKey<RefusingRequestBank, int, int>(max_clients, size) { }
+
+    int get_key(int const key_set) const { return key_set; }
+
+    void add_by_fq(int const key_set, MCCI_CLIENT_ID_T client_id, HeapNode* const node_ptr)
+    {
+        if (13 == key_set) throw string("refused");
+        RequestBankOneKey<RefusingRequestBank, int, int>::add_by_fq(key_set, client_id, node_ptr);
+    }
+};
+
+
+// a batch that fails part of the way through keeps what it added before the failure, as
+//  add() would, and nothing of the request that failed
+void test10()
+{
+    RefusingRequestBank b(10, 10);
+    b.add(1, 2, 40);
+
+    // adds 2 and 3, renews 1, renews the 3 it added, and fails on 13 before adding 4
+    vector<RefusingRequestBank::Request> batch(6);
+    int keys[] = {2, 3, 1, 3, 13, 4};
+    MCCI_TIME_T timeouts[] = {10, 30, 20, 5, 15, 15};
+    for (unsigned int i = 0; i < batch.size(); ++i)
+    {
+        batch[i].key_set = keys[i];
+        batch[i].client_id = 2;
+        batch[i].timeout = timeouts[i];
+    }
+
+    bool refused = false;
+    try
+    {
+        b.add_batch(batch);
+    }
+    catch (string s)
+    {
+        refused = "refused" == s;
+    }
+    if (!refused) throw string("batch didn't fail");
+
+    if (!b.contains(2, 2) || !b.contains(3, 2) || !b.contains(1, 2) || b.contains(13) || b.contains(4))
+        throw string("failed batch kept the wrong requests");
+    if (3 != b.get_outstanding_request_count(2)) throw string("failed batch counted the wrong requests");
+    if (b.minimum_timeout() != 5) throw string("failed batch's requests aren't in the bank's queue");
+
+    if (3 != b.pop_expired(100) || !b.empty() || b.get_outstanding_request_count(2))
+        throw string("failed batch's requests didn't expire");
+    printf("\nfailed batch kept the requests before the failure");
+}
+
+
 int main()
 {
     try
@@ -197,6 +592,13 @@ int main()
         test1();
         test2();
         test3();
+        test4();
+        test5();
+        test6();
+        test7();
+        test8();
+        test9();
+        test10();
     }
     catch (string s)
     {
@@ -7,23 +7,29 @@
 /**
 
   Various RequestBank types employed by MCCI
+
+  each is a template on the queue that keeps its timeouts (see RequestBank); the
+  typedefs below choose one per bank.  each passes itself to the class it derives from,
+  which finds its keys with it without a virtual call.
   
  */
 
 
-template<typename KeySet>
-class SinglePassthruKeyRequestBank : public RequestBankOneKey<KeySet, KeySet>
+template<typename KeySet, template <typename, typename, typename> class Timeouts = FibonacciHeap>
+class SinglePassthruKeyRequestBank
+: public RequestBankOneKey<SinglePassthruKeyRequestBank<KeySet, Timeouts>, KeySet, KeySet, Timeouts>
 {
   public:
     SinglePassthruKeyRequestBank(unsigned int max_clients, unsigned int size) :
-    RequestBankOneKey<KeySet, KeySet>(max_clients, size) { }
+    RequestBankOneKey<SinglePassthruKeyRequestBank<KeySet, Timeouts>, KeySet, KeySet, Timeouts>
+        (max_clients, size) { }
 
-    virtual KeySet get_key(KeySet const key_set) const { return key_set; }
+    KeySet get_key(KeySet const key_set) const { return key_set; }
 };
 
-typedef SinglePassthruKeyRequestBank<bool>                AllRequestBank;
-typedef SinglePassthruKeyRequestBank<MCCI_NODE_ADDRESS_T> HostRequestBank;
-typedef SinglePassthruKeyRequestBank<MCCI_VARIABLE_T>     VariableRequestBank;
+typedef SinglePassthruKeyRequestBank<bool, FibonacciHeap>                AllRequestBank;
+typedef SinglePassthruKeyRequestBank<MCCI_NODE_ADDRESS_T, FibonacciHeap> HostRequestBank;
+typedef SinglePassthruKeyRequestBank<MCCI_VARIABLE_T, FibonacciHeap>     VariableRequestBank;
 
 
 
@@ -33,18 +39,23 @@ inline std::ostream& operator<<(std::ostream &out, HostVarPair const &rhs)
 { return out << "(Host " << rhs.host << ", Var " << rhs.var << ")"; }
   
 
-class HostVariableRequestBank : public RequestBankOneKey<HostVarPair, uint32_t>
+template<template <typename, typename, typename> class Timeouts = FibonacciHeap>
+class BasicHostVariableRequestBank
+: public RequestBankOneKey<BasicHostVariableRequestBank<Timeouts>, HostVarPair, uint32_t, Timeouts>
 {
   public:
-    HostVariableRequestBank(unsigned int max_clients, unsigned int size) :
-    RequestBankOneKey<HostVarPair, uint32_t>(max_clients, size) { }
+    BasicHostVariableRequestBank(unsigned int max_clients, unsigned int size) :
+    RequestBankOneKey<BasicHostVariableRequestBank<Timeouts>, HostVarPair, uint32_t, Timeouts>
+        (max_clients, size) { }
 
-    virtual uint32_t get_key(HostVarPair const key_set) const
+    uint32_t get_key(HostVarPair const key_set) const
     {
         return (key_set.host << 16) + key_set.var;
     }
 };
 
+typedef BasicHostVariableRequestBank<FibonacciHeap> HostVariableRequestBank;
+
 
 
 typedef struct {MCCI_VARIABLE_T var; MCCI_REVISION_T rev; } VarRevPair;
@@ -53,24 +64,30 @@ inline std::ostream& operator<<(std::ostream &out, VarRevPair const &rhs)
 { return out << "(Var " << rhs.var << ", Rev " << rhs.rev << ")"; }
   
 
-class VariableRevisionRequestBank
-: public RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T>
+template<template <typename, typename, typename> class Timeouts = FibonacciHeap>
+class BasicVariableRevisionRequestBank
+: public RequestBankTwoKeys<BasicVariableRevisionRequestBank<Timeouts>,
+                            VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T, Timeouts>
 {
   public:
-  VariableRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
-    RequestBankTwoKeys<VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T> (max_clients, size1, size2) { }
+  BasicVariableRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
+    RequestBankTwoKeys<BasicVariableRevisionRequestBank<Timeouts>,
+                       VarRevPair, MCCI_VARIABLE_T, MCCI_REVISION_T, Timeouts>
+        (max_clients, size1, size2) { }
 
-    virtual MCCI_VARIABLE_T get_key_1(VarRevPair const key_set) const
+    MCCI_VARIABLE_T get_key_1(VarRevPair const key_set) const
     {
         return key_set.var;
     }
 
-    virtual MCCI_REVISION_T get_key_2(VarRevPair const key_set) const
+    MCCI_REVISION_T get_key_2(VarRevPair const key_set) const
     {
         return key_set.rev;
     }
 };
 
+typedef BasicVariableRevisionRequestBank<FibonacciHeap> VariableRevisionRequestBank;
+
 typedef struct {MCCI_NODE_ADDRESS_T host; MCCI_VARIABLE_T var; MCCI_REVISION_T rev; } HostVarRevTuple;
 
 inline std::ostream& operator<<(std::ostream &out, HostVarRevTuple const &rhs)
@@ -78,24 +95,30 @@ inline std::ostream& operator<<(std::ostream &out, HostVarRevTuple const &rhs)
 
 
 
-class RemoteRevisionRequestBank
-: public RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T>
+template<template <typename, typename, typename> class Timeouts = FibonacciHeap>
+class BasicRemoteRevisionRequestBank
+: public RequestBankTwoKeys<BasicRemoteRevisionRequestBank<Timeouts>,
+                            HostVarRevTuple, uint32_t, MCCI_REVISION_T, Timeouts>
 {
   public:
-  RemoteRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
-    RequestBankTwoKeys<HostVarRevTuple, uint32_t, MCCI_REVISION_T> (max_clients, size1, size2) { }
+  BasicRemoteRevisionRequestBank(unsigned int max_clients, unsigned int size1, unsigned int size2) :
+    RequestBankTwoKeys<BasicRemoteRevisionRequestBank<Timeouts>,
+                       HostVarRevTuple, uint32_t, MCCI_REVISION_T, Timeouts>
+        (max_clients, size1, size2) { }
 
-    virtual uint32_t get_key_1(HostVarRevTuple const key_set) const
+    uint32_t get_key_1(HostVarRevTuple const key_set) const
     {
         return (key_set.host << 16) + key_set.var;
     }
     
-    virtual MCCI_REVISION_T get_key_2(HostVarRevTuple const key_set) const
+    MCCI_REVISION_T get_key_2(HostVarRevTuple const key_set) const
     {
         return key_set.rev;
     }
 };
 
+typedef BasicRemoteRevisionRequestBank<FibonacciHeap> RemoteRevisionRequestBank;
+
     
 
 
@@ -166,9 +166,11 @@ void CMCCIRevisionSet::load(sqlite3* revision_db)
 
 }
 
-void CMCCIRevisionSet::check_revision(MCCI_VARIABLE_T variable_id)
+MCCI_REVISION_T& CMCCIRevisionSet::check_revision(MCCI_VARIABLE_T variable_id)
 {
-    if (!m_cache.has_key(variable_id))
+    LinearHash<MCCI_VARIABLE_T, MCCI_REVISION_T>::iterator it = m_cache.find(variable_id);
+
+    if (m_cache.end() == it)
     {
         //fprintf(stderr, "\ncheck_revision loading variable into cache");
         // bind placeholder #1 of the read statement to our new var id
@@ -176,8 +178,9 @@ void CMCCIRevisionSet::check_revision(MCCI_VARIABLE_T variable_id)
         sqlite3_bind_int(m_read, 2, m_signature_id);
         int result = sqlite3_step(m_read);  // look for the variable
         
+        MCCI_REVISION_T rev = 0; // matching the prepared statement, if we have to insert
         if (SQLITE_ROW == result)  // already exists
-            m_cache[variable_id] = sqlite3_column_int(m_read, 0); 
+            rev = sqlite3_column_int(m_read, 0); 
 
         // record any error
         string err = string("Error in check_revision: ") + string(sqlite3_errmsg(m_db));
@@ -185,46 +188,46 @@ void CMCCIRevisionSet::check_revision(MCCI_VARIABLE_T variable_id)
         sqlite3_clear_bindings(m_read);
         sqlite3_reset(m_read);
 
-        if (SQLITE_ROW   == result) return;   // we retrieved the value and are done
-        if (SQLITE_DONE != result) throw err; // "does not exist" is the only non-error case
-
-        //fprintf(stderr, "\ncheck_revision inserting variable into DB");
-        // getting here means we need to INSERT a new record
-        sqlite3_bind_int(m_insert, 1, variable_id);
-        sqlite3_bind_int(m_insert, 2, m_signature_id);
-        result = sqlite3_step(m_insert); 
-        sqlite3_clear_bindings(m_insert);
-        sqlite3_reset(m_insert);
-        
-        m_cache[variable_id] = 0; // matching the prepared statement
+        if (SQLITE_ROW != result)
+        {
+            if (SQLITE_DONE != result) throw err; // "does not exist" is the only non-error case
+
+            //fprintf(stderr, "\ncheck_revision inserting variable into DB");
+            // getting here means we need to INSERT a new record
+            sqlite3_bind_int(m_insert, 1, variable_id);
+            sqlite3_bind_int(m_insert, 2, m_signature_id);
+            result = sqlite3_step(m_insert); 
+            sqlite3_clear_bindings(m_insert);
+            sqlite3_reset(m_insert);
+        }
 
+        it = m_cache.try_emplace(variable_id, rev).first;
     }
-    
+
+    return it->second;
 }
 
 
 MCCI_REVISION_T CMCCIRevisionSet::get_revision(MCCI_VARIABLE_T variable_id)
 {
-    check_revision(variable_id);
-
-    return m_cache[variable_id];
+    return check_revision(variable_id);
 }
 
 
 MCCI_REVISION_T CMCCIRevisionSet::inc_revision(MCCI_VARIABLE_T variable_id)
 {
-    check_revision(variable_id);
+    MCCI_REVISION_T& rev = check_revision(variable_id);
 
     // immediate effect: memory
-    ++(m_cache[variable_id]);
+    ++rev;
 
     // UPDATE existing revision.
     // scheduled effect: db (delayed write, not synchronous)
-    sqlite3_bind_int(m_update, 1, m_cache[variable_id]);
+    sqlite3_bind_int(m_update, 1, rev);
     sqlite3_bind_int(m_update, 2, variable_id);
     sqlite3_bind_int(m_update, 3, m_signature_id);
     //fprintf(stderr, "\ninc_revision updating variable #%ld's rev to %ld",
-    //        (long)variable_id, (long)m_cache[variable_id]);
+    //        (long)variable_id, (long)rev);
     int result = sqlite3_step(m_update); 
     switch (result)
     {
@@ -242,6 +245,6 @@ MCCI_REVISION_T CMCCIRevisionSet::inc_revision(MCCI_VARIABLE_T variable_id)
     sqlite3_clear_bindings(m_update);
     sqlite3_reset(m_update);
 
-    return m_cache[variable_id];
+    return rev;
 
 }
@@ -59,8 +59,8 @@ class CMCCIRevisionSet
     void set_strict(bool v) { m_strict = v; };
     
   protected:
-    // put a variable in the DB if it's not there already
-    void check_revision(MCCI_VARIABLE_T variable_id);
+    // put a variable in the DB if it's not there already; return its cached revision
+    MCCI_REVISION_T& check_revision(MCCI_VARIABLE_T variable_id);
 
     // DB query for signature id, returns 0 if none exists
     int lookup_signature_id(string signature);
@@ -27,7 +27,7 @@ class CMCCISchema
 
   protected:
 
-    LinearHash<MCCI_VARIABLE_T, unsigned int> m_ordinality; // ordinality - variable ot ordinal
+    LinearHash<MCCI_VARIABLE_T, unsigned int> m_ordinality; // variable to ordinal
     vector<MCCI_VARIABLE_T>                   m_variable;   // ordinal to variable
     vector<string>                            m_name;       // the name of a variable, ordinal idx
 
@@ -51,8 +51,9 @@ class CMCCISchema
     // the ordinality of a variable
     unsigned int ordinality_of_variable(MCCI_VARIABLE_T variable_id)
     {
-        if (!m_ordinality.has_key(variable_id)) throw string("Tried to get ordinality of unknown var");
-        return m_ordinality[variable_id];
+        LinearHash<MCCI_VARIABLE_T, unsigned int>::iterator it = m_ordinality.find(variable_id);
+        if (m_ordinality.end() == it) throw string("Tried to get ordinality of unknown var");
+        return it->second;
     }
 
     // the variable of the ordinal
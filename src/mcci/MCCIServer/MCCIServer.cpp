@@ -16,6 +16,7 @@ CMCCIServer::CMCCIServer(CMCCITime* time,
     m_bank_hostvar(settings.max_clients, settings.bank_size_hostvar),
     m_bank_remote(settings.max_clients, settings.bank_size_remote_hostvar, settings.bank_size_remote_rev),
     m_bank_varrev(settings.max_clients, settings.bank_size_varrev_var, settings.bank_size_varrev_rev),
+    m_schedule(MCCI_BANKS),
     m_networking(networking)
 {
 
@@ -46,6 +47,7 @@ CMCCIServer::CMCCIServer(const CMCCIServer& rhs) :
     m_bank_varrev(rhs.m_settings.max_clients,
                   rhs.m_settings.bank_size_varrev_var,
                   rhs.m_settings.bank_size_varrev_rev),
+    m_schedule(MCCI_BANKS),
     m_networking(rhs.m_networking),
     m_time(rhs.m_time),
     m_external_time(rhs.m_external_time)
@@ -83,6 +85,7 @@ ostream& operator<<(ostream& out, const SMCCIServerSettings& rhs)
         << "\n\tBank size for var/rev's rev:\t" << rhs.bank_size_varrev_rev
         << "\n\tBank size for remote's host+var:\t" << rhs.bank_size_remote_hostvar
         << "\n\tBank size for remote's rev:\t" << rhs.bank_size_remote_rev
+        << "\n\tUnified timeouts:\t" << rhs.unified_timeouts
         ;
 
 }
@@ -162,6 +165,103 @@ int CMCCIServer::request_count() const
 }
 
 
+RequestBankStats CMCCIServer::get_bank_stats(unsigned int bank) const
+{
+    switch (bank)
+    {
+      case MCCI_BANK_ALL:     return m_bank_all.get_stats();
+      case MCCI_BANK_HOST:    return m_bank_host.get_stats();
+      case MCCI_BANK_VAR:     return m_bank_var.get_stats();
+      case MCCI_BANK_HOSTVAR: return m_bank_hostvar.get_stats();
+      case MCCI_BANK_REMOTE:  return m_bank_remote.get_stats();
+      case MCCI_BANK_VARREV:  return m_bank_varrev.get_stats();
+    }
+    throw string("No such request bank");
+}
+
+
+void CMCCIServer::reset_bank_stats()
+{
+    m_bank_all.reset_stats();
+    m_bank_host.reset_stats();
+    m_bank_var.reset_stats();
+    m_bank_hostvar.reset_stats();
+    m_bank_remote.reset_stats();
+    m_bank_varrev.reset_stats();
+}
+
+
+// the earliest timeout in a bank, if it has any
+template <typename Bank> static bool earliest_timeout(const Bank &bank, MCCI_TIME_T &deadline)
+{
+    if (bank.empty()) return false;
+    deadline = bank.minimum_timeout();
+    return true;
+}
+
+bool CMCCIServer::bank_deadline(unsigned int bank, MCCI_TIME_T &deadline) const
+{
+    switch (bank)
+    {
+      case MCCI_BANK_ALL:     return earliest_timeout(m_bank_all, deadline);
+      case MCCI_BANK_HOST:    return earliest_timeout(m_bank_host, deadline);
+      case MCCI_BANK_VAR:     return earliest_timeout(m_bank_var, deadline);
+      case MCCI_BANK_HOSTVAR: return earliest_timeout(m_bank_hostvar, deadline);
+      case MCCI_BANK_REMOTE:  return earliest_timeout(m_bank_remote, deadline);
+      case MCCI_BANK_VARREV:  return earliest_timeout(m_bank_varrev, deadline);
+    }
+    throw string("No such request bank");
+}
+
+
+void CMCCIServer::expire_bank(unsigned int bank, MCCI_TIME_T now)
+{
+    switch (bank)
+    {
+      case MCCI_BANK_ALL:     m_bank_all.pop_expired(now);     return;
+      case MCCI_BANK_HOST:    m_bank_host.pop_expired(now);    return;
+      case MCCI_BANK_VAR:     m_bank_var.pop_expired(now);     return;
+      case MCCI_BANK_HOSTVAR: m_bank_hostvar.pop_expired(now); return;
+      case MCCI_BANK_REMOTE:  m_bank_remote.pop_expired(now);  return;
+      case MCCI_BANK_VARREV:  m_bank_varrev.pop_expired(now);  return;
+    }
+    throw string("No such request bank");
+}
+
+
+void CMCCIServer::reschedule(unsigned int bank)
+{
+    if (!m_settings.unified_timeouts) return;
+
+    MCCI_TIME_T deadline = 0;
+    bool any = bank_deadline(bank, deadline);
+    m_schedule.update(bank, any, deadline);
+}
+
+
+bool CMCCIServer::next_deadline(MCCI_TIME_T &deadline) const
+{
+    if (m_settings.unified_timeouts)
+    {
+        if (m_schedule.empty()) return false;
+        deadline = m_schedule.next_deadline();
+        return true;
+    }
+
+    bool any = false;
+    for (unsigned int bank = 0; bank < MCCI_BANKS; ++bank)
+    {
+        MCCI_TIME_T d;
+        if (bank_deadline(bank, d) && (!any || d < deadline))
+        {
+            deadline = d;
+            any = true;
+        }
+    }
+    return any;
+}
+
+
 bool CMCCIServer::is_rejectable_request(const SMCCIRequestPacket* input) const
 {
     return 0 < input->revision && (
@@ -288,6 +388,17 @@ void CMCCIServer::process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
     }
     MCCI_REVISION_T lastrev = firstrev + limit - 1;
 
+    // however we leave (sending data or looking up variables can throw), leave no part of
+    //  this request's batches to be made with the next one
+    struct BatchGuard
+    {
+        CMCCIServer* server;
+        ~BatchGuard()
+        {
+            server->m_batch_remote.clear();
+            server->m_batch_varrev.clear();
+        }
+    } batch_guard = { this };
     
     // expand subscription range and add to various queues
     for (MCCI_REVISION_T r = firstrev; r <= lastrev; r++)
@@ -324,6 +435,9 @@ void CMCCIServer::process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
 
     }
 
+    // a request for many revisions goes into each bank in one step
+    subscribe_batch();
+
 
     /*
     // decrement the remaining requests
@@ -355,6 +469,7 @@ void CMCCIServer::process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
 void CMCCIServer::subscribe_promiscuous(MCCI_CLIENT_ID_T client_id, MCCI_TIME_T timeout)
 {
     m_bank_all.add(1, client_id, timeout);
+    reschedule(MCCI_BANK_ALL);
 }
 
 void CMCCIServer::subscribe_to_host(MCCI_CLIENT_ID_T client_id,
@@ -362,6 +477,7 @@ void CMCCIServer::subscribe_to_host(MCCI_CLIENT_ID_T client_id,
                                     MCCI_NODE_ADDRESS_T node_address)
 {
     m_bank_host.add(node_address, client_id, timeout);
+    reschedule(MCCI_BANK_HOST);
 }
 
 void CMCCIServer::subscribe_to_variable(MCCI_CLIENT_ID_T client_id,
@@ -369,6 +485,7 @@ void CMCCIServer::subscribe_to_variable(MCCI_CLIENT_ID_T client_id,
                                         MCCI_VARIABLE_T variable_id)
 {
     m_bank_var.add(variable_id, client_id, timeout);
+    reschedule(MCCI_BANK_VAR);
 }
 
 void CMCCIServer::subscribe_to_host_var(MCCI_CLIENT_ID_T client_id,
@@ -380,6 +497,7 @@ void CMCCIServer::subscribe_to_host_var(MCCI_CLIENT_ID_T client_id,
     hv.host = host;
     hv.var = variable_id;
     m_bank_hostvar.add(hv, client_id, timeout);
+    reschedule(MCCI_BANK_HOSTVAR);
 }
 
 void CMCCIServer::subscribe_specific_remote(MCCI_CLIENT_ID_T client_id,
@@ -388,11 +506,13 @@ void CMCCIServer::subscribe_specific_remote(MCCI_CLIENT_ID_T client_id,
                                             MCCI_VARIABLE_T variable_id,
                                             MCCI_REVISION_T revision)
 {
-    HostVarRevTuple hvr;
-    hvr.host = node_address;
-    hvr.var = variable_id;
-    hvr.rev = revision;
-    m_bank_remote.add(hvr, client_id, timeout);
+    RemoteRevisionRequestBank::Request r;
+    r.key_set.host = node_address;
+    r.key_set.var = variable_id;
+    r.key_set.rev = revision;
+    r.client_id = client_id;
+    r.timeout = timeout;
+    m_batch_remote.push_back(r);
 }
 
 
@@ -401,10 +521,31 @@ void CMCCIServer::subscribe_specific(MCCI_CLIENT_ID_T client_id,
                                      MCCI_VARIABLE_T variable_id,
                                      MCCI_REVISION_T revision)
 {
-    VarRevPair vr;
-    vr.var = variable_id;
-    vr.rev = revision;
-    m_bank_varrev.add(vr, client_id, timeout);
+    VariableRevisionRequestBank::Request r;
+    r.key_set.var = variable_id;
+    r.key_set.rev = revision;
+    r.client_id = client_id;
+    r.timeout = timeout;
+    m_batch_varrev.push_back(r);
+}
+
+
+void CMCCIServer::subscribe_batch()
+{
+    try
+    {
+        if (!m_batch_remote.empty()) m_bank_remote.add_batch(m_batch_remote);
+        if (!m_batch_varrev.empty()) m_bank_varrev.add_batch(m_batch_varrev);
+    }
+    catch (...)
+    {
+        // the banks keep what was added before the throw
+        reschedule(MCCI_BANK_REMOTE);
+        reschedule(MCCI_BANK_VARREV);
+        throw;
+    }
+    reschedule(MCCI_BANK_REMOTE);
+    reschedule(MCCI_BANK_VARREV);
 }
 
 
@@ -586,6 +727,7 @@ void CMCCIServer::enforce_fulfillment(const SMCCIDataPacket* delivered)
         vr.rev = delivered->revision;
 
         if (m_bank_varrev.get_by_pq(vr)) m_bank_varrev.remove_by_key(vr);
+        reschedule(MCCI_BANK_VARREV);
     }
     else
     {
@@ -595,6 +737,7 @@ void CMCCIServer::enforce_fulfillment(const SMCCIDataPacket* delivered)
         hvr.rev = delivered->revision;
         
         if (m_bank_remote.get_by_pq(hvr)) m_bank_remote.remove_by_key(hvr);
+        reschedule(MCCI_BANK_REMOTE);
     }
 }
 
@@ -606,22 +749,25 @@ void CMCCIServer::enforce_timeouts()
     // in other words take only n of k removals if n < k, but for every deferal
     // if k > last_n then take more than n.
     
-    while (!m_bank_all.empty() && now > m_bank_all.minimum_timeout())
-        m_bank_all.remove_minimum();
-
-    while (!m_bank_host.empty() && now > m_bank_host.minimum_timeout())
-        m_bank_host.remove_minimum();
-
-    while (!m_bank_var.empty() && now > m_bank_var.minimum_timeout())
-        m_bank_var.remove_minimum();
-
-    while (!m_bank_hostvar.empty() && now > m_bank_hostvar.minimum_timeout())
-        m_bank_hostvar.remove_minimum();
+    // with a schedule, only the banks with something due are visited, earliest first.
+    //  each lets go of all of it at once, so none comes up twice
+    if (m_settings.unified_timeouts)
+    {
+        while (m_schedule.due(now))
+        {
+            unsigned int bank = m_schedule.next_source();
+            expire_bank(bank, now);
+            reschedule(bank);
+        }
+        return;
+    }
 
-    while (!m_bank_remote.empty() && now > m_bank_remote.minimum_timeout())
-        m_bank_remote.remove_minimum();
-    
-    while (!m_bank_varrev.empty() && now > m_bank_varrev.minimum_timeout())
-        m_bank_varrev.remove_minimum();
+    // each bank lets go of everything that's due in one pass over its queue
+    m_bank_all.pop_expired(now);
+    m_bank_host.pop_expired(now);
+    m_bank_var.pop_expired(now);
+    m_bank_hostvar.pop_expired(now);
+    m_bank_remote.pop_expired(now);
+    m_bank_varrev.pop_expired(now);
 }
 
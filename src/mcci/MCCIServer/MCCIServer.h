@@ -6,6 +6,7 @@
 #include "MCCIServerNetworking.h"
 #include "MCCIRevisionSet.h"
 #include "MCCITime.h"
+#include "MCCITimeoutScheduler.h"
 #include "MCCITypes.h"
 #include <map>
 #include <vector>
@@ -14,6 +15,18 @@
 //#include <unordered_map> // replace with boost?
 
 
+// the request banks, by number: for get_bank_stats, and as sources in the timeout schedule
+#define MCCI_BANK_ALL      0
+#define MCCI_BANK_HOST     1
+#define MCCI_BANK_VAR      2
+#define MCCI_BANK_HOSTVAR  3
+#define MCCI_BANK_REMOTE   4
+#define MCCI_BANK_VARREV   5
+
+// how many there are
+#define MCCI_BANKS 6
+
+
 // the settings for operating a MCCI server
 typedef struct
 {
@@ -30,6 +43,11 @@ typedef struct
     unsigned int bank_size_varrev_rev;
     unsigned int bank_size_remote_hostvar;
     unsigned int bank_size_remote_rev;
+
+    // whether the server keeps one schedule of all the banks' timeouts (see
+    //  CMCCITimeoutScheduler), so enforce_timeouts visits only the banks with something
+    //  due; otherwise it polls every bank
+    bool unified_timeouts;
     
     CMCCISchema* schema;
     CMCCIRevisionSet* revisionset;
@@ -57,6 +75,14 @@ class CMCCIServer
     RemoteRevisionRequestBank   m_bank_remote;
     VariableRevisionRequestBank m_bank_varrev;
 
+    // specific subscriptions waiting for subscribe_batch, within one request; emptied
+    //  whenever it ends, but kept to reuse their memory
+    vector<RemoteRevisionRequestBank::Request>   m_batch_remote;
+    vector<VariableRevisionRequestBank::Request> m_batch_varrev;
+
+    // the banks, by their earliest timeouts (kept if m_settings.unified_timeouts)
+    CMCCITimeoutScheduler m_schedule;
+
     CMCCIServerNetworking* m_networking;
     CMCCITime* m_time;
     bool m_external_time;
@@ -74,6 +100,14 @@ class CMCCIServer
 
     // number of open requests
     int request_count() const;
+
+    // counters of one request bank's work, given by its MCCI_BANK_* number.  they are all
+    //  zero unless the server is built with REQUEST_BANK_STATS (and, for the banks'
+    //  heaps, FIBONACCI_HEAP_STATS)
+    RequestBankStats get_bank_stats(unsigned int bank) const;
+
+    // start all the banks' counters again from zero
+    void reset_bank_stats();
     
     // accept a request packet, and put its contents in the appropriate structures, responding accordingly
     void process_request(MCCI_CLIENT_ID_T requestor_id,
@@ -97,6 +131,9 @@ class CMCCIServer
     // remove all expired requests and update the outstanding_requests counters appropriately
     void enforce_timeouts();
 
+    // the earliest timeout of any request, for sleeping until then; false if there are none
+    bool next_deadline(MCCI_TIME_T &deadline) const;
+
     // remove all requests forz a specific packet that was delivered
     void enforce_fulfillment(const SMCCIDataPacket* delivered);
     
@@ -138,6 +175,15 @@ class CMCCIServer
     // whether a request has one of the 4 possible input combinations that makes it wrong
     bool is_rejectable_request(const SMCCIRequestPacket* input) const;
 
+    // the earliest timeout in a bank, given by its MCCI_BANK_* number; false if it has none
+    bool bank_deadline(unsigned int bank, MCCI_TIME_T &deadline) const;
+
+    // remove a bank's expired requests
+    void expire_bank(unsigned int bank, MCCI_TIME_T now);
+
+    // tell the schedule a bank's earliest timeout after it changes, if there's a schedule
+    void reschedule(unsigned int bank);
+
     // slave to process_request, for the cases that involve forwarding
     void process_forwardable_request(MCCI_CLIENT_ID_T requestor_id,
                                      const SMCCIRequestPacket* input,
@@ -162,6 +208,7 @@ class CMCCIServer
                                MCCI_VARIABLE_T variable_id);
 
     //add a client to the list of receipents for a specific packet from this host
+    //  (the specific subscriptions are batched, and only made by subscribe_batch)
     void subscribe_specific(MCCI_CLIENT_ID_T client_id,
                             MCCI_TIME_T timeout,
                             MCCI_VARIABLE_T variable_id,
@@ -174,6 +221,10 @@ class CMCCIServer
                                    MCCI_VARIABLE_T variable_id,
                                    MCCI_REVISION_T revision);
 
+    // make the specific subscriptions batched so far, each bank's in one go (the caller
+    //  empties the batches afterwards, however it leaves)
+    void subscribe_batch();
+
     
     // check client subscription to variable
     bool bank_contains_variable(MCCI_CLIENT_ID_T client_id,
@@ -74,6 +74,7 @@ int main(int argc, char* argv[])
         settings.bank_size_varrev_rev = 20;
         settings.bank_size_remote_hostvar = 20;
         settings.bank_size_remote_rev = 20;
+        settings.unified_timeouts = false;
         
         // assign other objects
         settings.schema = schema;
@@ -14,6 +14,21 @@ using namespace std;
 CMCCITimeFake fake_time;
 CMCCIServerNetworkingFake fake_networking(cerr);
 
+// networking that fails to send data while `refuse` is set
+class CMCCIServerNetworkingRefusing : public CMCCIServerNetworkingFake
+{
+  public:
+    bool refuse;
+
+    CMCCIServerNetworkingRefusing(ostream& outstream) : CMCCIServerNetworkingFake(outstream), refuse(false) {}
+
+    virtual void send_data_to_client(MCCI_CLIENT_ID_T client, const SMCCIDataPacket* p)
+    {
+        if (refuse) throw string("refused to send data");
+        CMCCIServerNetworkingFake::send_data_to_client(client, p);
+    }
+};
+
 sqlite3* schema_db = NULL;
 sqlite3* rs_db     = NULL;
 
@@ -121,6 +136,7 @@ int init(bool debug)
         settings.bank_size_varrev_rev = 20;
         settings.bank_size_remote_hostvar = 20;
         settings.bank_size_remote_rev = 20;
+        settings.unified_timeouts = true;
         
         // assign other objects
         settings.schema = schema;
@@ -246,6 +262,11 @@ int test_rb_basic(SMCCIRequestPacket request, int local_impact, int remote_impac
     cerr << "\nreqs " << reqs << " rc " << my_server->request_count();
     assert(reqs == my_server->request_count());
 
+    // the server's next deadline is the request's, if it holds one
+    MCCI_TIME_T deadline = 0;
+    assert(my_server->next_deadline(deadline) == (0 < reqs));
+    assert(0 == reqs || fake_time.now() + 1 == deadline);
+
     cerr << "\nenforcing timeouts after a request w/ future timeout: " << response;
     my_server->enforce_timeouts();
     assert(reqs == my_server->request_count());
@@ -260,11 +281,14 @@ int test_rb_basic(SMCCIRequestPacket request, int local_impact, int remote_impac
     assert(settings.max_remote_requests == response.requests_remaining_remote + remote_impact);
 
     cerr << "\nAfter altering a request to a past timeout: " << response << "\n" << *my_server;
+    assert(my_server->next_deadline(deadline) == (0 < reqs));
+    assert(0 == reqs || fake_time.now() - 1 == deadline);
 
     
     cerr << "\nenforcing timeouts";
     my_server->enforce_timeouts();
     assert(0 == my_server->request_count());
+    assert(!my_server->next_deadline(deadline));
     
     cerr << "\nAfter enforcing timeouts:\n" << *my_server;
     return 0;
@@ -338,8 +362,8 @@ int test_rb_remote()
     request.revision = 61;
     request.quantity = 5;
 
-    // remote requests count against remote
-    return test_rb_basic(request, 0, 5, 1);
+    // remote requests count against remote, one per revision
+    return test_rb_basic(request, 0, 5, 5);
 }
 
 int test_rb_varrev()
@@ -350,11 +374,104 @@ int test_rb_varrev()
     request.revision = 61;
     request.quantity = 5;
 
-    // varrev requests count against local
-    return test_rb_basic(request, 5, 0, 1);
+    // varrev requests count against local, one per revision
+    return test_rb_basic(request, 5, 0, 5);
 }
 
 
+// several requests in each of several banks are all counted
+int test_rb_many()
+{
+    fake_time.set_now(12344);
+
+    SMCCIRequestPacket request;
+    request.revision = 0;
+    request.quantity = 1;
+    request.timeout = fake_time.now() + 1;
+
+    SMCCIResponsePacket response;
+
+    // two hosts, two variables, and both variables of one host, for each of two clients
+    for (MCCI_CLIENT_ID_T client_id = 37; client_id <= 38; ++client_id)
+    {
+        for (int i = 1; i <= 2; ++i)
+        {
+            request.node_address = 87 + i;
+            request.variable_id = 0;
+            my_server->process_request(client_id, &request, &response);
+            assert(response.accepted);
+
+            request.node_address = MCCI_HOST_ANY;
+            request.variable_id = i;
+            my_server->process_request(client_id, &request, &response);
+            assert(response.accepted);
+
+            request.node_address = 88;
+            my_server->process_request(client_id, &request, &response);
+            assert(response.accepted);
+        }
+    }
+
+    // and 5 revisions of a variable that haven't been produced yet
+    request.node_address = 0;
+    request.variable_id = 1;
+    request.revision = 61;
+    request.quantity = 5;
+    my_server->process_request(37, &request, &response);
+    assert(response.accepted);
+
+    cerr << "\n" << *my_server;
+    assert(4 + 4 + 4 + 5 == my_server->request_count());
+
+    fake_time.set_now(12346);
+    my_server->enforce_timeouts();
+    assert(0 == my_server->request_count());
+
+    return 0;
+}
+
+
+// a request that fails part-way subscribes to nothing, then or with the next request
+int test_failed_request()
+{
+    CMCCIServerNetworkingRefusing refusing(cerr);
+    CMCCIServer server((CMCCITime*)&fake_time, &refusing, my_server->get_settings());
+    fake_time.set_now(12344);
+
+    SMCCIProductionPacket production;
+    SMCCIAcceptancePacket acceptance;
+    production.variable_id = 1;
+    production.payload = 0;
+    production.response_id = 77;
+    server.process_production(25, &production, &acceptance);
+    server.process_production(25, &production, &acceptance);
+    int current_rev = acceptance.revision;
+
+    // the revision before the current one is batched, then sending the current one fails
+    SMCCIRequestPacket request;
+    request.node_address = 0;
+    request.variable_id = 1;
+    request.revision = current_rev - 1;
+    request.quantity = 3;
+    request.timeout = fake_time.now() + 1;
+
+    SMCCIResponsePacket response;
+    bool refused = false;
+    refusing.refuse = true;
+    try { server.process_request(54, &request, &response); } catch (string s) { refused = true; }
+    refusing.refuse = false;
+    assert(refused && 0 == server.request_count());
+
+    // an unrelated request for a future revision brings only itself
+    request.variable_id = 2;
+    request.revision = server.get_settings().revisionset->get_revision(2) + 10;
+    request.quantity = 1;
+    server.process_request(60, &request, &response);
+    assert(response.accepted && 1 == server.request_count());
+
+    return 0;
+}
+
 
 // request is a request packet, impacts are how many req slots we expect the packet to occupy
 int test_sndrecv()
@@ -442,6 +559,8 @@ int main(int argc, char* argv[])
     do_test("test_rb_hostvar", test_rb_hostvar);
     do_test("test_rb_remote", test_rb_remote);
     do_test("test_rb_varrev", test_rb_varrev);
+    do_test("test_rb_many", test_rb_many);
+    do_test("test_failed_request", test_failed_request);
     
     do_test("test_sndrcv", test_sndrecv);
 
@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include "DaryHeap.h"
+#include "MCCITypes.h"
+#include <vector>
+
+using namespace std;
+
+
+/**
+   The order in which a few queues of timeouts (the server's request banks) come due: each
+   source with any timeouts has one entry here, keyed by its earliest, so the next
+   deadline anywhere, and whose it is, is at the minimum.
+
+   The sources keep their own timeouts, and their requests' handles into them.  Whoever
+   changes a source tells the scheduler its earliest timeout afterwards with update() (or
+   that it has none), which moves its entry only if that changed; and expiring what's due
+   is taking next_source() for as long as due(now) says so, expiring it, and updating it.
+   Sources that aren't due are never looked at.
+
+   Sources are numbered from 0 to one less than the number the scheduler is made with.
+ */
+class CMCCITimeoutScheduler
+{
+  protected:
+    typedef DaryHeap<MCCI_TIME_T, unsigned int> Deadlines;
+
+    Deadlines m_deadlines;
+    vector<Deadlines::Node*> m_sources;  // each source's entry, NULL while it has no timeouts
+
+  public:
+    CMCCITimeoutScheduler(unsigned int sources) : m_sources(sources, (Deadlines::Node*)NULL) {}
+
+    // a source's earliest timeout is now `deadline`, if it has `any`
+    void update(unsigned int source, bool any, MCCI_TIME_T deadline)
+    {
+        Deadlines::Node* &n = this->m_sources.at(source);
+        if (!any)
+        {
+            if (n) this->m_deadlines.remove(n, 0);
+            n = NULL;
+        }
+        else if (!n)
+        {
+            n = this->m_deadlines.insert(deadline, source);
+        }
+        else if (n->key() != deadline)
+        {
+            this->m_deadlines.alter_key(n, deadline, 0);
+        }
+    }
+
+    // whether any source has timeouts
+    bool empty() const { return this->m_deadlines.empty(); }
+
+    // whether any source has a timeout before `now`
+    bool due(MCCI_TIME_T now) const
+    {
+        return !this->m_deadlines.empty() && this->m_deadlines.minimum()->key() < now;
+    }
+
+    // the earliest timeout of all, and the source it's in (only if there are any)
+    MCCI_TIME_T next_deadline() const { return this->m_deadlines.minimum()->key(); }
+    unsigned int next_source() const { return this->m_deadlines.minimum()->data(); }
+
+    // forget every source's timeouts
+    void clear()
+    {
+        this->m_deadlines.clear();
+        fill(this->m_sources.begin(), this->m_sources.end(), (Deadlines::Node*)NULL);
+    }
+
+  protected:
+
+    // the entries are the scheduler's own
+    CMCCITimeoutScheduler(const CMCCITimeoutScheduler &rhs);
+    CMCCITimeoutScheduler& operator=(const CMCCITimeoutScheduler &rhs);
+};
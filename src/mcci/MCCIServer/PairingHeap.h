@@ -0,0 +1,362 @@
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <new>
+
+using namespace std;
+
+
+template <typename Key, typename Data> class PairingHeapNode
+{
+  protected:
+    Key m_key;
+    Data m_data;
+
+    PairingHeapNode<Key, Data>* m_child;     // the first of its children
+    PairingHeapNode<Key, Data>* m_next;      // its next sibling
+    PairingHeapNode<Key, Data>* m_previous;  // its previous sibling, or its parent if it's the first child
+
+  public:
+    PairingHeapNode(Key k, Data d) : m_key(k), m_data(d), m_child(NULL), m_next(NULL), m_previous(NULL) {}
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    template <typename K, typename D, typename A> friend class PairingHeap;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, typename Alloc> class PairingHeap;
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream &, const PairingHeap<Key, Data, Alloc> &);
+
+
+/**
+   A pairing heap: a min-heap with the same interface as FibonacciHeap, so a RequestBank
+   can keep its timeouts in one.
+
+   The heap is a single tree whose children are kept in a sibling list.  Inserting and
+   lowering a key are a single link (meld) with the root; removing the minimum melds the
+   root's children in pairs, left to right, then the pairs right to left.  It does much
+   less bookkeeping per operation than a Fibonacci heap (no degrees, marks or cascading
+   cuts, and no consolidation table), which usually makes it faster in practice, at the
+   cost of only amortized O(log n) bounds for lowering a key.
+
+   A key is raised by taking the node out, with its children melded back in, and
+   inserting it again.
+
+   Nodes are created and destroyed through Alloc, rebound to the node type, as in
+   FibonacciHeap.
+ */
+template <typename Key, typename Data,
+          typename Alloc = std::allocator<PairingHeapNode<Key, Data> > >
+class PairingHeap
+{
+  public:
+    typedef PairingHeapNode<Key, Data> Node;
+
+  protected:
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+
+    NodeAlloc m_alloc;
+
+    Node* m_root;
+    unsigned int m_count;
+
+  public:
+
+    PairingHeap(const Alloc& alloc = Alloc()) : m_alloc(alloc)
+    {
+        this->m_root = NULL;
+        this->m_count = 0;
+    }
+
+    ~PairingHeap() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const PairingHeap<Key, Data, Alloc>& v);
+
+    bool empty() const { return 0 == this->m_count; }
+    unsigned int size() const { return this->m_count; }
+
+
+    Node* insert(Key k, Data d)
+    {
+        Node* n = allocator_traits<NodeAlloc>::allocate(this->m_alloc, 1);
+        new (n) Node(k, d);
+
+        this->m_root = meld(this->m_root, n);
+        ++this->m_count;
+        return n;
+    }
+
+
+    Node* minimum() const
+    {
+        if (!this->m_root) throw string("no minimum element");
+        return this->m_root;
+    }
+
+
+    void remove_minimum()
+    {
+        if (!this->m_root) throw string("trying to remove from an empty heap");
+
+        Node* n = this->m_root;
+        this->m_root = merge_pairs(n->m_child);
+        this->destroy_node(n);
+        --this->m_count;
+    }
+
+
+    // take all of other's nodes, with a single meld, leaving it empty.  the nodes keep
+    //  their addresses, so handles to them stay good; other must allocate as this heap does
+    void merge(PairingHeap& other)
+    {
+        if (&other == this) return;
+
+        this->m_root = meld(this->m_root, other.m_root);
+        this->m_count += other.m_count;
+        other.m_root = NULL;
+        other.m_count = 0;
+    }
+
+
+    // remove every node, visiting each once, without the work of removing them in order
+    void clear()
+    {
+        vector<Node*> todo;
+        if (this->m_root) todo.push_back(this->m_root);
+        while (!todo.empty())
+        {
+            Node* n = todo.back();
+            todo.pop_back();
+            if (n->m_child) todo.push_back(n->m_child);
+            if (n->m_next) todo.push_back(n->m_next);
+            this->destroy_node(n);
+        }
+
+        this->m_root = NULL;
+        this->m_count = 0;
+    }
+
+
+    // remove every node with a key before `now`, in no particular order, passing each to
+    //  cb(const Node*) on the way out.  the expired nodes are all at the top of the tree;
+    //  the subtrees left under them are joined in one two-pass merge at the end
+    template <typename Callback> unsigned int pop_expired(Key now, Callback cb)
+    {
+        if (!this->m_root || !(this->m_root->m_key < now)) return 0;
+
+        vector<Node*> todo(1, this->m_root);
+        Node* survivors = NULL;  // a list of subtrees, linked through m_next
+        unsigned int popped = 0;
+        while (!todo.empty())
+        {
+            Node* n = todo.back();
+            todo.pop_back();
+            if (n->m_next) todo.push_back(n->m_next);
+
+            if (n->m_key < now)
+            {
+                if (n->m_child) todo.push_back(n->m_child);
+                cb((const Node*)n);
+                this->destroy_node(n);
+                ++popped;
+            }
+            else
+            {
+                n->m_previous = NULL;
+                n->m_next = survivors;
+                survivors = n;
+            }
+        }
+
+        this->m_root = merge_pairs(survivors);
+        this->m_count -= popped;
+        return popped;
+    }
+
+
+    // (minus_infinity is unused; it is here so that the heaps can be swapped for one another)
+    void remove(Node* node, Key minus_infinity)
+    {
+        if (node == this->m_root)
+        {
+            this->remove_minimum();
+            return;
+        }
+
+        this->detach(node);
+        this->m_root = meld(this->m_root, merge_pairs(node->m_child));
+        this->destroy_node(node);
+        --this->m_count;
+    }
+
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+
+        node->m_key = new_key;
+        if (node == this->m_root) return;
+
+        this->detach(node);
+        this->m_root = meld(this->m_root, node);
+    }
+
+
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        if (new_key < node->m_key)
+        {
+            this->decrease_key(node, new_key);
+        }
+        else if (new_key > node->m_key)
+        {
+            // its children may now belong above it: take it out, and put it back alone
+            if (node == this->m_root)
+            {
+                this->m_root = merge_pairs(node->m_child);
+            }
+            else
+            {
+                this->detach(node);
+                this->m_root = meld(this->m_root, merge_pairs(node->m_child));
+            }
+
+            node->m_child = NULL;
+            node->m_key = new_key;
+            this->m_root = meld(this->m_root, node);
+        }
+    }
+
+
+    void print_roots(ostream& out) const
+    {
+        out << "m_count=" << this->m_count << "  root=";
+        if (!this->m_root) return;
+
+        // nodes in preorder, each followed by ( and ) around its children
+        vector<const Node*> todo(1, this->m_root);
+        while (!todo.empty())
+        {
+            const Node* n = todo.back();
+            todo.pop_back();
+            if (!n)
+            {
+                out << ") ";
+                continue;
+            }
+
+            n->print_node(out);
+            out << " ";
+            if (n->m_next) todo.push_back(n->m_next);
+            if (n->m_child)
+            {
+                out << "( ";
+                todo.push_back(NULL);
+                todo.push_back(n->m_child);
+            }
+        }
+    }
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+
+  protected:
+
+    // the nodes are the heap's own; copies would share them
+    PairingHeap(const PairingHeap &rhs);
+    PairingHeap& operator=(const PairingHeap &rhs);
+
+
+    // join two trees (either may be NULL), the one with the larger root becoming the first
+    //  child of the other
+    static Node* meld(Node* a, Node* b)
+    {
+        if (!a) return b;
+        if (!b) return a;
+        if (b->m_key < a->m_key) std::swap(a, b);
+
+        b->m_previous = a;
+        b->m_next = a->m_child;
+        if (a->m_child) a->m_child->m_previous = b;
+        a->m_child = b;
+        return a;
+    }
+
+
+    // join a list of siblings into one tree, in two passes
+    static Node* merge_pairs(Node* first)
+    {
+        // left to right: meld them in pairs, stacking the results on `pairs`
+        Node* pairs = NULL;
+        while (first)
+        {
+            Node* a = first;
+            Node* b = a->m_next;
+            first = b ? b->m_next : NULL;
+
+            a->m_next = a->m_previous = NULL;
+            if (b) b->m_next = b->m_previous = NULL;
+
+            Node* m = meld(a, b);
+            m->m_next = pairs;
+            pairs = m;
+        }
+
+        // right to left: meld each pair into the result
+        Node* root = NULL;
+        while (pairs)
+        {
+            Node* p = pairs;
+            pairs = p->m_next;
+            p->m_next = NULL;
+            root = meld(root, p);
+        }
+
+        return root;
+    }
+
+
+    // unlink a (non-root) node, with its subtree, from its parent and siblings
+    void detach(Node* node)
+    {
+        if (node->m_previous->m_child == node)
+            node->m_previous->m_child = node->m_next;
+        else
+            node->m_previous->m_next = node->m_next;
+
+        if (node->m_next) node->m_next->m_previous = node->m_previous;
+        node->m_next = node->m_previous = NULL;
+    }
+
+
+    void destroy_node(Node* n)
+    {
+        n->~Node();
+        allocator_traits<NodeAlloc>::deallocate(this->m_alloc, n, 1);
+    }
+};
+
+
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream& output, const PairingHeap<Key, Data, Alloc>& v)
+{
+    v.print_roots(output);
+    return output;
+}
@@ -0,0 +1,461 @@
+
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <boost/cstdint.hpp>
+
+using namespace std;
+
+
+// each level of the wheel resolves one byte of the key
+#define TIMING_WHEEL_SLOT_BITS 8
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_SLOT_BITS)
+
+
+// the links of a slot's list; a slot's head is one of these on its own
+struct TimingWheelLink
+{
+    TimingWheelLink* m_previous;
+    TimingWheelLink* m_next;
+};
+
+
+template <typename Key, typename Data> class TimingWheelNode : public TimingWheelLink
+{
+  protected:
+    Key m_key;
+    Data m_data;
+    unsigned short m_slot;  // level * TIMING_WHEEL_SLOTS + slot, to find its list again
+
+  public:
+    TimingWheelNode(Key k, Data d) : m_key(k), m_data(d), m_slot(0) {}
+
+    Key key() const { return this->m_key; }
+    Data data() const { return this->m_data; }
+
+    void print_node(ostream& out) const { out << this->m_data << ":" << this->m_key; }
+
+    template <typename K, typename D, typename A> friend class TimingWheel;
+};
+
+
+// declare class to enable declaration of ostream operator
+template <typename Key, typename Data, typename Alloc> class TimingWheel;
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream &, const TimingWheel<Key, Data, Alloc> &);
+
+
+/**
+   A hierarchical timing wheel: a min-priority queue on unsigned integer keys (times) with
+   the same interface as FibonacciHeap, so a RequestBank can keep its timeouts in either.
+
+   There is a level per byte of the key, each of 256 slots.  A node sits on the level of
+   the highest byte in which its key differs from the wheel's current time, in the slot
+   for that byte of its key; so everything on level 0 is due within 256 ticks, and all of
+   a level-0 slot's nodes have the same key.  Inserting, cancelling (remove) and
+   rescheduling (alter_key) just link or unlink a node: O(1), whatever the key.
+
+   The current time moves forward to the key of each node removed by remove_minimum.  A
+   higher-level slot it moves into is cascaded, its nodes placed again on lower levels;
+   each node is cascaded at most once per level, so expiry is O(1) amortized, and a
+   level-0 slot expires as a batch.  Finding the minimum is a scan of occupancy bitmaps
+   (and, for a slot above level 0, of that slot), and is remembered until it changes.
+
+   Keys before the current time (a timeout that has already passed) are kept on a list of
+   their own, which is always due first; it is searched for its minimum, so it is meant for
+   the odd late arrival.  An empty wheel goes back to time 0, so a key inserted into one is
+   never late.
+
+   Nodes are created and destroyed through Alloc, rebound to the node type, as in
+   FibonacciHeap.
+ */
+template <typename Key, typename Data,
+          typename Alloc = std::allocator<TimingWheelNode<Key, Data> > >
+class TimingWheel
+{
+    static_assert(is_integral<Key>::value && is_unsigned<Key>::value,
+                  "TimingWheel keys are unsigned integer times");
+
+  public:
+    typedef TimingWheelNode<Key, Data> Node;
+
+  protected:
+    typedef typename allocator_traits<Alloc>::template rebind_alloc<Node> NodeAlloc;
+
+    static const unsigned int LEVELS = sizeof(Key);
+    static const unsigned int PAST = LEVELS * TIMING_WHEEL_SLOTS;  // the slot for past keys
+    static const unsigned int WORDS = TIMING_WHEEL_SLOTS / 64;     // bitmap words per level
+
+    NodeAlloc m_alloc;
+
+    Key m_now;                    // no node in the wheel proper has an earlier key
+    unsigned int m_count;
+    mutable Node* m_minimum;      // remembered minimum, or NULL to find it again
+
+    TimingWheelLink m_slot[PAST + 1];
+    uint64_t m_occupied[LEVELS][WORDS];
+
+  public:
+
+    TimingWheel(const Alloc& alloc = Alloc()) : m_alloc(alloc)
+    {
+        this->m_now = 0;
+        this->m_count = 0;
+        this->m_minimum = NULL;
+
+        for (unsigned int i = 0; i <= PAST; ++i)
+            this->m_slot[i].m_previous = this->m_slot[i].m_next = &this->m_slot[i];
+
+        for (unsigned int l = 0; l < LEVELS; ++l)
+            for (unsigned int w = 0; w < WORDS; ++w)
+                this->m_occupied[l][w] = 0;
+    }
+
+    ~TimingWheel() { this->clear(); }
+
+    friend ostream& operator<< <>(ostream& output, const TimingWheel<Key, Data, Alloc>& v);
+
+    bool empty() const { return 0 == this->m_count; }
+    unsigned int size() const { return this->m_count; }
+
+    // the current time: the key of the last node removed by remove_minimum (or 0, if
+    //  the wheel has been empty since)
+    Key now() const { return this->m_now; }
+
+
+    Node* insert(Key k, Data d)
+    {
+        Node* n = allocator_traits<NodeAlloc>::allocate(this->m_alloc, 1);
+        new (n) Node(k, d);
+
+        // an empty wheel starts again from the beginning of time, so that no key is late
+        if (!this->m_count) this->m_now = 0;
+
+        this->place(n);
+        ++this->m_count;
+        if (this->m_minimum && k < this->m_minimum->m_key) this->m_minimum = n;
+        return n;
+    }
+
+
+    Node* minimum() const
+    {
+        if (this->m_minimum) return this->m_minimum;
+        if (!this->m_count) throw string("no minimum element");
+
+        // past keys are due before anything in the wheel
+        if (!this->is_vacant(PAST))
+            return this->m_minimum = this->earliest(PAST);
+
+        for (unsigned int l = 0; l < LEVELS; ++l)
+        {
+            for (unsigned int w = 0; w < WORDS; ++w)
+            {
+                if (!this->m_occupied[l][w]) continue;
+
+                unsigned int s = l * TIMING_WHEEL_SLOTS + w * 64 + __builtin_ctzll(this->m_occupied[l][w]);
+
+                // a level-0 slot's nodes all have the same key; take the first to arrive
+                if (0 == l) return this->m_minimum = static_cast<Node*>(this->m_slot[s].m_next);
+                return this->m_minimum = this->earliest(s);
+            }
+        }
+
+        throw string("Internal error: TimingWheel count doesn't match its slots");
+    }
+
+
+    void remove_minimum()
+    {
+        Node* n = this->minimum();
+
+        if (PAST != n->m_slot && this->m_now < n->m_key) this->advance(n->m_key);
+        this->unlink(n);
+        this->destroy_node(n);
+        --this->m_count;
+        this->m_minimum = NULL;
+    }
+
+
+    // take all of other's nodes, placing each one for this wheel's time, and leave it empty.
+    //  the nodes keep their addresses, so handles to them stay good; other must allocate
+    //  as this wheel does
+    void merge(TimingWheel& other)
+    {
+        if (&other == this || !other.m_count) return;
+        if (!this->m_count) this->m_now = 0;
+
+        for (unsigned int i = 0; i <= PAST; ++i)
+        {
+            TimingWheelLink* head = &other.m_slot[i];
+            TimingWheelLink* l = head->m_next;
+            head->m_previous = head->m_next = head;
+            while (l != head)
+            {
+                Node* n = static_cast<Node*>(l);
+                l = l->m_next;
+                this->place(n);
+            }
+        }
+        this->m_count += other.m_count;
+        this->m_minimum = NULL;
+
+        for (unsigned int l = 0; l < LEVELS; ++l)
+            for (unsigned int w = 0; w < WORDS; ++w)
+                other.m_occupied[l][w] = 0;
+        other.m_now = 0;
+        other.m_count = 0;
+        other.m_minimum = NULL;
+    }
+
+
+    // remove every node, and go back to time 0
+    void clear()
+    {
+        for (unsigned int i = 0; i <= PAST; ++i)
+        {
+            TimingWheelLink* head = &this->m_slot[i];
+            while (head->m_next != head)
+            {
+                Node* n = static_cast<Node*>(head->m_next);
+                head->m_next = n->m_next;
+                this->destroy_node(n);
+            }
+            head->m_previous = head;
+        }
+
+        for (unsigned int l = 0; l < LEVELS; ++l)
+            for (unsigned int w = 0; w < WORDS; ++w)
+                this->m_occupied[l][w] = 0;
+
+        this->m_now = 0;
+        this->m_count = 0;
+        this->m_minimum = NULL;
+    }
+
+
+    // remove every node with a key before `now`, passing each to cb(const Node*) on the way
+    //  out: a slot at a time, each emptied in one pass
+    template <typename Callback> unsigned int pop_expired(Key now, Callback cb)
+    {
+        unsigned int popped = 0;
+        while (this->m_count && this->minimum()->m_key < now)
+        {
+            Node* first = this->minimum();
+            if (PAST != first->m_slot && this->m_now < first->m_key) this->advance(first->m_key);
+
+            // a level-0 slot's nodes all have the minimum key; the past list's may not
+            TimingWheelLink* head = &this->m_slot[first->m_slot];
+            for (TimingWheelLink* l = head->m_next; l != head; )
+            {
+                Node* n = static_cast<Node*>(l);
+                l = l->m_next;
+                if (!(n->m_key < now)) continue;
+
+                this->unlink(n);
+                cb((const Node*)n);
+                this->destroy_node(n);
+                --this->m_count;
+                ++popped;
+            }
+            this->m_minimum = NULL;
+        }
+        return popped;
+    }
+
+
+    // cancel a node, wherever it is.  (minus_infinity is unused; it is here so that
+    //  TimingWheel and FibonacciHeap can be swapped for one another)
+    void remove(Node* node, Key minus_infinity)
+    {
+        this->unlink(node);
+        if (node == this->m_minimum) this->m_minimum = NULL;
+        this->destroy_node(node);
+        --this->m_count;
+    }
+
+
+    // reschedule a node, earlier or later
+    void alter_key(Node* node, Key new_key, Key minus_infinity)
+    {
+        if (new_key == node->m_key) return;
+
+        bool later = node->m_key < new_key;
+        this->unlink(node);
+        node->m_key = new_key;
+        this->place(node);
+
+        if (node == this->m_minimum)
+        {
+            if (later) this->m_minimum = NULL;
+        }
+        else if (this->m_minimum && new_key < this->m_minimum->m_key)
+        {
+            this->m_minimum = node;
+        }
+    }
+
+    void decrease_key(Node* node, Key new_key)
+    {
+        if (new_key >= node->m_key)
+            throw string("Trying to decrease key to a greater key");
+        this->alter_key(node, new_key, new_key);
+    }
+
+
+    void print_roots(ostream& out) const
+    {
+        out << "m_now=" << this->m_now << "  m_count=" << this->m_count << "  slots=";
+        for (unsigned int i = 0; i <= PAST; ++i)
+        {
+            if (this->is_vacant(i)) continue;
+
+            out << (PAST == i ? string("past") : level_slot(i)) << "(";
+            for (const TimingWheelLink* l = this->m_slot[i].m_next; l != &this->m_slot[i]; l = l->m_next)
+            {
+                static_cast<const Node*>(l)->print_node(out);
+                out << " ";
+            }
+            out << ") ";
+        }
+    }
+
+    string summary() const
+    {
+        stringstream s;
+        this->print_roots(s);
+        return s.str();
+    }
+
+
+  protected:
+
+    // the nodes are the wheel's own; copies would share them
+    TimingWheel(const TimingWheel &rhs);
+    TimingWheel& operator=(const TimingWheel &rhs);
+
+
+    static string level_slot(unsigned int i)
+    {
+        stringstream s;
+        s << "L" << i / TIMING_WHEEL_SLOTS << "." << i % TIMING_WHEEL_SLOTS;
+        return s.str();
+    }
+
+    bool is_vacant(unsigned int i) const { return this->m_slot[i].m_next == &this->m_slot[i]; }
+
+    void set_occupied(unsigned int i)
+    {
+        if (PAST != i) this->m_occupied[i / TIMING_WHEEL_SLOTS][(i % TIMING_WHEEL_SLOTS) / 64] |= 1ull << (i % 64);
+    }
+
+    void clear_occupied(unsigned int i)
+    {
+        if (PAST != i) this->m_occupied[i / TIMING_WHEEL_SLOTS][(i % TIMING_WHEEL_SLOTS) / 64] &= ~(1ull << (i % 64));
+    }
+
+
+    // the slot a key belongs in, at the current time
+    unsigned int slot_for(Key k) const
+    {
+        if (k < this->m_now) return PAST;
+
+        Key differ = k ^ this->m_now;
+        unsigned int level = 0;
+        while (differ >> TIMING_WHEEL_SLOT_BITS)
+        {
+            differ >>= TIMING_WHEEL_SLOT_BITS;
+            ++level;
+        }
+
+        return level * TIMING_WHEEL_SLOTS + ((k >> (level * TIMING_WHEEL_SLOT_BITS)) & (TIMING_WHEEL_SLOTS - 1));
+    }
+
+
+    // link a node at the end of its slot, so equal keys come out in the order they went in
+    void place(Node* n)
+    {
+        unsigned int i = this->slot_for(n->m_key);
+        TimingWheelLink* head = &this->m_slot[i];
+
+        n->m_slot = i;
+        n->m_next = head;
+        n->m_previous = head->m_previous;
+        head->m_previous->m_next = n;
+        head->m_previous = n;
+        this->set_occupied(i);
+    }
+
+    void unlink(Node* n)
+    {
+        n->m_previous->m_next = n->m_next;
+        n->m_next->m_previous = n->m_previous;
+        if (this->is_vacant(n->m_slot)) this->clear_occupied(n->m_slot);
+    }
+
+
+    // the node with the smallest key in a slot that may hold several
+    Node* earliest(unsigned int i) const
+    {
+        const TimingWheelLink* head = &this->m_slot[i];
+        Node* best = static_cast<Node*>(head->m_next);
+        for (TimingWheelLink* l = best->m_next; l != head; l = l->m_next)
+            if (static_cast<Node*>(l)->m_key < best->m_key) best = static_cast<Node*>(l);
+        return best;
+    }
+
+
+    // move the current time forward to t, which is no later than any key in the wheel.
+    //  only the slot t falls in, on the highest level where t differs from now, can
+    //  hold nodes that must move down
+    void advance(Key t)
+    {
+        Key differ = t ^ this->m_now;
+        unsigned int level = 0;
+        while (differ >> TIMING_WHEEL_SLOT_BITS)
+        {
+            differ >>= TIMING_WHEEL_SLOT_BITS;
+            ++level;
+        }
+
+        this->m_now = t;
+        if (0 == level) return;  // level-0 slots are exact; nothing moves
+
+        unsigned int i = level * TIMING_WHEEL_SLOTS + ((t >> (level * TIMING_WHEEL_SLOT_BITS)) & (TIMING_WHEEL_SLOTS - 1));
+        if (this->is_vacant(i)) return;
+
+        // take the whole list off the slot, then place each node again
+        TimingWheelLink* head = &this->m_slot[i];
+        TimingWheelLink* l = head->m_next;
+        head->m_previous->m_next = NULL;
+        head->m_previous = head->m_next = head;
+        this->clear_occupied(i);
+
+        while (l)
+        {
+            Node* n = static_cast<Node*>(l);
+            l = l->m_next;
+            this->place(n);
+        }
+    }
+
+
+    void destroy_node(Node* n)
+    {
+        n->~Node();
+        allocator_traits<NodeAlloc>::deallocate(this->m_alloc, n, 1);
+    }
+};
+
+
+template <typename Key, typename Data, typename Alloc>
+    ostream& operator<<(ostream& output, const TimingWheel<Key, Data, Alloc>& v)
+{
+    v.print_roots(output);
+    return output;
+}
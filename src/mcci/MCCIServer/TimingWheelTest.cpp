@@ -0,0 +1,163 @@
+
+#include "TimingWheel.h"
+#include "MCCIArena.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+
+void print_min(TimingWheel<uint, string>* w)
+{
+        cout << "min=";
+        w->minimum()->print_node(cout);
+        cout << endl;
+}
+
+void doTest()
+{
+    TimingWheel<uint, string> w;
+
+    // keys on every level, and two on one level-0 slot
+    w.insert(4, "a");
+    w.insert(70000, "b");
+    w.insert(300, "c");
+    w.insert(4, "d");
+    w.insert(20000000, "e");
+    w.insert(301, "f");
+    w.print_roots(cout);
+    cout << endl;
+
+    while (!w.empty())
+    {
+        print_min(&w);
+        w.remove_minimum();
+        w.print_roots(cout);
+        cout << endl;
+    }
+
+    cout << endl << endl;
+
+    // now is 20000000; a key before it is due first, however it arrives
+    vector <TimingWheelNode<uint, string>*> nodes(4);
+    nodes[0] = w.insert(20000400, "a");
+    nodes[1] = w.insert(20000100, "b");
+    nodes[2] = w.insert(19999999, "late");
+    nodes[3] = w.insert(20000000, "now");
+    w.print_roots(cout);
+    cout << endl;
+    print_min(&w);
+    if ("late" != w.minimum()->data()) throw string("a past key isn't due first");
+
+    cout << "\nReschedule a and cancel late:\n";
+    w.alter_key(nodes[0], 20000050, 0);
+    w.remove(nodes[2], 0);
+    w.print_roots(cout);
+    cout << endl;
+
+    const char* order[] = {"now", "a", "b"};
+    for (uint i = 0; i < 3; ++i)
+    {
+        print_min(&w);
+        if (order[i] != w.minimum()->data()) throw string("timing wheel out of order");
+        w.remove_minimum();
+    }
+
+    cout << endl << endl;
+}
+
+
+// random inserts, reschedules, cancels and expiries against a multimap; keys span all the
+//  levels and sometimes fall before the wheel's current time
+void doRandomTest()
+{
+    typedef TimingWheelNode<uint, uint> Node;
+    CMCCIArena arena;
+    TimingWheel<uint, uint, CMCCIArenaAllocator<Node> > w((CMCCIArenaAllocator<Node>(&arena)));
+    multimap<uint, Node*> expected;
+    vector<Node*> live;
+    uint x = 1;
+    uint now = 0;
+
+    for (uint i = 0; i < 30000; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        uint r = x >> 8;
+        uint span = (0 == r % 3) ? 100 : (0 == r % 5) ? 100000 : (0 == r % 7) ? 0x7fffffff : 2000;
+        uint k = now + (x >> 4) % span;
+        if (0 == r % 13 && now > 50) k = now - 50;  // already due
+
+        switch (r % 4)
+        {
+          case 0:
+          case 1:
+            live.push_back(w.insert(k, i));
+            break;
+
+          case 2:  // reschedule or cancel one at random
+            if (live.empty()) break;
+            {
+                uint j = (x >> 3) % live.size();
+                if (r & 0x100)
+                {
+                    w.alter_key(live[j], k, 0);
+                }
+                else
+                {
+                    w.remove(live[j], 0);
+                    live[j] = live.back();
+                    live.pop_back();
+                }
+            }
+            break;
+
+          case 3:  // expire one
+            if (w.empty()) break;
+            {
+                Node* n = w.minimum();
+                now = max(now, n->key());
+                live.erase(find(live.begin(), live.end(), n));
+                w.remove_minimum();
+            }
+            break;
+        }
+
+        // the wheel's minimum must be a smallest key of those we hold
+        if (live.size() != w.size()) throw string("timing wheel count is off");
+        if (!live.empty())
+        {
+            uint smallest = live[0]->key();
+            for (uint j = 1; j < live.size(); ++j) smallest = min(smallest, live[j]->key());
+            if (w.minimum()->key() != smallest) throw string("timing wheel minimum is wrong");
+        }
+    }
+
+    // drain, in order
+    for (uint j = 0; j < live.size(); ++j) expected.insert(make_pair(live[j]->key(), live[j]));
+    for (multimap<uint, Node*>::iterator it = expected.begin(); it != expected.end(); ++it)
+    {
+        if (w.minimum()->key() != it->first) throw string("timing wheel drained out of order");
+        w.remove_minimum();
+    }
+    if (!w.empty() || arena.get_in_use()) throw string("timing wheel left nodes behind");
+
+    cout << "\nRandom operations against a reference: " << arena.get_reserved() << " bytes reserved" << endl;
+}
+
+
+int main() {
+    try
+    {
+        doTest();
+        doRandomTest();
+    }
+    catch (string s)
+    {
+        cerr << endl << "ERROR: " << s << endl;
+        return 1;
+    }
+}